@@ -17,6 +17,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -24,52 +25,164 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/file.h>
 #include <unistd.h>
 
+#include "bc_domain_mph.h"
+
 #endif /// USER_SPACE
 
 #include "bc_domain_names.h"
+#include "bc_domain_trie.h"
+#include "bc_domain_index.h"
+
+/// @brief 计算列区中保存的域名哈希值,忽略ASCII大小写
+/// 	不带种子,只用于扫描时筛选候选记录,内核索引的哈希链另有随机种子
+unsigned int domain_name_hash(const char *name,size_t len)
+{
+	return (unsigned int)hash_key_mem(name,len,0);
+}
+
+/// @brief 有效位图中第word个字的偏移
+static size_t domain_valid_offset(const struct bc_domain_names *names,enum domain_type type,size_t word)
+{
+	return names->domain_column_start[type]+word*sizeof(unsigned long long);
+}
+
+/// @brief 哈希数组中第index项的偏移
+static size_t domain_hash_offset(const struct bc_domain_names *names,enum domain_type type,size_t index)
+{
+	return names->domain_column_start[type]+
+		DOMAIN_VALID_WORDS(names->domain_type_max_len[type])*sizeof(unsigned long long)+
+		index*sizeof(unsigned int);
+}
+
+/// @brief 长度数组中第index项的偏移
+static size_t domain_len_offset(const struct bc_domain_names *names,enum domain_type type,size_t index)
+{
+	return domain_hash_offset(names,type,names->domain_type_max_len[type])+index;
+}
+
+/// @brief 按mask置位或清除有效位图中的一个字
+/// 	共享内存区中以原子操作修改,并行的写进程可以修改同一个字中不同的位
+/// @retval 成功0 失败错误代码负值
+static int update_domain_valid(struct bc_domain_db *db,enum domain_type type,size_t word,
+		unsigned long long mask,bool valid)
+{
+	const size_t off=domain_valid_offset(&db->domain_names,type,word);
+	unsigned long long *p=(unsigned long long*)get_domain_db_ptr(db,off,sizeof(*p));
+	unsigned long long w=0;
+	int err=0;
+	if(NULL!=p)
+	{
+		if(valid)
+			__atomic_fetch_or(p,mask,__ATOMIC_RELEASE);
+		else
+			__atomic_fetch_and(p,~mask,__ATOMIC_RELEASE);
+		return 0;
+	}
+	/// bigmem存储在独占锁下读改写
+	if((err=read_domain_db(db,off,&w,sizeof(w)))<0)
+		return err;
+	w=valid?(w|mask):(w&~mask);
+	return write_domain_db(db,off,&w,sizeof(w));
+}
+
+/// @brief 写入下标为index的记录的长度和哈希值
+/// @retval 成功0 失败错误代码负值
+static int set_domain_column(struct bc_domain_db *db,enum domain_type type,size_t index,
+		const struct domain_name *name)
+{
+	unsigned char len=strnlen(name->name,DOMAIN_MAX_LENGTH-1);
+	unsigned int hash=domain_name_hash(name->name,len);
+	int err=0;
+	if((err=write_domain_db(db,domain_hash_offset(&db->domain_names,type,index),
+					&hash,sizeof(hash)))<0)
+		return err;
+	return write_domain_db(db,domain_len_offset(&db->domain_names,type,index),&len,sizeof(len));
+}
+
+/// @brief 清除type类别[from,to)记录的列
+/// @retval 成功0 失败错误代码负值
+static int clear_domain_columns(struct bc_domain_db *db,enum domain_type type,size_t from,size_t to)
+{
+	static const unsigned char zero[256];
+	size_t i=0;
+	int err=0;
+	/// 有效位图按字清除,首尾不完整的字只清除范围内的位
+	for(i=from;i<to&&err>=0;i=(i|63)+1)
+	{
+		size_t end=(i|63)+1<to?(i|63)+1:to;
+		unsigned long long mask=end-i<64?((1ull<<(end-i))-1)<<(i%64):~0ull;
+		err=update_domain_valid(db,type,i/64,mask,false);
+	}
+	/// 哈希数组与长度数组
+	for(i=from;i<to&&err>=0;)
+	{
+		size_t n=(to-i)*sizeof(unsigned int)<sizeof(zero)?to-i:sizeof(zero)/sizeof(unsigned int);
+		err=write_domain_db(db,domain_hash_offset(&db->domain_names,type,i),zero,n*sizeof(unsigned int));
+		if(err>=0)
+			err=write_domain_db(db,domain_len_offset(&db->domain_names,type,i),zero,n);
+		i+=n;
+	}
+	return err;
+}
 
 #ifndef USER_SPACE
 /// @brief 内核函数，初始化bc_domain_db
-int init_bc_domain_db(struct bc_domain_db *db)
+/// @param[in] backend db的存储方式
+int init_bc_domain_db(struct bc_domain_db *db,enum domain_backend backend)
 {
 	int i=0;
 	int err=0;
 	size_t sum=0;
-	size_t max_len[DOMAIN_TYPE_NUM]={
-		WEBPAGE_DOMAIN_MAX_COUNT,
-		BLANK_DOMAIN_MAX_COUNT,
-		DOWNLOAD_DOMAIN_MAX_COUNT,
-		MULTIMEDIA_DOMAIN_MAX_COUNT,
-		INTERNATIONAL_DOMAIN_MAX_COUNT,
-		SHOPPING_DOMAIN_MAX_COUNT
-	};
 	/// 初始化bc_domain_names
 	db->domain_names.is_update=false;
+	db->domain_names.journal_seq=0;
+	db->domain_names.journal_reserved=0;
 	memset(db->domain_names.domain_type_len,0,
 			sizeof(db->domain_names.domain_type_len));
-	for(i=0;i<DOMAIN_TYPE_NUM;i++)
-		db->domain_names.domain_type_max_len[i]=max_len[i];
-	sum=sizeof(struct bc_domain_names);
-	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	sum=init_bc_domain_layout(&db->domain_names);
+	memset(&db->region,0,sizeof(db->region));
+	/// 初始化存储
+	if(DOMAIN_BACKEND_REGION==backend)
 	{
-		db->domain_names.domain_type_start[i]=sum;
-		sum+=max_len[i];
+		if((err=init_domain_region(&db->region,sum))<0)
+		{
+			printk(KERN_ERR "init_domain_region error\n");
+			return err;
+		}
 	}
-	/// 初始化bigmem
-	if((err=init_bigmem(&db->mem,
-					DOMAIN_MAX_COUNT*sizeof(struct domain_name)+sizeof(struct bc_domain_names),
-					GFP_KERNEL))<0)
+	else if((err=init_bigmem(&db->mem,sum,GFP_KERNEL))<0)
 	{
 		printk(KERN_ERR "init_bigmem error\n");
 		return err;
 	}
+	/// 初始时没有最小完美哈希索引,通配规则,有序索引和压缩trie,各记录均无效
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		struct domain_mph mph;
+		struct domain_glob glob;
+		struct domain_order order;
+		struct domain_trie trie;
+		memset(&mph,0,sizeof(mph));
+		memset(&glob,0,sizeof(glob));
+		memset(&order,0,sizeof(order));
+		memset(&trie,0,sizeof(trie));
+		if((err=set_domain_mph(&mph,db,i))<0||(err=set_domain_glob(&glob,db,i))<0
+				||(err=set_domain_order(&order,db,i))<0||(err=set_domain_trie(&trie,db,i))<0
+				||(err=clear_domain_columns(db,i,0,db->domain_names.domain_type_max_len[i]))<0)
+		{
+			printk(KERN_ERR "write domain_mph error\n");
+			clean_bc_domain_db(db);
+			return err;
+		}
+	}
 	/// bc_domain_name
 	if((err=save_bc_domain_names(db))<0)
 	{
 		printk(KERN_ERR "write bc_domain_names error\n");
-		clean_bigmem(&db->mem);
+		clean_bc_domain_db(db);
 	}
 	return err;
 }
@@ -79,17 +192,67 @@ int clean_bc_domain_db(struct bc_domain_db *db)
 {
 	memset(&db->domain_names,0,sizeof(struct bc_domain_names));
 	/// 清除内存
-	clean_bigmem(&db->mem);
+	if(NULL!=db->region.base)
+		clean_domain_region(&db->region);
+	else
+		clean_bigmem(&db->mem);
 	return 0;
 }
 
 #else
+/// @brief 映射字符设备或文件中的共享内存区
+/// 	先映射头部得到db大小,再映射整个区域
+/// @retval 成功0 错误返回错误代码的负值
+static int load_domain_region(const char *path,struct bc_domain_db *db)
+{
+	struct domain_region head;
+	size_t size=0;
+	int err=0;
+	int fd=0;
+	if((fd=open(path,O_RDWR|O_CLOEXEC))<0)
+	{
+		error_at_line(0,errno,__FILE__,__LINE__,"open %s error",path);
+		return -errno;
+	}
+	if((err=map_domain_region(&head,fd,sizeof(struct bc_domain_names)))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"mmap %s error",path);
+		close(fd);
+		return err;
+	}
+	memcpy(&db->domain_names,head.base,sizeof(db->domain_names));
+	head.fd=-1;
+	clean_domain_region(&head);
+	if(BC_DOMAIN_MAGIC!=db->domain_names.magic)
+	{
+		error_at_line(0,EINVAL,__FILE__,__LINE__,"%s is not a bc_domain db",path);
+		close(fd);
+		return -EINVAL;
+	}
+	size=get_bc_domain_db_size(&db->domain_names);
+	if((err=map_domain_region(&db->region,fd,size))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"mmap %s error",path);
+		close(fd);
+		return err;
+	}
+	return 0;
+}
+
 /// @brief 用户函数,从文件中反序列化db结构
 /// @retval 成功0 错误返回错误代码的负值
 int load_bc_domain_db(const char *path,struct bc_domain_db *db)
 {
-	if(NULL==db)
+	struct stat st;
+	if(NULL==db||NULL==path)
 		return -EINVAL;
+	memset(&db->region,0,sizeof(db->region));
+	db->region.fd=-1;
+	/// 并行的写进程在同一文件上加锁,打开失败时不加锁
+	db->lock_fd=open(path,O_RDONLY|O_CLOEXEC);
+	/// 模块的字符设备或模拟的共享文件,proc文件的大小为0
+	if(stat(path,&st)==0&&(S_ISCHR(st.st_mode)||(S_ISREG(st.st_mode)&&st.st_size>0)))
+		return load_domain_region(path,db);
 	/// 从文件中读取全部内容
 	char buf[1024]="";
 	const int buf_len=sizeof(buf)/sizeof(buf[0]);
@@ -139,16 +302,511 @@ int load_bc_domain_db(const char *path,struct bc_domain_db *db)
 
 void unload_bc_domain_db(struct bc_domain_db *db)
 {
-	unmmap_clean_bigmem(&db->mem);
+	if(NULL!=db->region.base)
+		clean_domain_region(&db->region);
+	else
+		unmmap_clean_bigmem(&db->mem);
+	if(db->lock_fd>=0)
+		close(db->lock_fd);
+	db->lock_fd=-1;
+}
+
+/// @brief 用户函数,创建与模块布局相同的空db
+/// @retval 成功0 错误返回错误代码的负值
+int create_bc_domain_db(const char *path,struct bc_domain_db *db)
+{
+	size_t sum=0;
+	int err=0;
+	if(NULL==db)
+		return -EINVAL;
+	memset(&db->domain_names,0,sizeof(db->domain_names));
+	sum=init_bc_domain_layout(&db->domain_names);
+	/// 新建的区域全为0,即没有域名和最小完美哈希索引
+	if((err=init_domain_region(&db->region,path,sum))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"create %s error",NULL==path?"memfd":path);
+		return err;
+	}
+	db->lock_fd=NULL==path?-1:open(path,O_RDONLY|O_CLOEXEC);
+	return save_bc_domain_names(db);
+}
+
+/// @brief 用户函数,返回默认的db路径
+const char *get_bc_domain_db_path(void)
+{
+	if(access(REGION_DEV_PATH,R_OK|W_OK)==0)
+		return REGION_DEV_PATH;
+	return PROC_PATH;
 }
 
 /// @breif 整理数据结构中的内存，避免碎片
+/// 	去掉无效记录,并重新编译最小完美哈希索引
 void defrag_mentation(struct bc_domain_db *db,enum domain_type type)
 {
+	int err=0;
+	if((err=compile_domain_mph(db,type))<0)
+		error_at_line(0,-err,__FILE__,__LINE__,"defrag type %d error",type);
+}
+
+/// @brief 返回共享内存区中头部的指针,写进程经原子操作更新其中的计数
+/// @retval 存储为共享内存区时返回指针 bigmem存储返回NULL
+static struct bc_domain_names *get_domain_db_head(struct bc_domain_db *db)
+{
+	return (struct bc_domain_names*)get_domain_db_ptr(db,0,sizeof(struct bc_domain_names));
+}
+
+/// @brief 用户函数,对db加文件锁并重新读取头部
+/// @retval 成功0 失败错误代码负值
+int lock_bc_domain_db(struct bc_domain_db *db,bool exclusive)
+{
+	int err=0;
+	if(NULL==db)
+		return -EINVAL;
+	/// bigmem存储没有直接指针,无法原子地更新计数
+	if(NULL==get_domain_db_head(db))
+		exclusive=true;
+	while(db->lock_fd>=0&&flock(db->lock_fd,exclusive?LOCK_EX:LOCK_SH)<0)
+	{
+		if(EINTR==errno)
+			continue;
+		err=-errno;
+		error_at_line(0,-err,__FILE__,__LINE__,"lock db error");
+		return err;
+	}
+	/// 等待期间其他进程可能已改写头部
+	if((err=read_domain_db(db,0,&db->domain_names,sizeof(db->domain_names)))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"read db header error");
+		unlock_bc_domain_db(db);
+	}
+	return err;
+}
+
+/// @brief 用户函数,释放文件锁
+void unlock_bc_domain_db(struct bc_domain_db *db)
+{
+	if(NULL!=db&&db->lock_fd>=0)
+		flock(db->lock_fd,LOCK_UN);
+}
+
+/// @brief 用户函数,预留type类别末尾的一条记录
+/// @retval 成功0 类别已满返回-ENOSPC 失败错误代码负值
+int reserve_domain_name(struct bc_domain_db *db,enum domain_type type,size_t *index)
+{
+	struct bc_domain_names *head=NULL;
+	const size_t off=offsetof(struct bc_domain_names,domain_type_len[type]);
+	size_t max_len=0;
+	size_t len=0;
+	int err=0;
+	if(NULL==db||NULL==index||type<0||DOMAIN_TYPE_NUM<=type)
+		return -EINVAL;
+	max_len=db->domain_names.domain_type_max_len[type];
+	if(NULL!=(head=get_domain_db_head(db)))
+	{
+		/// 有上限的fetch-add,类别已满时不改变记录个数
+		len=__atomic_load_n(&head->domain_type_len[type],__ATOMIC_ACQUIRE);
+		do
+		{
+			if(len>=max_len)
+				return -ENOSPC;
+		}while(!__atomic_compare_exchange_n(&head->domain_type_len[type],&len,len+1,
+					false,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE));
+	}
+	else
+	{
+		/// bigmem存储在独占锁下读写记录个数
+		if((err=read_domain_db(db,off,&len,sizeof(len)))<0)
+			return err;
+		if(len>=max_len)
+			return -ENOSPC;
+		len++;
+		if((err=write_domain_db(db,off,&len,sizeof(len)))<0)
+			return err;
+		len--;
+	}
+	*index=len;
+	if(db->domain_names.domain_type_len[type]<=len)
+		db->domain_names.domain_type_len[type]=len+1;
+	return 0;
+}
+
+/// @brief 用户函数,写入预留的记录并发布
+/// @retval 成功0 失败错误代码负值
+int publish_domain_name(const struct domain_name *name,struct bc_domain_db *db,
+		enum domain_type type,size_t index)
+{
+	struct domain_name tmp;
+	int err=0;
+	if(NULL==name||NULL==db||type<0||DOMAIN_TYPE_NUM<=type)
+		return -EINVAL;
+	memcpy(&tmp,name,sizeof(tmp));
+	tmp.is_vaild=false;
+	if((err=set_domain_name(&tmp,db,type,index))<0||!name->is_vaild)
+		return err;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	if((err=write_domain_db(db,db->domain_names.domain_type_start[type]+
+			index*sizeof(struct domain_name)+offsetof(struct domain_name,is_vaild),
+			&name->is_vaild,sizeof(name->is_vaild)))<0)
+		return err;
+	/// 最后置有效位,扫描列区的进程读到有效位时记录已发布
+	return update_domain_valid(db,type,index/64,1ull<<(index%64),true);
+}
+
+/// @brief 用户函数,将type类别[from,to)的记录清零
+/// @retval 成功0 失败错误代码负值
+int clear_domain_names(struct bc_domain_db *db,enum domain_type type,size_t from,size_t to)
+{
+	struct domain_name empty[DOMAIN_ITER_BATCH];
+	int err=0;
+	if(NULL==db||type<0||DOMAIN_TYPE_NUM<=type)
+		return -EINVAL;
+	if(to>db->domain_names.domain_type_max_len[type])
+		to=db->domain_names.domain_type_max_len[type];
+	memset(empty,0,sizeof(empty));
+	while(from<to&&err>=0)
+	{
+		size_t n=to-from<DOMAIN_ITER_BATCH?to-from:DOMAIN_ITER_BATCH;
+		if((err=clear_domain_columns(db,type,from,from+n))<0)
+			break;
+		err=write_domain_db(db,db->domain_names.domain_type_start[type]+
+				from*sizeof(struct domain_name),empty,n*sizeof(struct domain_name));
+		from+=n;
+	}
+	return err;
+}
+
+/// 发布日志时等待之前预留序号的写进程的最长时间,超时视其已退出
+#define DOMAIN_JOURNAL_WAIT_US 1000000
+/// 等待时每次休眠的时间
+#define DOMAIN_JOURNAL_POLL_US 50
+
+/// @brief 用户函数,向修改日志追加一条记录并发布新的序号
+/// 	先原子地预留序号并写入日志记录,再按序号顺序写入序号,内核读到序号时记录已经完整
+/// @retval 成功0 失败错误代码负值
+int append_domain_journal(struct bc_domain_db *db,enum domain_journal_op op,
+		enum domain_type type,size_t index)
+{
+	struct domain_journal_entry entry;
+	memset(&entry,0,sizeof(entry));
+	entry.index=index;
+	entry.type=type;
+	entry.op=op;
+	return append_domain_journals(db,&entry,1);
+}
+
+/// @brief 用户函数,向修改日志追加num条记录,最后一次写入序号
+/// 	一次预留num个连续的序号,全部记录写入后才发布最大的序号
+/// @retval 成功0 失败错误代码负值
+int append_domain_journals(struct bc_domain_db *db,struct domain_journal_entry *entries,size_t num)
+{
+	struct bc_domain_names *head=NULL;
+	unsigned long long seq=0;
+	unsigned long long first=0;
+	unsigned long long cur=0;
+	size_t i=0;
+	int waited=0;
+	int err=0;
+	if(NULL==db||NULL==entries)
+		return -EINVAL;
+	if(0==db->domain_names.journal_start)
+		return -EINVAL;
+	if(0==num)
+		return 0;
+	/// 超过日志容量时内核无法增量应用
+	if(num>DOMAIN_JOURNAL_SIZE)
+		return -E2BIG;
+	for(i=0;i<num;i++)
+	{
+		if(entries[i].type>=DOMAIN_TYPE_NUM)
+			return -EINVAL;
+	}
+	head=get_domain_db_head(db);
+	/// bigmem存储在独占锁下执行,头部已在加锁时重新读取
+	if(NULL!=head)
+		seq=__atomic_add_fetch(&head->journal_reserved,num,__ATOMIC_ACQ_REL);
+	else
+		seq=db->domain_names.journal_seq+num;
+	first=seq-num+1;
+	for(i=0;i<num;i++)
+	{
+		entries[i].seq=first+i;
+		if((err=write_domain_db(db,db->domain_names.journal_start+
+						(entries[i].seq&(DOMAIN_JOURNAL_SIZE-1))*sizeof(entries[i]),
+						entries+i,sizeof(entries[i])))<0)
+		{
+			error_at_line(0,-err,__FILE__,__LINE__,"write journal error");
+			return err;
+		}
+	}
+	if(NULL==head)
+	{
+		__sync_synchronize();
+		if((err=write_domain_db(db,offsetof(struct bc_domain_names,journal_seq),
+						&seq,sizeof(seq)))<0||
+				(err=write_domain_db(db,offsetof(struct bc_domain_names,journal_reserved),
+						&seq,sizeof(seq)))<0)
+		{
+			error_at_line(0,-err,__FILE__,__LINE__,"write journal seq error");
+			return err;
+		}
+		db->domain_names.journal_seq=seq;
+		db->domain_names.journal_reserved=seq;
+		return 0;
+	}
+	/// 之前的序号发布后才能发布seq,否则内核会越过未写完的日志
+	cur=__atomic_load_n(&head->journal_seq,__ATOMIC_ACQUIRE);
+	while(cur+1<first&&waited<DOMAIN_JOURNAL_WAIT_US)
+	{
+		usleep(DOMAIN_JOURNAL_POLL_US);
+		waited+=DOMAIN_JOURNAL_POLL_US;
+		cur=__atomic_load_n(&head->journal_seq,__ATOMIC_ACQUIRE);
+	}
+	/// 超时后越过之前的序号,内核读到序号不符的日志时完全重建
+	if(cur+1<first)
+	{
+		error_at_line(0,ETIMEDOUT,__FILE__,__LINE__,"wait journal %llu timeout,skip to %llu",cur+1,seq);
+		err=-EAGAIN;
+	}
+	/// 已被超时的写进程越过,记录只能由完全重建载入
+	else if(cur>=first)
+		err=-EAGAIN;
+	while(cur<seq&&!__atomic_compare_exchange_n(&head->journal_seq,&cur,seq,
+				false,__ATOMIC_RELEASE,__ATOMIC_ACQUIRE))
+		;
+	/// 本地头部随之更新,之后保存头部时不会退回计数
+	db->domain_names.journal_seq=cur>seq?cur:seq;
+	if(db->domain_names.journal_reserved<seq)
+		db->domain_names.journal_reserved=seq;
+	return err;
+}
+
+/// @brief 初始化迭代器,遍历type类别的全部记录
+/// @retval 成功0 失败错误代码负值
+int domain_iter_init(struct domain_iter *it,struct bc_domain_db *db,enum domain_type type)
+{
+	if(NULL==it||NULL==db)
+		return -EINVAL;
+	if(type<0||DOMAIN_TYPE_NUM<=type)
+		return -EFAULT;
+	it->db=db;
+	it->type=type;
+	it->index=0;
+	it->end=db->domain_names.domain_type_len[type];
+	it->batch_start=0;
+	it->batch_len=0;
+	it->span=NULL;
+	it->err=0;
+	return 0;
+}
+
+/// @brief 返回下一条记录,指针在下一次调用前有效
+/// 	共享内存区直接返回记录指针,bigmem每DOMAIN_ITER_BATCH条记录只读取一次
+/// @retval 记录指针 结束或出错返回NULL
+const struct domain_name *domain_iter_next(struct domain_iter *it,size_t *index)
+{
+	if(NULL==it||it->err<0||it->index>=it->end)
+		return NULL;
+	if(it->index>=it->batch_start+it->batch_len)
+	{
+		size_t len=it->end-it->index;
+		if((it->span=get_domain_name_span(it->db,it->type,it->index,&len,
+						it->batch,DOMAIN_ITER_BATCH))==NULL)
+		{
+			error_at_line(0,EFAULT,__FILE__,__LINE__,"read_bigmem error");
+			it->err=-EFAULT;
+			return NULL;
+		}
+		it->batch_start=it->index;
+		it->batch_len=len;
+	}
+	if(NULL!=index)
+		*index=it->index;
+	return it->span+(it->index++-it->batch_start);
 }
 
 #endif
 
+/// @brief 依据各类域名的最大个数设置布局
+/// @retval db所需的字节数
+size_t init_bc_domain_layout(struct bc_domain_names *names)
+{
+	int i=0;
+	size_t sum=0;
+	size_t max_len[DOMAIN_TYPE_NUM]={
+		WEBPAGE_DOMAIN_MAX_COUNT,
+		BLANK_DOMAIN_MAX_COUNT,
+		DOWNLOAD_DOMAIN_MAX_COUNT,
+		MULTIMEDIA_DOMAIN_MAX_COUNT,
+		INTERNATIONAL_DOMAIN_MAX_COUNT,
+		SHOPPING_DOMAIN_MAX_COUNT
+	};
+	names->magic=BC_DOMAIN_MAGIC;
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+		names->domain_type_max_len[i]=max_len[i];
+	sum=sizeof(struct bc_domain_names);
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		names->domain_type_start[i]=sum;
+		sum+=max_len[i]*sizeof(struct domain_name);
+	}
+	/// 列区位于域名数组之后
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		names->domain_column_start[i]=sum;
+		sum+=DOMAIN_COLUMN_SIZE(max_len[i]);
+	}
+	/// 最小完美哈希区位于列区之后
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		names->domain_mph_start[i]=sum;
+		sum+=DOMAIN_MPH_SIZE(max_len[i]);
+	}
+	/// 通配规则区位于最小完美哈希区之后
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		names->domain_glob_start[i]=sum;
+		sum+=DOMAIN_GLOB_SIZE;
+	}
+	/// 有序索引区位于通配规则区之后
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		names->domain_order_start[i]=sum;
+		sum+=DOMAIN_ORDER_SIZE(max_len[i]);
+	}
+	/// 压缩trie区位于有序索引区之后
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		names->domain_trie_start[i]=sum;
+		sum+=DOMAIN_TRIE_SIZE(max_len[i]);
+	}
+	/// 修改日志区位于最后
+	names->journal_start=sum;
+	sum+=DOMAIN_JOURNAL_AREA_SIZE;
+	return sum;
+}
+
+/// @brief 依据头部计算db所需的字节数
+size_t get_bc_domain_db_size(const struct bc_domain_names *names)
+{
+	size_t size=sizeof(struct bc_domain_names);
+	int i=0;
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		size_t end=names->domain_type_start[i]+
+			names->domain_type_max_len[i]*sizeof(struct domain_name);
+		if(end>size)
+			size=end;
+		end=names->domain_column_start[i]+DOMAIN_COLUMN_SIZE(names->domain_type_max_len[i]);
+		if(end>size)
+			size=end;
+		end=names->domain_mph_start[i]+DOMAIN_MPH_SIZE(names->domain_type_max_len[i]);
+		if(end>size)
+			size=end;
+		end=names->domain_glob_start[i]+DOMAIN_GLOB_SIZE;
+		if(end>size)
+			size=end;
+		end=names->domain_order_start[i]+DOMAIN_ORDER_SIZE(names->domain_type_max_len[i]);
+		if(end>size)
+			size=end;
+		end=names->domain_trie_start[i]+DOMAIN_TRIE_SIZE(names->domain_type_max_len[i]);
+		if(end>size)
+			size=end;
+	}
+	if(names->journal_start+DOMAIN_JOURNAL_AREA_SIZE>size)
+		size=names->journal_start+DOMAIN_JOURNAL_AREA_SIZE;
+	return size;
+}
+
+/// @brief 返回db存储中[offset,offset+len)的直接指针
+/// @retval 存储为共享内存区时返回指针 否则返回NULL
+const void *get_domain_db_ptr(struct bc_domain_db *db,size_t offset,size_t len)
+{
+	if(NULL==db->region.base)
+		return NULL;
+	if(offset>db->region.size||len>db->region.size-offset)
+		return NULL;
+	return (const char*)db->region.base+offset;
+}
+
+/// @brief 返回type类别从index开始的一段连续记录
+/// @retval 记录指针 越界或出错返回NULL
+const struct domain_name *get_domain_name_span(struct bc_domain_db *db,enum domain_type type,
+		size_t index,size_t *num,struct domain_name *buf,size_t buf_num)
+{
+	const struct domain_name *span=NULL;
+	size_t offset=0;
+	size_t n=0;
+	if(NULL==db||NULL==num||type<0||DOMAIN_TYPE_NUM<=type)
+		return NULL;
+	if(index>=db->domain_names.domain_type_len[type])
+		return NULL;
+	n=db->domain_names.domain_type_len[type]-index;
+	if(n>*num)
+		n=*num;
+	offset=db->domain_names.domain_type_start[type]+index*sizeof(struct domain_name);
+	if((span=get_domain_db_ptr(db,offset,n*sizeof(struct domain_name)))==NULL)
+	{
+		/// bigmem存储的布局不可见,一次读取一段到缓冲区
+		if(NULL==buf||0==buf_num)
+			return NULL;
+		if(n>buf_num)
+			n=buf_num;
+		if(read_domain_db(db,offset,buf,n*sizeof(struct domain_name))<0)
+			return NULL;
+		span=buf;
+	}
+	*num=n;
+	return span;
+}
+
+/// @brief 从db的存储中读取len字节
+/// @retval 成功0 失败错误代码负值
+int read_domain_db(struct bc_domain_db *db,size_t offset,void *buf,size_t len)
+{
+	if(NULL!=db->region.base)
+	{
+		if(offset>db->region.size||len>db->region.size-offset)
+			return -EFAULT;
+		memcpy(buf,(const char*)db->region.base+offset,len);
+		return 0;
+	}
+#ifdef USER_SPACE
+	return read_bigmem(&db->mem,offset,buf,len);
+#else
+	return read_bigmem_bh(&db->mem,offset,buf,len);
+#endif
+}
+
+/// @brief 向db的存储中写入len字节
+/// @retval 成功0 失败错误代码负值
+int write_domain_db(struct bc_domain_db *db,size_t offset,const void *buf,size_t len)
+{
+	if(NULL!=db->region.base)
+	{
+		if(offset>db->region.size||len>db->region.size-offset)
+			return -EFAULT;
+		memcpy((char*)db->region.base+offset,buf,len);
+		return 0;
+	}
+#ifdef USER_SPACE
+	return write_bigmem(&db->mem,offset,buf,len);
+#else
+	return write_bigmem_bh(&db->mem,offset,buf,len);
+#endif
+}
+
+/// @brief 读取序号为seq的修改日志
+/// @retval 成功0 失败错误代码负值
+int read_domain_journal(struct bc_domain_db *db,unsigned long long seq,
+		struct domain_journal_entry *entry)
+{
+	if(NULL==db||NULL==entry||0==db->domain_names.journal_start)
+		return -EINVAL;
+	return read_domain_db(db,db->domain_names.journal_start+
+			(seq&(DOMAIN_JOURNAL_SIZE-1))*sizeof(struct domain_journal_entry),
+			entry,sizeof(struct domain_journal_entry));
+}
+
 /// @brief 设置更新标识
 int set_update_domain_db(struct bc_domain_db *db,bool isupdate)
 {
@@ -157,12 +815,9 @@ int set_update_domain_db(struct bc_domain_db *db,bool isupdate)
 	if(NULL==db)
 		return -EINVAL;
 	db->domain_names.is_update=isupdate;
-	/// 写入内存
-#ifdef USER_SPACE
-	if((err=write_bigmem(&db->mem,0,&db->domain_names,sizeof(struct bc_domain_names)))<0)
-#else
-	if((err=write_bigmem_bh(&db->mem,0,&db->domain_names,sizeof(struct bc_domain_names)))<0)
-#endif
+	/// 只写入更新标识,不覆盖其他写进程更新的计数
+	if((err=write_domain_db(db,offsetof(struct bc_domain_names,is_update),
+					&db->domain_names.is_update,sizeof(db->domain_names.is_update)))<0)
 	{
 #ifndef USER_SPACE
 		printk(KERN_ERR "write_bigmem error");
@@ -197,15 +852,9 @@ int get_domain_name(struct domain_name *name,struct bc_domain_db *db,enum domain
 	if(index>=db->domain_names.domain_type_len[type])
 		return -EFAULT;
 	/// 获取内存
-#ifdef USER_SPACE
-	if((err=read_bigmem(&db->mem,
+	if((err=read_domain_db(db,
 					db->domain_names.domain_type_start[type]+index*sizeof(struct domain_name),
 					name,sizeof(struct domain_name)))<0)
-#else
-	if((err=read_bigmem_bh(&db->mem,
-					db->domain_names.domain_type_start[type]+index*sizeof(struct domain_name),
-					name,sizeof(struct domain_name)))<0)
-#endif
 	{
 #ifdef USER_SPACE
 		error_at_line(0,-err,__FILE__,__LINE__,"read_bigmem error");
@@ -229,16 +878,14 @@ int set_domain_name(const struct domain_name *name,struct bc_domain_db *db,enum
 		return -EFAULT;
 	if(index>=db->domain_names.domain_type_len[type])
 		return -EFAULT;
+	/// 先清除有效位,扫描列区的进程不会读到改写了一半的记录
+	if((err=update_domain_valid(db,type,index/64,1ull<<(index%64),false))<0)
+		return err;
 	/// 设置内存
-#ifdef USER_SPACE
-	if((err=write_bigmem(&db->mem,
+	if((err=write_domain_db(db,
 				db->domain_names.domain_type_start[type]+index*sizeof(struct domain_name),
-				name,sizeof(struct domain_name)))<0)
-#else
-	if((err=write_bigmem_bh(&db->mem,
-				db->domain_names.domain_type_start[type]+index*sizeof(struct domain_name),
-				name,sizeof(struct domain_name)))<0)
-#endif
+				name,sizeof(struct domain_name)))<0||
+			(err=set_domain_column(db,type,index,name))<0)
 	{
 #ifdef USER_SPACE
 		error_at_line(0,-err,__FILE__,__LINE__,"write_bigmem error");
@@ -247,19 +894,279 @@ int set_domain_name(const struct domain_name *name,struct bc_domain_db *db,enum
 #endif
 		return err;
 	}
+	if(name->is_vaild)
+		return update_domain_valid(db,type,index/64,1ull<<(index%64),true);
 	return 0;
 }
 
+/// @brief 读取type类别从start开始至多DOMAIN_COLUMN_BATCH条记录的列
+/// 	共享内存区中直接指向列区,bigmem存储读取到cols的缓冲区
+/// @retval 成功返回记录个数,越界返回0 失败错误代码负值
+int get_domain_columns(struct domain_columns *cols,struct bc_domain_db *db,
+		enum domain_type type,size_t start)
+{
+	const struct bc_domain_names *names=NULL;
+	size_t words=0;
+	size_t n=0;
+	int err=0;
+	if(NULL==cols||NULL==db||type<0||DOMAIN_TYPE_NUM<=type)
+		return -EINVAL;
+	names=&db->domain_names;
+	cols->start=start;
+	cols->num=0;
+	/// 越界时返回0,按cols->num遍历时最后一次调用的start可以不是64的倍数
+	if(start>=names->domain_type_len[type])
+		return 0;
+	if(0!=start%64)
+		return -EINVAL;
+	n=names->domain_type_len[type]-start;
+	if(n>DOMAIN_COLUMN_BATCH)
+		n=DOMAIN_COLUMN_BATCH;
+	words=(n+63)/64;
+	cols->valid=get_domain_db_ptr(db,domain_valid_offset(names,type,start/64),
+			words*sizeof(unsigned long long));
+	cols->hash=get_domain_db_ptr(db,domain_hash_offset(names,type,start),n*sizeof(unsigned int));
+	cols->len=get_domain_db_ptr(db,domain_len_offset(names,type,start),n);
+	if(NULL==cols->valid||NULL==cols->hash||NULL==cols->len)
+	{
+		/// bigmem存储的布局不可见,各列读取到缓冲区
+		if((err=read_domain_db(db,domain_valid_offset(names,type,start/64),cols->valid_buf,
+						words*sizeof(unsigned long long)))<0||
+				(err=read_domain_db(db,domain_hash_offset(names,type,start),cols->hash_buf,
+						n*sizeof(unsigned int)))<0||
+				(err=read_domain_db(db,domain_len_offset(names,type,start),cols->len_buf,n))<0)
+			return err;
+		cols->valid=cols->valid_buf;
+		cols->hash=cols->hash_buf;
+		cols->len=cols->len_buf;
+	}
+	cols->num=n;
+	return n;
+}
+
+/// @brief 读取type类别的最小完美哈希索引
+/// @retval 成功0 失败错误代码的负值
+int get_domain_mph(struct domain_mph *mph,size_t size,struct bc_domain_db *db,enum domain_type type)
+{
+	int err=0;
+	size_t offset=0;
+	if(NULL==db||NULL==mph||size<sizeof(struct domain_mph))
+		return -EINVAL;
+	if(DOMAIN_TYPE_NUM<=type)
+		return -EFAULT;
+	offset=db->domain_names.domain_mph_start[type];
+	if((err=read_domain_db(db,offset,mph,sizeof(struct domain_mph)))<0)
+		return err;
+	if(0==mph->slot_num)
+		return 0;
+	/// 校验索引大小
+	if(0==mph->bucket_num||
+			sizeof(struct domain_mph)+mph->bucket_num*sizeof(unsigned short)>size||
+			DOMAIN_MPH_SIZE(db->domain_names.domain_type_max_len[type])<
+			sizeof(struct domain_mph)+mph->bucket_num*sizeof(unsigned short))
+	{
+		mph->slot_num=0;
+		return -EFAULT;
+	}
+	err=read_domain_db(db,offset+sizeof(struct domain_mph),mph->disp,
+			mph->bucket_num*sizeof(unsigned short));
+	if(err<0)
+		mph->slot_num=0;
+	return err<0?err:0;
+}
+
+/// @brief 写入type类别的最小完美哈希索引
+/// @retval 成功0 失败错误代码的负值
+int set_domain_mph(const struct domain_mph *mph,struct bc_domain_db *db,enum domain_type type)
+{
+	size_t size=sizeof(struct domain_mph);
+	if(NULL==db||NULL==mph)
+		return -EINVAL;
+	if(DOMAIN_TYPE_NUM<=type)
+		return -EFAULT;
+	if(mph->slot_num>0)
+		size+=mph->bucket_num*sizeof(unsigned short);
+	if(size>DOMAIN_MPH_SIZE(db->domain_names.domain_type_max_len[type]))
+		return -EFAULT;
+	return write_domain_db(db,db->domain_names.domain_mph_start[type],mph,size);
+}
+
+/// @brief 读取type类别的通配规则DFA
+/// @retval 成功0 失败错误代码的负值
+int get_domain_glob(struct domain_glob *glob,size_t size,struct bc_domain_db *db,enum domain_type type)
+{
+	int err=0;
+	size_t offset=0;
+	size_t len=0;
+	if(NULL==db||NULL==glob||size<sizeof(struct domain_glob))
+		return -EINVAL;
+	if(DOMAIN_TYPE_NUM<=type)
+		return -EFAULT;
+	offset=db->domain_names.domain_glob_start[type];
+	if((err=read_domain_db(db,offset,glob,sizeof(struct domain_glob)))<0)
+	{
+		glob->rule_num=0;
+		return err;
+	}
+	if(0==glob->rule_num)
+		return 0;
+	/// 校验状态个数和字符类
+	len=(size_t)glob->state_num*glob->class_num*sizeof(unsigned short);
+	if(glob->state_num<=DOMAIN_GLOB_START||glob->state_num>DOMAIN_GLOB_MAX_STATES||
+			0==glob->class_num||glob->class_num>DOMAIN_GLOB_MAX_CLASSES||
+			sizeof(struct domain_glob)+len>size)
+	{
+		glob->rule_num=0;
+		return -EFAULT;
+	}
+	err=read_domain_db(db,offset+sizeof(struct domain_glob),glob->trans,len);
+	if(err<0)
+		glob->rule_num=0;
+	return err<0?err:0;
+}
+
+/// @brief 读取type类别的通配规则DFA所需的缓冲区大小
+/// @retval 有规则时返回DFA的字节数 没有规则或DFA无效返回0
+size_t get_domain_glob_size(struct bc_domain_db *db,enum domain_type type)
+{
+	struct domain_glob glob;
+	if(NULL==db||DOMAIN_TYPE_NUM<=type)
+		return 0;
+	/// 只读取字符类之前的个数
+	if(read_domain_db(db,db->domain_names.domain_glob_start[type],&glob,
+				offsetof(struct domain_glob,classes))<0||0==glob.rule_num)
+		return 0;
+	if(glob.state_num<=DOMAIN_GLOB_START||glob.state_num>DOMAIN_GLOB_MAX_STATES||
+			0==glob.class_num||glob.class_num>DOMAIN_GLOB_MAX_CLASSES)
+		return 0;
+	return sizeof(struct domain_glob)+(size_t)glob.state_num*glob.class_num*sizeof(unsigned short);
+}
+
+/// @brief 写入type类别的通配规则DFA
+/// @retval 成功0 失败错误代码的负值
+int set_domain_glob(const struct domain_glob *glob,struct bc_domain_db *db,enum domain_type type)
+{
+	size_t size=sizeof(struct domain_glob);
+	if(NULL==db||NULL==glob)
+		return -EINVAL;
+	if(DOMAIN_TYPE_NUM<=type)
+		return -EFAULT;
+	if(glob->rule_num>0)
+		size+=(size_t)glob->state_num*glob->class_num*sizeof(unsigned short);
+	if(size>DOMAIN_GLOB_SIZE)
+		return -EFAULT;
+	return write_domain_db(db,db->domain_names.domain_glob_start[type],glob,size);
+}
+
+/// @brief 读取type类别的有序索引
+/// @retval 成功0 失败错误代码的负值
+int get_domain_order(struct domain_order *order,size_t size,struct bc_domain_db *db,enum domain_type type)
+{
+	int err=0;
+	size_t offset=0;
+	size_t len=0;
+	if(NULL==db||NULL==order||size<sizeof(struct domain_order))
+		return -EINVAL;
+	if(DOMAIN_TYPE_NUM<=type)
+		return -EFAULT;
+	offset=db->domain_names.domain_order_start[type];
+	if((err=read_domain_db(db,offset,order,sizeof(struct domain_order)))<0)
+	{
+		order->count=0;
+		return err;
+	}
+	/// 校验记录个数
+	len=2*(size_t)order->count*sizeof(unsigned int);
+	if(order->count>order->num||order->num>db->domain_names.domain_type_max_len[type]||
+			sizeof(struct domain_order)+len>size)
+	{
+		order->num=0;
+		order->count=0;
+		return -EFAULT;
+	}
+	if(0==order->count)
+		return 0;
+	err=read_domain_db(db,offset+sizeof(struct domain_order),order->items,len);
+	if(err<0)
+		order->count=0;
+	return err<0?err:0;
+}
+
+/// @brief 写入type类别的有序索引
+/// @retval 成功0 失败错误代码的负值
+int set_domain_order(const struct domain_order *order,struct bc_domain_db *db,enum domain_type type)
+{
+	size_t size=0;
+	if(NULL==db||NULL==order)
+		return -EINVAL;
+	if(DOMAIN_TYPE_NUM<=type)
+		return -EFAULT;
+	size=sizeof(struct domain_order)+2*(size_t)order->count*sizeof(unsigned int);
+	if(size>DOMAIN_ORDER_SIZE(db->domain_names.domain_type_max_len[type]))
+		return -EFAULT;
+	return write_domain_db(db,db->domain_names.domain_order_start[type],order,size);
+}
+
+/// @brief 读取type类别的压缩trie
+/// @retval 成功0 失败错误代码的负值
+int get_domain_trie(struct domain_trie *trie,size_t size,struct bc_domain_db *db,enum domain_type type)
+{
+	struct domain_trie layout;
+	int err=0;
+	size_t offset=0;
+	if(NULL==db||NULL==trie||size<sizeof(struct domain_trie))
+		return -EINVAL;
+	if(DOMAIN_TYPE_NUM<=type)
+		return -EFAULT;
+	offset=db->domain_names.domain_trie_start[type];
+	if((err=read_domain_db(db,offset,trie,sizeof(struct domain_trie)))<0)
+	{
+		trie->key_num=0;
+		return err;
+	}
+	if(0==trie->key_num)
+		return 0;
+	/// 各部分的偏移须与依据个数算出的一致
+	memcpy(&layout,trie,sizeof(layout));
+	if(trie->num>db->domain_names.domain_type_max_len[type]||trie->key_num>trie->num||
+			domain_trie_layout(&layout)<0||memcmp(&layout,trie,sizeof(layout))!=0||
+			sizeof(struct domain_trie)+trie->size>size)
+	{
+		trie->key_num=0;
+		return -EFAULT;
+	}
+	err=read_domain_db(db,offset+sizeof(struct domain_trie),trie->data,trie->size);
+	/// 串池须以'\0'结尾,查找时不会越界
+	if(err>=0&&trie->link_bytes>0&&
+			'\0'!=((const char*)trie->data)[trie->link_pool+trie->link_bytes-1])
+		err=-EFAULT;
+	if(err<0)
+		trie->key_num=0;
+	return err<0?err:0;
+}
+
+/// @brief 写入type类别的压缩trie
+/// @retval 成功0 失败错误代码的负值
+int set_domain_trie(const struct domain_trie *trie,struct bc_domain_db *db,enum domain_type type)
+{
+	size_t size=sizeof(struct domain_trie);
+	if(NULL==db||NULL==trie)
+		return -EINVAL;
+	if(DOMAIN_TYPE_NUM<=type)
+		return -EFAULT;
+	if(trie->key_num>0)
+		size+=trie->size;
+	if(size>DOMAIN_TRIE_SIZE(db->domain_names.domain_type_max_len[type]))
+		return -EFAULT;
+	return write_domain_db(db,db->domain_names.domain_trie_start[type],trie,size);
+}
+
 /// @brief 保存bc_domain_names结构
 /// @retval 成功返回0 失败错误代码负值
 int save_bc_domain_names(struct bc_domain_db *db)
 {
 	if(NULL==db)
 		return 0;
-#ifndef USER_SPACE
-	return write_bigmem_bh(&db->mem,0,&db->domain_names,sizeof(struct bc_domain_names));
-#else
-	return write_bigmem(&db->mem,0,&db->domain_names,sizeof(struct bc_domain_names));
-#endif
+	return write_domain_db(db,0,&db->domain_names,sizeof(struct bc_domain_names));
 }
 
@@ -0,0 +1,271 @@
+/*
+ * @file bc_domain_glob.c
+ * @breif 通配规则的编译,用户程序在发布更新时调用
+ * 	  以规则中的位置为NFA状态,子集构造得到DFA
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#include <errno.h>
+#include <error.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bc_domain_glob.h"
+
+/// 状态集合哈希表的大小,须为2的幂且大于DOMAIN_GLOB_MAX_STATES
+#define GLOB_SET_TABLE (DOMAIN_GLOB_MAX_STATES*2)
+
+/// 子集构造的中间状态,位置集合均为位图
+/// 	读入字符类k后的集合为 (set&star) | ((set&match[k])<<1),再加入'*'匹配空串的位置
+struct glob_builder
+{
+	size_t words;               ///< 每个集合的64位字个数
+	unsigned long long *star;   ///< '*'所在的位置
+	unsigned long long *end;    ///< 规则末尾的位置
+	unsigned long long *match;  ///< 各字符类可前进一步的位置,class_num个集合
+	unsigned long long *sets;   ///< 各DFA状态对应的位置集合
+	unsigned short table[GLOB_SET_TABLE];   ///< 集合哈希表,存放状态+1
+	unsigned int state_num;     ///< 已有的状态个数
+};
+
+/// @brief 位置集合的哈希
+static unsigned int glob_set_hash(const unsigned long long *set,size_t words)
+{
+	unsigned long long h=0;
+	size_t i=0;
+	for(i=0;i<words;i++)
+		h=(h^set[i])*0x9e3779b97f4a7c15ull;
+	return (unsigned int)(h>>32);
+}
+
+/// @brief set|=(src&mask)<<1,返回set是否改变
+static bool glob_shift_or(unsigned long long *set,const unsigned long long *src,
+		const unsigned long long *mask,size_t words)
+{
+	unsigned long long carry=0;
+	bool changed=false;
+	size_t i=0;
+	for(i=0;i<words;i++)
+	{
+		unsigned long long x=src[i]&mask[i];
+		unsigned long long add=(x<<1)|carry;
+		carry=x>>63;
+		if(add&~set[i])
+			changed=true;
+		set[i]|=add;
+	}
+	return changed;
+}
+
+/// @brief 加入'*'匹配空串的位置,重复次数为连续'*'的个数
+static void glob_closure(const struct glob_builder *b,unsigned long long *set)
+{
+	while(glob_shift_or(set,set,b->star,b->words));
+}
+
+/// @brief 集合中是否有规则末尾的位置
+static bool glob_accept(const struct glob_builder *b,const unsigned long long *set)
+{
+	size_t i=0;
+	for(i=0;i<b->words;i++)
+		if(set[i]&b->end[i])
+			return true;
+	return false;
+}
+
+/// @brief 查找或加入状态集合
+/// @retval 状态 超出上限返回-E2BIG
+static int glob_state(struct glob_builder *b,const unsigned long long *set)
+{
+	unsigned int pos=glob_set_hash(set,b->words)&(GLOB_SET_TABLE-1);
+	size_t i=0;
+	/// 空集为拒绝状态
+	for(i=0;i<b->words&&0==set[i];i++);
+	if(i==b->words)
+		return DOMAIN_GLOB_DEAD;
+	while(b->table[pos])
+	{
+		unsigned int s=b->table[pos]-1;
+		if(memcmp(b->sets+s*b->words,set,b->words*sizeof(unsigned long long))==0)
+			return s;
+		pos=(pos+1)&(GLOB_SET_TABLE-1);
+	}
+	if(b->state_num>=DOMAIN_GLOB_MAX_STATES)
+		return -E2BIG;
+	memcpy(b->sets+b->state_num*b->words,set,b->words*sizeof(unsigned long long));
+	b->table[pos]=b->state_num+1;
+	return b->state_num++;
+}
+
+/// @brief 将n条通配规则编译为DFA
+/// @retval 成功0 状态或字符类超出上限返回-E2BIG 失败错误代码负值
+int build_domain_glob(const char **rules,size_t n,struct domain_glob *glob,size_t size)
+{
+	struct glob_builder *b=NULL;
+	unsigned long long *next=NULL;
+	unsigned char dot=0;
+	size_t i=0;
+	size_t p=0;
+	unsigned int s=0;
+	unsigned int k=0;
+	int err=0;
+
+	if(NULL==rules||NULL==glob||size<sizeof(struct domain_glob))
+		return -EINVAL;
+	memset(glob,0,sizeof(struct domain_glob));
+	if(0==n)
+		return 0;
+	/// 字符类:0为规则中未出现的字符,'.'单独一类以区分'?'
+	glob->class_num=1;
+	dot=glob->classes['.']=glob->class_num++;
+	for(i=0;i<n;i++)
+	{
+		const char *c=NULL;
+		for(c=rules[i];'\0'!=*c;c++)
+		{
+			unsigned char ch=*c;
+			if(ch>='A'&&ch<='Z')
+				ch+='a'-'A';
+			if('*'==ch||'?'==ch||glob->classes[ch])
+				continue;
+			if(glob->class_num>=DOMAIN_GLOB_MAX_CLASSES)
+				return -E2BIG;
+			glob->classes[ch]=glob->class_num++;
+		}
+		p+=strlen(rules[i])+1;
+	}
+	for(i='a';i<='z';i++)
+		glob->classes[i-'a'+'A']=glob->classes[i];
+	if(sizeof(struct domain_glob)+(size_t)DOMAIN_GLOB_MAX_STATES*glob->class_num*sizeof(unsigned short)>size)
+		return -EINVAL;
+	/// 各规则依次排列,每条规则末尾多一个接受位置
+	if((b=(struct glob_builder*)calloc(1,sizeof(struct glob_builder)))==NULL)
+		return -ENOMEM;
+	b->words=(p+64)/64;
+	b->star=(unsigned long long*)calloc(b->words,sizeof(unsigned long long));
+	b->end=(unsigned long long*)calloc(b->words,sizeof(unsigned long long));
+	b->match=(unsigned long long*)calloc(glob->class_num*b->words,sizeof(unsigned long long));
+	b->sets=(unsigned long long*)calloc((size_t)DOMAIN_GLOB_MAX_STATES*b->words,sizeof(unsigned long long));
+	next=(unsigned long long*)calloc(b->words,sizeof(unsigned long long));
+	if(NULL==b->star||NULL==b->end||NULL==b->match||NULL==b->sets||NULL==next)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	for(i=0,p=0;i<n;i++)
+	{
+		const char *c=NULL;
+		next[p>>6]|=1ull<<(p&63);
+		for(c=rules[i];'\0'!=*c;c++,p++)
+		{
+			unsigned long long bit=1ull<<(p&63);
+			if('*'==*c)
+				b->star[p>>6]|=bit;
+			else if('?'==*c)
+			{
+				/// '?'在'.'以外的字符类上前进
+				for(k=0;k<glob->class_num;k++)
+					if(k!=dot)
+						b->match[k*b->words+(p>>6)]|=bit;
+			}
+			else
+				b->match[glob->classes[(unsigned char)*c]*b->words+(p>>6)]|=bit;
+		}
+		b->end[p>>6]|=1ull<<(p&63);
+		p++;
+	}
+	/// 状态0为拒绝状态(空集),状态1为初始状态
+	b->state_num=1;
+	glob_closure(b,next);
+	if(glob_state(b,next)!=DOMAIN_GLOB_START)
+	{
+		err=-EINVAL;
+		goto out;
+	}
+	for(s=DOMAIN_GLOB_START;s<b->state_num;s++)
+	{
+		for(k=0;k<glob->class_num;k++)
+		{
+			const unsigned long long *cur=b->sets+s*b->words;
+			unsigned short *t=glob->trans+s*glob->class_num+k;
+			int state=0;
+			for(i=0;i<b->words;i++)
+				next[i]=cur[i]&b->star[i];
+			glob_shift_or(next,cur,b->match+k*b->words,b->words);
+			glob_closure(b,next);
+			if((state=glob_state(b,next))<0)
+			{
+				err=state;
+				goto out;
+			}
+			*t=state;
+			if(state&&glob_accept(b,b->sets+state*b->words))
+				*t|=DOMAIN_GLOB_ACCEPT;
+		}
+	}
+	memset(glob->trans,0,glob->class_num*sizeof(unsigned short));
+	glob->state_num=b->state_num;
+	glob->rule_num=n;
+out:
+	free(b->star);
+	free(b->end);
+	free(b->match);
+	free(b->sets);
+	free(b);
+	free(next);
+	return err;
+}
+
+/// @brief 将db中type类别的有效通配规则编译为DFA并写入db
+/// 	编译失败时写入空的自动机,内核不再使用旧的规则
+/// @retval 成功返回规则个数 失败错误代码负值
+int compile_domain_glob(struct bc_domain_db *db,enum domain_type type)
+{
+	struct domain_glob *glob=NULL;
+	const char **rules=NULL;
+	size_t len=0;
+	size_t n=0;
+	size_t i=0;
+	int err=0;
+
+	if(NULL==db||type<0||type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	len=get_domain_name_num(db,type);
+	rules=(const char**)calloc(len+1,sizeof(char*));
+	glob=(struct domain_glob*)calloc(1,DOMAIN_GLOB_SIZE);
+	if(NULL==rules||NULL==glob)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	for(i=0;i<len;i++)
+	{
+		struct domain_name name;
+		if((err=get_domain_name(&name,db,type,i))<0)
+			goto out;
+		if(!name.is_vaild||!is_domain_glob(name.name))
+			continue;
+		if((rules[n]=strdup(name.name))==NULL)
+		{
+			err=-ENOMEM;
+			goto out;
+		}
+		n++;
+	}
+	if((err=build_domain_glob(rules,n,glob,DOMAIN_GLOB_SIZE))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"compile %zu glob rules for type %d failed",n,type);
+		memset(glob,0,sizeof(struct domain_glob));
+		set_domain_glob(glob,db,type);
+		goto out;
+	}
+	if((err=set_domain_glob(glob,db,type))==0)
+		err=n;
+out:
+	for(i=0;NULL!=rules&&i<n;i++)
+		free((char*)rules[i]);
+	free(rules);
+	free(glob);
+	return err;
+}
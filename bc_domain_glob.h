@@ -0,0 +1,71 @@
+/*
+ * bc_domain_glob模块头文件
+ * 	  通配规则,'*'匹配任意个字符(可跨越'.'),'?'匹配'.'以外的单个字符
+ * 	  用户程序在发布更新时将一个类别的全部规则编译为一个DFA,
+ * 	  内核查找时对查询只扫描一遍,与规则个数无关
+ */
+#ifndef _BC_DOMAIN_GLOB_H
+#define _BC_DOMAIN_GLOB_H
+
+#include "bc_domain_names.h"
+
+/// 通配字符
+#define DOMAIN_GLOB_CHARS "*?"
+
+/// @brief 判断域名记录是否为通配规则
+static inline bool is_domain_glob(const char *name)
+{
+	for(;'\0'!=*name;name++)
+		if('*'==*name||'?'==*name)
+			return true;
+	return false;
+}
+
+/// @brief DFA实际占用的字节数,没有规则时只有头部
+static inline size_t domain_glob_bytes(const struct domain_glob *glob)
+{
+	return sizeof(struct domain_glob)+
+		(glob->rule_num>0?(size_t)glob->state_num*glob->class_num*sizeof(unsigned short):0);
+}
+
+/// @brief 从状态state开始,依次读入长度为len的字符
+/// @param[in,out] accept 最后一次转移的目标是否为接受状态
+/// @retval 最终状态,0表示已无法匹配
+static inline unsigned int domain_glob_feed(const struct domain_glob *glob,unsigned int state,
+		const char *str,size_t len,bool *accept)
+{
+	unsigned short t=0;
+	size_t i=0;
+	for(i=0;i<len&&state;i++)
+	{
+		t=glob->trans[state*glob->class_num+glob->classes[(unsigned char)str[i]]];
+		state=t&~DOMAIN_GLOB_ACCEPT;
+		*accept=(t&DOMAIN_GLOB_ACCEPT)!=0;
+	}
+	return state;
+}
+
+/// @brief 判断长度为len的点分格式域名是否匹配任一规则,调用者需保证glob->rule_num>0
+/// @retval 匹配1 不匹配0
+static inline int domain_glob_match(const struct domain_glob *glob,const char *str,size_t len)
+{
+	bool accept=false;
+	if(0==len)
+		return 0;
+	return domain_glob_feed(glob,DOMAIN_GLOB_START,str,len,&accept)&&accept;
+}
+
+#ifdef USER_SPACE
+
+/// @brief 将n条通配规则编译为DFA
+/// @param[out] glob 大小为size的缓冲区
+/// @retval 成功0 状态或字符类超出上限返回-E2BIG 失败错误代码负值
+int build_domain_glob(const char **rules,size_t n,struct domain_glob *glob,size_t size);
+
+/// @brief 将db中type类别的有效通配规则编译为DFA并写入db
+/// @retval 成功返回规则个数 失败错误代码负值
+int compile_domain_glob(struct bc_domain_db *db,enum domain_type type);
+
+#endif /// USER_SPACE
+
+#endif /// _BC_DOMAIN_GLOB_H
@@ -0,0 +1,460 @@
+/**
+ * @file bc_domain_hashtest.c
+ * @brief 域名哈希函数的质量与速度测试
+ *       对比当前的hash_key_mem与原先逐字节的JS哈希:
+ *       雪崩(翻转输入的一位,输出各位翻转的概率),
+ *       桶分布(按索引的掩码取桶,与均匀分布的卡方偏差),
+ *       以及不同长度下每次哈希的耗时,
+ *       -t时另外对比压缩trie与哈希索引每个域名占用的内存和查找耗时
+ *       调用格式
+ *       bc_domain_hashtest [-n count] [-b bits] [-t] [domain_list]
+ *
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "bc_domain_index.h"
+#include "bc_domain_trie.h"
+
+const char *g_program="bc_domain_hashtest";
+
+struct option g_opts[]={
+	{"count",required_argument,NULL,'n'},
+	{"bits",required_argument,NULL,'b'},
+	{"trie",no_argument,NULL,'t'},
+	{"help",no_argument,NULL,'h'},
+	{NULL,0,NULL,0}
+};
+
+/// 命令行参数结构
+struct argument
+{
+	const char *path;     ///< 域名列表,NULL时随机生成
+	size_t count;         ///< 随机生成的域名个数
+	unsigned int bits;    ///< 桶个数为2^bits
+	bool is_trie;         ///< 是否对比压缩trie
+}g_argu={NULL,100000,12,false};
+
+/// 测试用的域名集合
+struct name_set
+{
+	char **names;
+	size_t num;
+};
+
+static void usage(int err)
+{
+	if(EXIT_SUCCESS!=err)
+		printf("Trye %s -h|--help for more information\n",g_program);
+	else
+	{
+		printf("%s [-n count] [-b bits] [-t] [domain_list]\n\t 测试域名哈希函数的质量与速度\n",g_program);
+		printf("\n\t-n|--count n 没有给出域名列表时随机生成的域名个数,默认100000\n");
+		printf("\t-b|--bits n 桶分布测试的桶个数为2^n,默认12\n");
+		printf("\t-t|--trie 对比压缩trie与哈希索引的内存和查找耗时\n");
+		printf("\t-h|--help 显示本信息\n");
+	}
+	exit(err);
+}
+
+/// @brief 原先的哈希函数,逐字节计算,作为对比
+static unsigned int legacy_hash(const char *str,size_t len,unsigned int seed)
+{
+	unsigned int hash=1315423911^seed;
+	size_t i=0;
+	for(i=0;i<len;i++)
+	{
+		unsigned char c=str[i];
+		if(c>='A'&&c<='Z')
+			c+='a'-'A';
+		hash^=((hash<<5)+c+(hash>>2));
+	}
+	return hash;
+}
+
+/// @brief 当前的哈希函数
+static unsigned long long current_hash(const char *str,size_t len,unsigned int seed)
+{
+	return hash_key_mem(str,len,seed);
+}
+
+/// @brief 返回单调时钟的纳秒数
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000ull+ts.tv_nsec;
+}
+
+/// @brief 随机生成形如label.label.tld的域名
+static char *random_name(void)
+{
+	static const char *tlds[]={"com","net","org","cn","com.cn","io"};
+	static const char chars[]="abcdefghijklmnopqrstuvwxyz0123456789-";
+	char buf[DOMAIN_MAX_LENGTH];
+	int labels=1+rand()%3;
+	size_t n=0;
+	int i=0;
+	for(i=0;i<labels;i++)
+	{
+		int len=1+rand()%16;
+		int j=0;
+		for(j=0;j<len;j++)
+			buf[n++]=chars[rand()%(j==0?26:(int)sizeof(chars)-2)];
+		buf[n++]='.';
+	}
+	strcpy(buf+n,tlds[rand()%(sizeof(tlds)/sizeof(tlds[0]))]);
+	return strdup(buf);
+}
+
+/// @brief 载入或生成测试域名
+/// @retval 成功0 失败错误代码负值
+static int load_names(struct name_set *set)
+{
+	size_t cap=g_argu.count;
+	set->num=0;
+	if(NULL==g_argu.path)
+	{
+		if((set->names=(char**)calloc(cap,sizeof(char*)))==NULL)
+			return -ENOMEM;
+		for(set->num=0;set->num<cap;set->num++)
+			set->names[set->num]=random_name();
+		return 0;
+	}
+	FILE *fp=fopen(g_argu.path,"r");
+	char line[1024];
+	if(NULL==fp)
+	{
+		error_at_line(0,errno,__FILE__,__LINE__,"open %s error",g_argu.path);
+		return -errno;
+	}
+	cap=1024;
+	set->names=(char**)malloc(cap*sizeof(char*));
+	while(NULL!=set->names&&fgets(line,sizeof(line),fp)!=NULL)
+	{
+		size_t len=strcspn(line," \t\r\n#");
+		if(0==len||len>=DOMAIN_MAX_LENGTH)
+			continue;
+		line[len]='\0';
+		if(set->num==cap)
+		{
+			cap<<=1;
+			set->names=(char**)realloc(set->names,cap*sizeof(char*));
+			if(NULL==set->names)
+				break;
+		}
+		set->names[set->num++]=strdup(line);
+	}
+	fclose(fp);
+	return NULL==set->names?-ENOMEM:0;
+}
+
+/// @brief 雪崩测试,翻转每个输入位,统计输出各位翻转的概率
+/// 	翻转字母的0x20位只改变大小写,哈希值应不变,不计入
+static void test_avalanche(const struct name_set *set,const char *title,bool legacy)
+{
+	size_t samples=set->num<2000?set->num:2000;
+	int out_bits=legacy?32:64;
+	double flips[64];
+	size_t trials=0;
+	size_t i=0;
+	int j=0;
+	double worst=0;
+	double sum=0;
+	memset(flips,0,sizeof(flips));
+	for(i=0;i<samples;i++)
+	{
+		char buf[DOMAIN_MAX_LENGTH];
+		size_t len=strlen(set->names[i]);
+		size_t pos=0;
+		unsigned long long base=0;
+		memcpy(buf,set->names[i],len+1);
+		base=legacy?legacy_hash(buf,len,0):current_hash(buf,len,0);
+		for(pos=0;pos<len;pos++)
+		{
+			int bit=0;
+			for(bit=0;bit<8;bit++)
+			{
+				unsigned long long h=0;
+				unsigned long long diff=0;
+				char c=buf[pos];
+				if(0x20==(1<<bit)&&((c|0x20)>='a'&&(c|0x20)<='z'))
+					continue;
+				buf[pos]^=1<<bit;
+				h=legacy?legacy_hash(buf,len,0):current_hash(buf,len,0);
+				buf[pos]=c;
+				diff=h^base;
+				for(j=0;j<out_bits;j++)
+					flips[j]+=(diff>>j)&1;
+				trials++;
+			}
+		}
+	}
+	for(j=0;j<out_bits;j++)
+	{
+		double bias=flips[j]/trials-0.5;
+		if(bias<0)
+			bias=-bias;
+		if(bias>worst)
+			worst=bias;
+		sum+=flips[j]/trials;
+	}
+	printf("%-8s avalanche: trials %zu mean flip %.4f worst bit bias %.4f\n",
+			title,trials,sum/out_bits,worst);
+}
+
+/// @brief 桶分布测试,与索引一样以掩码取桶
+static void test_buckets(const struct name_set *set,const char *title,bool legacy)
+{
+	size_t bucket_num=(size_t)1<<g_argu.bits;
+	unsigned int *count=(unsigned int*)calloc(bucket_num,sizeof(unsigned int));
+	double expect=(double)set->num/bucket_num;
+	double chi=0;
+	unsigned int max=0;
+	size_t i=0;
+	if(NULL==count)
+		return;
+	for(i=0;i<set->num;i++)
+	{
+		const char *name=set->names[i];
+		unsigned long long h=legacy?legacy_hash(name,strlen(name),0)
+			:current_hash(name,strlen(name),0);
+		count[h&(bucket_num-1)]++;
+	}
+	for(i=0;i<bucket_num;i++)
+	{
+		chi+=(count[i]-expect)*(count[i]-expect)/expect;
+		if(count[i]>max)
+			max=count[i];
+	}
+	/// 均匀分布时chi/(bucket_num-1)约为1
+	printf("%-8s buckets: %zu keys %zu chi2/df %.3f max %u expect %.2f\n",
+			title,bucket_num,set->num,chi/(bucket_num-1),max,expect);
+	free(count);
+}
+
+/// @brief 速度测试
+static void test_speed(void)
+{
+	static const size_t lens[]={8,16,24,32,64,127};
+	char buf[DOMAIN_MAX_LENGTH];
+	const size_t loops=2000000;
+	size_t i=0;
+	size_t k=0;
+	for(i=0;i<sizeof(buf);i++)
+		buf[i]="Abcdefghij.klmnopqrstuvwxyz-0123456789"[i%38];
+	printf("%-8s%-12s%-12s\n","len","legacy(ns)","current(ns)");
+	for(k=0;k<sizeof(lens)/sizeof(lens[0]);k++)
+	{
+		volatile unsigned long long sink=0;
+		uint64_t start=0;
+		double t_legacy=0;
+		double t_current=0;
+		start=now_ns();
+		for(i=0;i<loops;i++)
+			sink+=legacy_hash(buf,lens[k],i);
+		t_legacy=(double)(now_ns()-start)/loops;
+		start=now_ns();
+		for(i=0;i<loops;i++)
+			sink+=current_hash(buf,lens[k],i);
+		t_current=(double)(now_ns()-start)/loops;
+		printf("%-8zu%-12.2f%-12.2f\n",lens[k],t_legacy,t_current);
+	}
+}
+
+/// @brief 大小写折叠的正确性检查
+/// @retval 通过0 失败-1
+static int test_case_fold(const struct name_set *set)
+{
+	size_t i=0;
+	for(i=0;i<set->num;i++)
+	{
+		char buf[DOMAIN_MAX_LENGTH];
+		size_t len=strlen(set->names[i]);
+		size_t j=0;
+		for(j=0;j<len;j++)
+		{
+			char c=set->names[i][j];
+			buf[j]=(c>='a'&&c<='z'&&(j&1))?c-('a'-'A'):c;
+		}
+		if(current_hash(buf,len,7)!=current_hash(set->names[i],len,7))
+		{
+			printf("case fold: %s and %.*s differ\n",set->names[i],(int)len,buf);
+			return -1;
+		}
+	}
+	printf("case fold: ok\n");
+	return 0;
+}
+
+/// @brief 以names中的域名依次查找,返回每次查找的平均纳秒数
+/// @param[out] found 找到的个数
+static double trie_bench(const struct domain_index *idx,const struct domain_trie *trie,
+		char **names,size_t num,size_t *found)
+{
+	uint64_t start=now_ns();
+	size_t i=0;
+	*found=0;
+	for(i=0;i<num;i++)
+	{
+		struct domain_key key;
+		int r=0;
+		domain_key_set(&key,names[i],strlen(names[i]));
+		r=NULL!=trie?domain_trie_lookup(trie,key.buf,key.len):domain_index_lookup(idx,&key);
+		if(r>=0)
+			(*found)++;
+	}
+	return (double)(now_ns()-start)/num;
+}
+
+/// @brief 对比压缩trie与哈希索引每个域名占用的内存和查找耗时
+/// 	哈希索引的记录均在哈希链中,与发布后追加的记录相同
+/// @retval 通过0 失败错误代码负值
+static int test_trie(const struct name_set *set)
+{
+	size_t size=DOMAIN_TRIE_SIZE(set->num);
+	struct domain_trie *trie=(struct domain_trie*)malloc(size);
+	unsigned int *records=(unsigned int*)calloc(set->num,sizeof(unsigned int));
+	char **queries=(char**)calloc(set->num,sizeof(char*));
+	char **misses=(char**)calloc(set->num,sizeof(char*));
+	struct domain_index idx;
+	struct domain_index_stat stat;
+	size_t found[4];
+	double ns[4];
+	size_t i=0;
+	int err=0;
+
+	memset(&idx,0,sizeof(idx));
+	if(NULL==trie||NULL==records||NULL==queries||NULL==misses)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	for(i=0;i<set->num;i++)
+		records[i]=i;
+	if((err=build_domain_trie((const char**)set->names,records,set->num,set->num,trie,size))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"build trie error");
+		goto out;
+	}
+	if((err=init_domain_index(&idx,domain_index_bucket_num(set->num),set->num))<0)
+		goto out;
+	for(i=0;i<set->num;i++)
+		if((err=domain_index_insert(&idx,i,set->names[i]))<0)
+			goto out;
+	/// 每个域名的查找结果须指向相同的域名
+	for(i=0;i<set->num;i++)
+	{
+		int r=domain_trie_lookup(trie,set->names[i],strlen(set->names[i]));
+		if(r<0||strcasecmp(set->names[r],set->names[i])!=0)
+		{
+			printf("trie: %s not found\n",set->names[i]);
+			err=-EINVAL;
+			goto out;
+		}
+	}
+	/// 打乱查找顺序,未命中的域名随机生成
+	for(i=0;i<set->num;i++)
+	{
+		queries[i]=set->names[rand()%set->num];
+		misses[i]=random_name();
+	}
+	ns[0]=trie_bench(&idx,NULL,queries,set->num,found+0);
+	ns[1]=trie_bench(&idx,trie,queries,set->num,found+1);
+	ns[2]=trie_bench(&idx,NULL,misses,set->num,found+2);
+	ns[3]=trie_bench(&idx,trie,misses,set->num,found+3);
+	domain_index_get_stat(&idx,&stat);
+	printf("trie: keys %u nodes %u links %u bytes %zu (%.2f bytes/name)\n",
+			trie->key_num,trie->node_num,trie->link_num,domain_trie_bytes(trie),
+			(double)domain_trie_bytes(trie)/set->num);
+	printf("hash: chained %zu bytes %zu (%.2f bytes/name), db record %zu bytes/name\n",
+			stat.chained,stat.bytes_used,(double)stat.bytes_used/set->num,sizeof(struct domain_name));
+	printf("%-8s%-12s%-12s%-8s\n","lookup","hash(ns)","trie(ns)","ratio");
+	printf("%-8s%-12.1f%-12.1f%-8.2f\n","hit",ns[0],ns[1],ns[1]/ns[0]);
+	printf("%-8s%-12.1f%-12.1f%-8.2f\n","miss",ns[2],ns[3],ns[3]/ns[2]);
+	if(found[0]!=found[1]||found[2]!=found[3])
+	{
+		printf("trie: found %zu/%zu, hash found %zu/%zu\n",found[1],found[3],found[0],found[2]);
+		err=-EINVAL;
+	}
+out:
+	for(i=0;NULL!=misses&&i<set->num;i++)
+		free(misses[i]);
+	destory_domain_index(&idx);
+	free(trie);
+	free(records);
+	free(queries);
+	free(misses);
+	return err;
+}
+
+/// @brief 解析程序的命令行参数
+static void parse_argument(int argc,char **argv)
+{
+	int ch=0;
+	while((ch=getopt_long(argc,argv,":n:b:th",g_opts,NULL))!=-1)
+	{
+		switch(ch)
+		{
+			case 'n':
+				g_argu.count=strtoul(optarg,NULL,10);
+				if(0==g_argu.count)
+					usage(EXIT_FAILURE);
+				break;
+			case 'b':
+				g_argu.bits=strtoul(optarg,NULL,10);
+				if(g_argu.bits<1||g_argu.bits>24)
+					usage(EXIT_FAILURE);
+				break;
+			case 't':
+				g_argu.is_trie=true;
+				break;
+			case 'h':
+				usage(EXIT_SUCCESS);
+			case ':':
+				fprintf(stderr,"no argument find for %c\n",optopt);
+				usage(EXIT_FAILURE);
+			default:
+				fprintf(stderr,"no support options:%c\n",optopt);
+				usage(EXIT_FAILURE);
+		}
+	}
+	if(optind<argc)
+		g_argu.path=argv[optind];
+}
+
+int main(int argc,char **argv)
+{
+	struct name_set set;
+	int err=0;
+	size_t i=0;
+	parse_argument(argc,argv);
+	srand(1);
+	if((err=load_names(&set))<0||0==set.num)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"no domain to test");
+		return EXIT_FAILURE;
+	}
+	err=test_case_fold(&set);
+	test_avalanche(&set,"legacy",true);
+	test_avalanche(&set,"current",false);
+	test_buckets(&set,"legacy",true);
+	test_buckets(&set,"current",false);
+	test_speed();
+	if(g_argu.is_trie&&0==err)
+		err=test_trie(&set);
+	for(i=0;i<set.num;i++)
+		free(set.names[i]);
+	free(set.names);
+	return err<0?EXIT_FAILURE:0;
+}
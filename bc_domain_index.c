@@ -0,0 +1,871 @@
+/*
+ * @file bc_domain_index.c
+ * @breif 域名哈希索引,内核与用户态共用
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#ifndef USER_SPACE
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/mm.h>
+#include <linux/random.h>
+
+#define INDEX_ALLOC(size,node) kvzalloc_node(size,GFP_KERNEL,node)
+#define INDEX_FREE(p) kvfree(p)
+#else
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+#define INDEX_ALLOC(size,node) calloc(1,size)
+#define INDEX_FREE(p) free(p)
+#define NUMA_NO_NODE (-1)
+#endif
+
+#include "bc_domain_index.h"
+#include "bc_domain_mph.h"
+#include "bc_domain_glob.h"
+#include "bc_domain_trie.h"
+
+/// @brief 64位循环左移
+static inline unsigned long long hash_rotl(unsigned long long x,int r)
+{
+	return (x<<r)|(x>>(64-r));
+}
+
+/// @brief 混入一个8字节分组
+static inline unsigned long long hash_mix_word(unsigned long long hash,unsigned long long w)
+{
+	hash^=hash_fold_case(w)*HASH_KEY_K1;
+	return hash_rotl(hash,31)*HASH_KEY_K0;
+}
+
+/// @brief 最后的混合
+static inline unsigned long long hash_finish(unsigned long long hash)
+{
+	hash^=hash>>33;
+	hash*=0xff51afd7ed558ccdull;
+	hash^=hash>>33;
+	hash*=0xc4ceb9fe1a85ec53ull;
+	hash^=hash>>33;
+	return hash;
+}
+
+/// @brief 计算长度为len的点分格式域名带种子的64位哈希值
+unsigned long long hash_key_mem(const char *str,size_t len,unsigned int seed)
+{
+	unsigned long long hash=(seed*HASH_KEY_K0)^(len*HASH_KEY_K1);
+	unsigned long long w=0;
+	while(len>=sizeof(w))
+	{
+		memcpy(&w,str,sizeof(w));
+		hash=hash_mix_word(hash,w);
+		str+=sizeof(w);
+		len-=sizeof(w);
+	}
+	/// 不足8字节的尾部补0
+	if(len>0)
+	{
+		w=0;
+		memcpy(&w,str,len);
+		hash=hash_mix_word(hash,w);
+	}
+	return hash_finish(hash);
+}
+
+/// 逐段写入字节的8字节分组累加器,分组的划分与hash_key_mem相同
+struct hash_stream
+{
+	unsigned long long hash;
+	unsigned char part[8];   ///< 未满8字节的分组
+	size_t fill;             ///< part中的字节数
+};
+
+/// @brief 写入len个字节,满8字节的分组直接混入
+static inline void hash_stream_feed(struct hash_stream *st,const unsigned char *p,size_t len)
+{
+	unsigned long long w=0;
+	/// 先补满上次剩余的分组
+	while(st->fill>0&&len>0)
+	{
+		st->part[st->fill++]=*p++;
+		len--;
+		if(sizeof(w)==st->fill)
+		{
+			memcpy(&w,st->part,sizeof(w));
+			st->hash=hash_mix_word(st->hash,w);
+			st->fill=0;
+		}
+	}
+	while(len>=sizeof(w))
+	{
+		memcpy(&w,p,sizeof(w));
+		st->hash=hash_mix_word(st->hash,w);
+		p+=sizeof(w);
+		len-=sizeof(w);
+	}
+	memcpy(st->part+st->fill,p,len);
+	st->fill+=len;
+}
+
+/// @brief 计算线格式查询键带种子的64位哈希值
+/// 	各标签及其间的'.'依次写入分组累加器,与点分格式的结果相同,不展开为点分格式
+static unsigned long long hash_key_qname(const struct dns_qname *qname,unsigned int seed)
+{
+	struct hash_stream st;
+	unsigned long long w=0;
+	const unsigned char *label=NULL;
+	size_t pos=qname->offset;
+	size_t len=0;
+	size_t n=0;
+	st.hash=(seed*HASH_KEY_K0)^(qname->len*HASH_KEY_K1);
+	st.fill=0;
+	while((label=dns_qname_label(qname,&pos,&len))!=NULL)
+	{
+		if(n++>0)
+			hash_stream_feed(&st,(const unsigned char*)".",1);
+		hash_stream_feed(&st,label,len);
+	}
+	/// 不足8字节的尾部补0
+	if(st.fill>0)
+	{
+		memset(st.part+st.fill,0,sizeof(st.part)-st.fill);
+		memcpy(&w,st.part,sizeof(w));
+		st.hash=hash_mix_word(st.hash,w);
+	}
+	return hash_finish(st.hash);
+}
+
+/// @brief 将线格式查询键展开为点分格式,能匹配的域名不超过DOMAIN_MAX_LENGTH
+/// 	只用于保存域名,查找和哈希直接读取各标签
+/// @retval 点分格式的长度
+static size_t domain_key_flatten(const struct domain_key *key,char *buf)
+{
+	size_t pos=key->qname->offset;
+	size_t len=0;
+	size_t n=0;
+	const unsigned char *label=NULL;
+	while((label=dns_qname_label(key->qname,&pos,&len))!=NULL)
+	{
+		if(n>0&&n<DOMAIN_MAX_LENGTH)
+			buf[n++]='.';
+		if(len>DOMAIN_MAX_LENGTH-n)
+			len=DOMAIN_MAX_LENGTH-n;
+		memcpy(buf+n,label,len);
+		n+=len;
+	}
+	return n;
+}
+
+/// @brief 计算查询键带种子的64位哈希值
+unsigned long long hash_key_seed(const struct domain_key *key,unsigned int seed)
+{
+	if(NULL==key->qname)
+		return hash_key_mem(key->buf,key->len,seed);
+	return hash_key_qname(key->qname,seed);
+}
+
+/// @brief 将查询键复制为点分格式,不以'\0'结尾
+/// @param[out] buf 至少DOMAIN_MAX_LENGTH字节
+/// @retval 点分格式的长度
+size_t domain_key_copy(const struct domain_key *key,char *buf)
+{
+	size_t len=key->len<DOMAIN_MAX_LENGTH?key->len:DOMAIN_MAX_LENGTH;
+	if(NULL!=key->qname)
+		return domain_key_flatten(key,buf);
+	memcpy(buf,key->buf,len);
+	return len;
+}
+
+/// @brief 选取哈希链的随机种子
+static unsigned int index_random_seed(void)
+{
+#ifndef USER_SPACE
+	return get_random_u32();
+#else
+	unsigned int seed=0;
+	if(getrandom(&seed,sizeof(seed),GRND_NONBLOCK)!=sizeof(seed))
+		seed=(unsigned int)time(NULL)^((unsigned int)getpid()<<16);
+	return seed;
+#endif
+}
+
+/// @brief 设置点分格式查询键,忽略末尾的根点
+/// @retval 可能匹配返回1 不可能匹配返回0
+int domain_key_set(struct domain_key *key,const char *buf,size_t len)
+{
+	if(len>0&&'.'==buf[len-1])
+		len--;
+	key->buf=buf;
+	key->len=len;
+	key->qname=NULL;
+	return len>0&&len<DOMAIN_MAX_LENGTH;
+}
+
+/// @brief 设置线格式查询键
+/// @retval 可能匹配返回1 不可能匹配返回0 格式错误返回错误代码负值
+int domain_key_set_qname(struct domain_key *key,struct dns_qname *qname,
+		const unsigned char *msg,size_t msg_len,size_t offset)
+{
+	int err=0;
+	if((err=bc_domain_qname_parse(msg,msg_len,offset,qname))<0)
+		return err;
+	key->buf=NULL;
+	key->len=qname->len;
+	key->qname=qname;
+	return qname->len>0&&qname->len<DOMAIN_MAX_LENGTH;
+}
+
+/// @brief 比较查询键与db中的域名
+/// @retval 相等1 不相等0
+int domain_key_equal(const struct domain_key *key,const char *name)
+{
+	if(NULL!=key->qname)
+		return bc_domain_qname_equal(key->qname,name);
+	return '\0'==name[key->len]&&strncasecmp(name,key->buf,key->len)==0;
+}
+
+/// @brief 初始化索引
+/// @retval 成功0 失败错误代码负值
+int init_domain_index(struct domain_index *idx,size_t bucket_num,size_t cap)
+{
+	return init_domain_index_node(idx,bucket_num,cap,NUMA_NO_NODE);
+}
+
+/// @brief 初始化索引,trie为true时分配压缩trie,keys和哈希链数组在重建时分配
+/// @retval 成功0 失败错误代码负值
+static int init_index(struct domain_index *idx,size_t bucket_num,size_t cap,int node,bool trie)
+{
+	if(NULL==idx)
+		return -EINVAL;
+	memset(idx,0,sizeof(*idx));
+	if(0==bucket_num||0==cap)
+		return 0;
+	/// 桶个数须为2的幂
+	while(bucket_num&(bucket_num-1))
+		bucket_num&=bucket_num-1;
+	idx->node=node;
+	idx->mph_size=DOMAIN_MPH_SIZE(cap);
+	idx->mph=(struct domain_mph*)INDEX_ALLOC(idx->mph_size,node);
+	idx->buckets=(unsigned int*)INDEX_ALLOC(bucket_num*sizeof(unsigned int),node);
+	idx->key_off=(unsigned int*)INDEX_ALLOC(cap*sizeof(unsigned int),node);
+	if(NULL==idx->mph||NULL==idx->buckets||NULL==idx->key_off)
+		goto nomem;
+	if(trie)
+	{
+		idx->trie_size=DOMAIN_TRIE_SIZE(cap);
+		if((idx->trie=(struct domain_trie*)INDEX_ALLOC(idx->trie_size,node))==NULL)
+			goto nomem;
+	}
+	else
+	{
+		/// 按最长域名预留,重建时不分配内存
+		idx->next=(unsigned int*)INDEX_ALLOC(cap*sizeof(unsigned int),node);
+		idx->hashes=(unsigned int*)INDEX_ALLOC(cap*sizeof(unsigned int),node);
+		idx->keys=(char*)INDEX_ALLOC(cap*DOMAIN_MAX_LENGTH,node);
+		if(NULL==idx->next||NULL==idx->hashes||NULL==idx->keys)
+			goto nomem;
+		idx->chain_cap=cap;
+		idx->key_cap=cap*DOMAIN_MAX_LENGTH;
+	}
+	idx->bucket_max=bucket_num;
+	idx->bucket_num=bucket_num;
+	idx->seed=index_random_seed();
+	idx->cap=cap;
+	return 0;
+nomem:
+	destory_domain_index(idx);
+	return -ENOMEM;
+}
+
+/// @brief 在NUMA节点node上初始化索引
+/// @retval 成功0 失败错误代码负值
+int init_domain_index_node(struct domain_index *idx,size_t bucket_num,size_t cap,int node)
+{
+	return init_index(idx,bucket_num,cap,node,false);
+}
+
+/// @brief 在NUMA节点node上初始化使用压缩trie的索引
+/// @retval 成功0 失败错误代码负值
+int init_domain_index_trie(struct domain_index *idx,size_t bucket_num,size_t cap,int node)
+{
+	return init_index(idx,bucket_num,cap,node,true);
+}
+
+/// @brief 使trie索引的哈希链数组从记录base开始至少容纳chain_num项,keys至少容纳key_bytes字节
+/// 	只在进程上下文中调用,原有内容不保留,不使用trie的索引已按cap分配
+/// @retval 成功0 失败错误代码负值
+static int domain_index_reserve(struct domain_index *idx,size_t base,size_t chain_num,size_t key_bytes)
+{
+	if(NULL==idx->trie)
+		return 0;
+	/// 追加的记录变少时释放多余的项
+	if(chain_num>idx->chain_cap||2*chain_num<idx->chain_cap)
+	{
+		unsigned int *next=(unsigned int*)INDEX_ALLOC(chain_num*sizeof(unsigned int),idx->node);
+		unsigned int *hashes=(unsigned int*)INDEX_ALLOC(chain_num*sizeof(unsigned int),idx->node);
+		if(NULL==next||NULL==hashes)
+		{
+			INDEX_FREE(next);
+			INDEX_FREE(hashes);
+			return -ENOMEM;
+		}
+		INDEX_FREE(idx->next);
+		INDEX_FREE(idx->hashes);
+		idx->next=next;
+		idx->hashes=hashes;
+		idx->chain_cap=chain_num;
+	}
+	if(key_bytes>idx->key_cap)
+	{
+		char *keys=(char*)INDEX_ALLOC(key_bytes,idx->node);
+		if(NULL==keys)
+			return -ENOMEM;
+		INDEX_FREE(idx->keys);
+		idx->keys=keys;
+		idx->key_cap=key_bytes;
+	}
+	idx->base=base;
+	return 0;
+}
+
+/// @brief 使通配规则DFA的缓冲区为size字节,size为0时释放
+/// 	只在进程上下文中调用,原有内容不保留,失败时保留原有的缓冲区
+/// @retval 成功0 失败错误代码负值
+static int domain_index_reserve_glob(struct domain_index *idx,size_t size)
+{
+	struct domain_glob *glob=NULL;
+	/// 规则变少时释放多余的空间
+	if(size<=idx->glob_size&&2*size>=idx->glob_size)
+		return 0;
+	if(size>0&&(glob=(struct domain_glob*)INDEX_ALLOC(size,idx->node))==NULL)
+		return -ENOMEM;
+	INDEX_FREE(idx->glob);
+	idx->glob=glob;
+	idx->glob_size=size;
+	return 0;
+}
+
+/// @brief 紧凑之后释放trie索引keys中多余的空间,保留DOMAIN_INDEX_TRIE_SLACK个最长域名的余量
+/// 	只在进程上下文中调用,分配失败时保留原有的keys
+static void domain_index_trim_keys(struct domain_index *idx)
+{
+	size_t size=idx->key_used+DOMAIN_INDEX_TRIE_SLACK*DOMAIN_MAX_LENGTH;
+	char *keys=NULL;
+	if(NULL==idx->trie||2*size>=idx->key_cap)
+		return;
+	if((keys=(char*)INDEX_ALLOC(size,idx->node))==NULL)
+		return;
+	memcpy(keys,idx->keys,idx->key_used);
+	INDEX_FREE(idx->keys);
+	idx->keys=keys;
+	idx->key_cap=size;
+}
+
+/// @brief 销毁索引,并释放内存
+void destory_domain_index(struct domain_index *idx)
+{
+	if(NULL==idx)
+		return;
+	INDEX_FREE(idx->mph);
+	INDEX_FREE(idx->trie);
+	INDEX_FREE(idx->glob);
+	INDEX_FREE(idx->buckets);
+	INDEX_FREE(idx->next);
+	INDEX_FREE(idx->hashes);
+	INDEX_FREE(idx->key_off);
+	INDEX_FREE(idx->keys);
+	memset(idx,0,sizeof(*idx));
+}
+
+/// @brief 清空索引内容,不释放内存
+void reset_domain_index(struct domain_index *idx)
+{
+	if(NULL==idx||NULL==idx->buckets)
+		return;
+	memset(idx->buckets,0,idx->bucket_num*sizeof(unsigned int));
+	idx->mph->slot_num=0;
+	if(NULL!=idx->glob)
+		idx->glob->rule_num=0;
+	if(NULL!=idx->trie)
+		idx->trie->key_num=0;
+	idx->num=0;
+	idx->records=0;
+	idx->key_used=0;
+	idx->live=0;
+	idx->used_buckets=0;
+	idx->max_chain=0;
+}
+
+/// @brief 将下标为index,哈希为hash的记录加入索引
+/// @retval 成功0 失败错误代码负值
+int domain_index_add(struct domain_index *idx,size_t index,unsigned int hash)
+{
+	size_t b=0;
+	size_t len=0;
+	unsigned int cur=0;
+	if(NULL==idx||0==idx->bucket_num||index>=idx->cap||index<idx->base||index-idx->base>=idx->chain_cap)
+		return -EINVAL;
+	b=hash&(idx->bucket_num-1);
+	idx->hashes[index-idx->base]=hash;
+	idx->next[index-idx->base]=idx->buckets[b];
+	if(0==idx->buckets[b])
+		idx->used_buckets++;
+	idx->buckets[b]=index+1;
+	idx->num++;
+	/// 统计随加入更新,读取统计时不必遍历各链
+	for(cur=index+1;cur;cur=idx->next[cur-1-idx->base])
+		len++;
+	if(len>idx->max_chain)
+		idx->max_chain=len;
+	return 0;
+}
+
+/// @brief 按已保存的哈希值将链中记录重新分配到bucket_num个桶
+static void domain_index_rehash(struct domain_index *idx,size_t bucket_num)
+{
+	size_t i=0;
+	idx->bucket_num=bucket_num;
+	idx->num=0;
+	idx->used_buckets=0;
+	idx->max_chain=0;
+	memset(idx->buckets,0,idx->bucket_num*sizeof(unsigned int));
+	for(i=idx->mph->slot_num>idx->base?idx->mph->slot_num:idx->base;i<idx->records;i++)
+		if(idx->key_off[i]&&DOMAIN_INDEX_IN_TRIE!=idx->key_off[i]&&DOMAIN_INDEX_IN_GLOB!=idx->key_off[i])
+			domain_index_add(idx,i,idx->hashes[i-idx->base]);
+}
+
+/// @brief 分段重建的第一步,清空索引并载入最小完美哈希索引和通配规则DFA
+/// @retval 成功返回需要复制的记录数 失败错误代码负值
+int domain_index_build_begin(struct domain_index *idx,struct bc_domain_db *db,enum domain_type type)
+{
+	size_t num=0;
+	size_t base=0;
+	size_t tail=0;
+	int err=0;
+	if(NULL==idx||NULL==db)
+		return -EINVAL;
+	reset_domain_index(idx);
+	if(0==idx->cap)
+		return 0;
+	num=get_domain_name_num(db,type);
+	if(num>idx->cap)
+		num=idx->cap;
+	/// 载入最小完美哈希索引,之后追加的记录才需要加入哈希链
+	if(get_domain_mph(idx->mph,idx->mph_size,db,type)<0||idx->mph->slot_num>num)
+		idx->mph->slot_num=0;
+	/// 载入通配规则DFA,按编译的大小分配,没有规则时不分配,失败时rule_num为0
+	if((err=domain_index_reserve_glob(idx,get_domain_glob_size(db,type)))<0)
+	{
+		reset_domain_index(idx);
+		return err;
+	}
+	if(NULL!=idx->glob)
+		get_domain_glob(idx->glob,idx->glob_size,db,type);
+	/// 有可用的压缩trie时由trie代替最小完美哈希
+	if(NULL!=idx->trie)
+	{
+		if(get_domain_trie(idx->trie,idx->trie_size,db,type)<0||idx->trie->num>num)
+			idx->trie->key_num=0;
+		if(idx->trie->key_num>0)
+			idx->mph->slot_num=0;
+		/// 只为trie之后的记录和余量分配,分段复制时每条记录最多占DOMAIN_MAX_LENGTH字节
+		base=idx->trie->key_num>0?idx->trie->num:0;
+		tail=num-base+DOMAIN_INDEX_TRIE_SLACK;
+		if(tail>idx->cap-base)
+			tail=idx->cap-base;
+		if(0==tail)
+			tail=1;
+		if((err=domain_index_reserve(idx,base,tail,tail*DOMAIN_MAX_LENGTH))<0)
+		{
+			reset_domain_index(idx);
+			return err;
+		}
+	}
+	idx->records=num;
+	return num;
+}
+
+/// @brief 复制[start,end)之间的有效域名,并计算需要加入哈希链的记录的哈希值
+/// 	域名复制到keys中从(start-base)*DOMAIN_MAX_LENGTH开始的区域,
+/// 	不同的区间互不重叠,可以在多个cpu上同时执行.
+/// 	先读取列区的有效位图和长度,无效记录不读取记录本身
+/// @retval 成功返回需要加入哈希链的记录数 失败错误代码负值
+int domain_index_build_range(struct domain_index *idx,struct bc_domain_db *db,enum domain_type type,
+		size_t start,size_t end)
+{
+	struct domain_name *buf=NULL;
+	struct domain_columns *cols=NULL;
+	const struct domain_name *span=NULL;
+	size_t span_start=0;
+	size_t span_num=0;
+	size_t used=(start>idx->base?start-idx->base:0)*DOMAIN_MAX_LENGTH;
+	size_t i=0;
+	int chained=0;
+	if(NULL==idx||NULL==db||start>end||end>idx->records)
+		return -EINVAL;
+	if(start==end)
+		return 0;
+	if(NULL==(cols=INDEX_ALLOC(sizeof(*cols),NUMA_NO_NODE)))
+		return -ENOMEM;
+	cols->start=0;
+	cols->num=0;
+	/// 共享内存区中直接读取记录,bigmem存储每次读取一段到缓冲区
+	if(NULL==get_domain_db_ptr(db,db->domain_names.domain_type_start[type],
+				sizeof(struct domain_name))&&
+			NULL==(buf=INDEX_ALLOC(DOMAIN_SPAN_SIZE*sizeof(struct domain_name),NUMA_NO_NODE)))
+	{
+		INDEX_FREE(cols);
+		return -ENOMEM;
+	}
+	for(i=start;i<end;i++)
+	{
+		const struct domain_name *name=NULL;
+		const char *key=idx->keys+used;
+		size_t len=0;
+		idx->key_off[i]=0;
+		if((i<cols->start||i>=cols->start+cols->num)&&
+				get_domain_columns(cols,db,type,i&~(size_t)63)<=0)
+			continue;
+		if(!domain_column_valid(cols,i))
+			continue;
+		if(NULL==span||i<span_start||i>=span_start+span_num)
+		{
+			span_start=i;
+			span_num=end-i;
+			if(NULL==(span=get_domain_name_span(db,type,i,&span_num,buf,DOMAIN_SPAN_SIZE)))
+				continue;
+		}
+		name=span+(i-span_start);
+		if(!name->is_vaild)
+			continue;
+		/// 列区可被用户程序改写,长度与记录不一致时跳过,避免越过本区间的keys
+		len=cols->len[i-cols->start];
+		if(len>DOMAIN_MAX_LENGTH-1||strnlen(name->name,DOMAIN_MAX_LENGTH)!=len)
+			continue;
+		/// trie中的记录只需标记,建立trie之后改写的记录仍加入哈希链
+		if(NULL!=idx->trie&&i<idx->trie->num&&domain_trie_lookup(idx->trie,name->name,len)==(int)i)
+		{
+			idx->key_off[i]=DOMAIN_INDEX_IN_TRIE;
+			continue;
+		}
+		/// 通配规则由DFA匹配,只需标记
+		if(is_domain_glob(name->name))
+		{
+			idx->key_off[i]=DOMAIN_INDEX_IN_GLOB;
+			continue;
+		}
+		/// trie之前不在trie中的记录只出现在发布改写记录的过程中,发布结束后会再次完全重建
+		if(i<idx->base)
+			continue;
+		/// 记录可能正被用户程序改写,之后只使用复制的域名
+		memcpy(idx->keys+used,name->name,len);
+		idx->keys[used+len]='\0';
+		idx->key_off[i]=used+1;
+		used+=len+1;
+		if(i<idx->mph->slot_num)
+			continue;
+		idx->hashes[i-idx->base]=hash_key_mem(key,len,idx->seed);
+		chained++;
+	}
+	INDEX_FREE(buf);
+	INDEX_FREE(cols);
+	return chained;
+}
+
+/// @brief 分段重建的最后一步,紧凑keys并依据各区间的结果建立哈希链
+/// @param[in] chained 各区间需要加入哈希链的记录数之和
+/// @retval 成功返回加入哈希链的记录数 失败错误代码负值
+int domain_index_build_end(struct domain_index *idx,size_t chained)
+{
+	size_t i=0;
+	if(NULL==idx)
+		return -EINVAL;
+	if(0==idx->cap)
+		return 0;
+	/// 各区间之间留有空隙,依次前移使keys重新紧凑,为之后加入的记录保留空间
+	idx->key_used=0;
+	idx->live=0;
+	for(i=0;i<idx->records;i++)
+	{
+		size_t len=0;
+		if(idx->key_off[i])
+			idx->live++;
+		if(0==idx->key_off[i]||DOMAIN_INDEX_IN_TRIE==idx->key_off[i]||DOMAIN_INDEX_IN_GLOB==idx->key_off[i])
+			continue;
+		len=strlen(idx->keys+idx->key_off[i]-1)+1;
+		memmove(idx->keys+idx->key_used,idx->keys+idx->key_off[i]-1,len);
+		idx->key_off[i]=idx->key_used+1;
+		idx->key_used+=len;
+	}
+	domain_index_trim_keys(idx);
+	/// 调整桶个数
+	idx->bucket_num=domain_index_bucket_num(chained);
+	if(idx->bucket_num>idx->bucket_max)
+		idx->bucket_num=idx->bucket_max;
+	domain_index_rehash(idx,idx->bucket_num);
+	return idx->num;
+}
+
+/// @brief 依据db中type类别的有效域名重建索引
+/// 	桶个数依据链中的记录数和目标负载重新选择,不超过已分配的个数
+/// @retval 成功返回加入哈希链的记录数 失败错误代码负值
+int domain_index_build(struct domain_index *idx,struct bc_domain_db *db,enum domain_type type)
+{
+	int num=0;
+	int chained=0;
+	if((num=domain_index_build_begin(idx,db,type))<=0)
+		return num;
+	if((chained=domain_index_build_range(idx,db,type,0,num))<0)
+		return chained;
+	return domain_index_build_end(idx,chained);
+}
+
+/// @brief 将下标为index的记录以域名name加入索引,已有的记录先移除
+/// @retval 成功0 需要重建索引时返回错误代码负值
+int domain_index_insert(struct domain_index *idx,size_t index,const char *name)
+{
+	size_t len=0;
+	if(NULL==idx||NULL==name||index>=idx->cap)
+		return -EINVAL;
+	/// 最小完美哈希覆盖的记录和通配规则只能通过重建改变
+	if(index<idx->mph->slot_num||is_domain_glob(name))
+		return -EINVAL;
+	len=strnlen(name,DOMAIN_MAX_LENGTH-1);
+	domain_index_remove(idx,index);
+	/// 删除的域名不回收,keys或trie索引预留的余量用尽时需要重建
+	if(index<idx->base||index-idx->base>=idx->chain_cap||idx->key_used+len+1>idx->key_cap)
+		return -ENOSPC;
+	/// 中间尚未加入的记录视为无效
+	while(idx->records<=index)
+		idx->key_off[idx->records++]=0;
+	memcpy(idx->keys+idx->key_used,name,len);
+	idx->keys[idx->key_used+len]='\0';
+	idx->key_off[index]=idx->key_used+1;
+	idx->key_used+=len+1;
+	idx->live++;
+	domain_index_add(idx,index,hash_key_mem(name,len,idx->seed));
+	/// 超过目标负载时桶个数加倍,均摊后每次加入仍为常数时间
+	if(idx->num*100>idx->bucket_num*DOMAIN_INDEX_LOAD_PERCENT&&idx->bucket_num<idx->bucket_max)
+		domain_index_rehash(idx,idx->bucket_num<<1);
+	return 0;
+}
+
+/// @brief 将下标为index的记录从索引中移除
+void domain_index_remove(struct domain_index *idx,size_t index)
+{
+	unsigned int *bucket=NULL;
+	unsigned int *link=NULL;
+	unsigned int off=0;
+	if(NULL==idx||index>=idx->records||0==idx->key_off[index])
+		return;
+	off=idx->key_off[index];
+	idx->key_off[index]=0;
+	idx->live--;
+	if(index<idx->mph->slot_num||DOMAIN_INDEX_IN_TRIE==off||DOMAIN_INDEX_IN_GLOB==off)
+		return;
+	/// 从哈希链中摘除
+	bucket=idx->buckets+(idx->hashes[index-idx->base]&(idx->bucket_num-1));
+	for(link=bucket;*link;link=idx->next+(*link-1-idx->base))
+	{
+		if(*link==index+1)
+		{
+			*link=idx->next[index-idx->base];
+			idx->num--;
+			if(0==*bucket)
+				idx->used_buckets--;
+			break;
+		}
+	}
+}
+
+/// @brief 将src的内容复制到dst,两者须以相同的参数初始化
+/// 	trie索引在复制前按src的大小分配,只在进程上下文中调用
+/// @retval 成功0 失败错误代码负值,失败时dst为空索引
+int domain_index_copy(struct domain_index *dst,const struct domain_index *src)
+{
+	int err=0;
+	if(NULL==dst||NULL==src)
+		return -EINVAL;
+	if(dst->cap!=src->cap||dst->bucket_max!=src->bucket_max)
+		return -EINVAL;
+	if(0==src->cap)
+		return 0;
+	reset_domain_index(dst);
+	if((err=domain_index_reserve(dst,src->base,src->chain_cap,src->key_cap))<0)
+		return err;
+	if((err=domain_index_reserve_glob(dst,NULL!=src->glob&&src->glob->rule_num>0?
+					domain_glob_bytes(src->glob):0))<0)
+		return err;
+	if(src->base!=dst->base||src->records-src->base>dst->chain_cap||src->key_used>dst->key_cap)
+		return -EINVAL;
+	dst->bucket_num=src->bucket_num;
+	dst->seed=src->seed;
+	memcpy(dst->mph,src->mph,src->mph_size);
+	if(NULL!=dst->glob)
+		memcpy(dst->glob,src->glob,domain_glob_bytes(src->glob));
+	if(NULL!=dst->trie&&NULL!=src->trie)
+		memcpy(dst->trie,src->trie,domain_trie_bytes(src->trie));
+	else if(NULL!=dst->trie)
+		dst->trie->key_num=0;
+	memcpy(dst->buckets,src->buckets,src->bucket_num*sizeof(unsigned int));
+	if(src->records>src->base)
+	{
+		memcpy(dst->next,src->next,(src->records-src->base)*sizeof(unsigned int));
+		memcpy(dst->hashes,src->hashes,(src->records-src->base)*sizeof(unsigned int));
+	}
+	memcpy(dst->key_off,src->key_off,src->records*sizeof(unsigned int));
+	memcpy(dst->keys,src->keys,src->key_used);
+	dst->num=src->num;
+	dst->records=src->records;
+	dst->key_used=src->key_used;
+	dst->live=src->live;
+	dst->used_buckets=src->used_buckets;
+	dst->max_chain=src->max_chain;
+	return 0;
+}
+
+/// @brief 统计索引的结构
+/// 	只读取随加入和移除更新的计数,与记录数和桶个数无关,可以在查找的锁内调用
+void domain_index_get_stat(const struct domain_index *idx,struct domain_index_stat *stat)
+{
+	size_t holes=0;
+	memset(stat,0,sizeof(*stat));
+	if(NULL==idx||0==idx->cap)
+		return;
+	stat->records=idx->records;
+	stat->live=idx->live;
+	stat->mph_slots=idx->mph->slot_num;
+	/// 最小完美哈希编译时留下的空槽不是删除的记录
+	if(idx->mph->slot_num>idx->mph->key_num)
+		holes=idx->mph->slot_num-idx->mph->key_num;
+	if(stat->records-stat->live>holes)
+		stat->tombstones=stat->records-stat->live-holes;
+	stat->chained=idx->num;
+	if(NULL!=idx->glob&&idx->glob->rule_num>0)
+	{
+		stat->glob_rules=idx->glob->rule_num;
+		stat->glob_states=idx->glob->state_num;
+	}
+	if(NULL!=idx->trie&&idx->trie->key_num>0)
+	{
+		stat->trie_keys=idx->trie->key_num;
+		stat->trie_bytes=domain_trie_bytes(idx->trie);
+	}
+	stat->bucket_num=idx->bucket_num;
+	stat->used_buckets=idx->used_buckets;
+	stat->max_chain=idx->max_chain;
+	stat->bytes_used=sizeof(struct domain_mph)
+		+(idx->mph->slot_num?idx->mph->bucket_num*sizeof(unsigned short):0)
+		+idx->bucket_num*sizeof(unsigned int)
+		+idx->records*sizeof(unsigned int)
+		+(idx->records>idx->base?idx->records-idx->base:0)*2*sizeof(unsigned int)+idx->key_used
+		+(NULL!=idx->glob?domain_glob_bytes(idx->glob):0)
+		+stat->trie_bytes;
+	stat->bytes_alloc=idx->mph_size+idx->glob_size+idx->trie_size+idx->bucket_max*sizeof(unsigned int)
+		+idx->cap*sizeof(unsigned int)+idx->chain_cap*2*sizeof(unsigned int)+idx->key_cap;
+}
+
+/// @brief 以通配规则DFA匹配查询键,线格式逐个标签读入
+/// @retval 匹配成功1 匹配失败0
+static int domain_index_glob_match(const struct domain_glob *glob,const struct domain_key *key)
+{
+	unsigned int state=DOMAIN_GLOB_START;
+	bool accept=false;
+	size_t pos=0;
+	size_t len=0;
+	size_t n=0;
+	const unsigned char *label=NULL;
+	if(NULL==key->qname)
+		return domain_glob_match(glob,key->buf,key->len);
+	pos=key->qname->offset;
+	while(state&&(label=dns_qname_label(key->qname,&pos,&len))!=NULL)
+	{
+		if(n++>0)
+			state=domain_glob_feed(glob,state,".",1,&accept);
+		state=domain_glob_feed(glob,state,(const char*)label,len,&accept);
+	}
+	return n>0&&state&&accept;
+}
+
+/// @brief 查找的实现,probes为NULL时内联后不产生计数的代码
+/// @param[out] probes 累加比较的次数,trie,最小完美哈希和通配规则各计一次,哈希链按访问的节点计
+static __always_inline int index_lookup(const struct domain_index *idx,const struct domain_key *key,
+		unsigned int *probes)
+{
+	unsigned int cur=0;
+	unsigned int hash=0;
+	if(NULL==idx||0==idx->records)
+		return DOMAIN_INDEX_MISS;
+	/// 压缩trie:在压缩的形式上逐字符下降,删除或改写的记录不再标记为在trie中
+	if(NULL!=idx->trie&&idx->trie->key_num>0)
+	{
+		int r=NULL==key->qname?domain_trie_lookup(idx->trie,key->buf,key->len)
+			:domain_trie_lookup_qname(idx->trie,key->qname);
+		if(NULL!=probes)
+			(*probes)++;
+		if(r>=0&&(size_t)r<idx->records&&DOMAIN_INDEX_IN_TRIE==idx->key_off[r])
+			return r;
+	}
+	/// 最小完美哈希:一次探测,一次比较
+	if(idx->mph->slot_num>0)
+	{
+		unsigned int slot=domain_mph_slot(idx->mph,hash_key_seed(key,idx->mph->seed));
+		if(NULL!=probes)
+			(*probes)++;
+		if(idx->key_off[slot]&&domain_key_equal(key,idx->keys+idx->key_off[slot]-1))
+			return slot;
+	}
+	/// 发布后追加的记录
+	if(idx->num>0)
+	{
+		hash=hash_key_seed(key,idx->seed);
+		for(cur=idx->buckets[hash&(idx->bucket_num-1)];cur;cur=idx->next[cur-1-idx->base])
+		{
+			if(NULL!=probes)
+				(*probes)++;
+			if(idx->hashes[cur-1-idx->base]!=hash)
+				continue;
+			if(domain_key_equal(key,idx->keys+idx->key_off[cur-1]-1))
+				return cur-1;
+		}
+	}
+	/// 通配规则
+	if(NULL!=idx->glob&&idx->glob->rule_num>0)
+	{
+		if(NULL!=probes)
+			(*probes)++;
+		if(domain_index_glob_match(idx->glob,key))
+			return DOMAIN_INDEX_GLOB;
+	}
+	return DOMAIN_INDEX_MISS;
+}
+
+/// @brief 在索引中查找key
+/// @retval 匹配的记录下标 匹配通配规则DOMAIN_INDEX_GLOB 匹配失败DOMAIN_INDEX_MISS
+int domain_index_lookup(const struct domain_index *idx,const struct domain_key *key)
+{
+	return index_lookup(idx,key,NULL);
+}
+
+/// @brief 在索引中查找key,并统计比较的次数,供跟踪点使用
+/// @retval 同domain_index_lookup
+int domain_index_lookup_probes(const struct domain_index *idx,const struct domain_key *key,
+		unsigned int *probes)
+{
+	*probes=0;
+	return index_lookup(idx,key,probes);
+}
+
+/// @brief 在索引中查找key
+/// @retval 匹配成功1 匹配失败0
+int domain_index_match(const struct domain_index *idx,const struct domain_key *key)
+{
+	return domain_index_lookup(idx,key)!=DOMAIN_INDEX_MISS;
+}
@@ -0,0 +1,217 @@
+/*
+ * bc_domain_index模块头文件
+ * 	  域名哈希索引,内核查找与用户态工具共用同一份代码
+ */
+#ifndef _BC_DOMAIN_INDEX_H
+#define _BC_DOMAIN_INDEX_H
+
+#include "bc_domain_names.h"
+#include "bc_domain_parse.h"
+
+/// 哈希函数的乘数
+#define HASH_KEY_K0 0x9e3779b97f4a7c15ull
+#define HASH_KEY_K1 0xc2b2ae3d27d4eb4full
+
+/// 哈希链的目标负载(百分比),重建时依据链中记录数选择桶个数
+#define DOMAIN_INDEX_LOAD_PERCENT 75
+/// 桶个数下限
+#define DOMAIN_INDEX_MIN_BUCKETS 16
+
+/// domain_index_lookup的返回值,通配规则编译为一个自动机,不区分具体的规则
+#define DOMAIN_INDEX_MISS (-1)
+#define DOMAIN_INDEX_GLOB (-2)
+
+/// key_off的取值,记录的域名只保存在压缩trie中
+#define DOMAIN_INDEX_IN_TRIE 0xffffffffu
+/// key_off的取值,通配规则由DFA匹配,不复制到keys
+#define DOMAIN_INDEX_IN_GLOB 0xfffffffeu
+
+/// trie索引为重建之后追加的记录预留的项数,用尽时由完全重建增长
+#define DOMAIN_INDEX_TRIE_SLACK 1024
+
+/// 查询键,点分格式或DNS线格式
+struct domain_key
+{
+	const char *buf;                  ///< 点分格式域名,不要求以'\0'结尾
+	size_t len;                       ///< 点分格式长度
+	const struct dns_qname *qname;    ///< 非NULL时为线格式域名
+};
+
+/// 单个类别的索引
+/// 	前mph->slot_num条记录由用户程序编译的最小完美哈希索引,
+/// 	之后追加的记录按下标组织成数组链表,建立索引时不为每个域名分配内存
+/// 	有效域名紧凑复制到keys中,查找时不再读取db
+/// 	通配规则不进入哈希链,精确匹配失败后由glob判断
+/// 	启用压缩trie且db中有trie时,trie代替最小完美哈希,其中的域名不再复制到keys,
+/// 	keys和哈希链数组只容纳trie之后的记录,在重建时按需增长
+struct domain_index
+{
+	struct domain_mph *mph;  ///< 最小完美哈希索引的副本
+	size_t mph_size;         ///< mph缓冲区大小
+	struct domain_trie *trie;   ///< 压缩trie的副本,NULL表示不使用trie
+	size_t trie_size;        ///< trie缓冲区大小
+	struct domain_glob *glob;   ///< 通配规则DFA的副本,NULL表示没有通配规则
+	size_t glob_size;        ///< glob缓冲区大小,按编译的DFA在重建时分配
+	unsigned int *buckets;   ///< 桶,存放链首记录下标+1,0表示空,只使用前bucket_num个
+	unsigned int *next;      ///< 各记录在链中的后继下标+1,第i项对应记录base+i
+	unsigned int *hashes;    ///< 各记录哈希值的低32位,比较字符串前先比较哈希,第i项对应记录base+i
+	unsigned int *key_off;   ///< 各记录的域名在keys中的偏移+1,0表示无效记录
+	char *keys;              ///< 紧凑存放的有效域名,以'\0'分隔
+	size_t base;             ///< next,hashes和keys从该记录开始,之前的记录在trie中
+	size_t chain_cap;        ///< next和hashes的项数
+	size_t key_cap;          ///< keys的字节数
+	int node;                ///< 分配内存的NUMA节点
+	size_t bucket_num;       ///< 当前使用的桶个数,2的幂
+	size_t bucket_max;       ///< 已分配的桶个数
+	size_t cap;              ///< 可索引的记录个数
+	size_t num;              ///< 哈希链中的记录个数
+	size_t records;          ///< 已建立索引的记录个数
+	size_t key_used;         ///< keys已使用的字节数
+	size_t live;             ///< key_off非0的记录个数
+	size_t used_buckets;     ///< 非空桶个数
+	size_t max_chain;        ///< 最长链的长度,移除记录时不减小,重新分配桶时重新计算
+	unsigned int seed;       ///< 哈希链的种子,初始化时随机选取
+};
+
+/// @brief 将8个字节中的ASCII大写字母转为小写,非ASCII字节不变
+static inline unsigned long long hash_fold_case(unsigned long long w)
+{
+	const unsigned long long ones=0x0101010101010101ull;
+	unsigned long long low=w&(0x7f*ones);
+	/// 各字节最高位分别表示 >='A' 和 >'Z',加法不会向相邻字节进位
+	unsigned long long ge_a=low+(0x80-'A')*ones;
+	unsigned long long gt_z=low+(0x7f-'Z')*ones;
+	unsigned long long upper=ge_a&~gt_z&~w&(0x80*ones);
+	return w|(upper>>2);
+}
+
+/// @brief 计算长度为len的点分格式域名带种子的64位哈希值
+/// 	每次处理8个字节,忽略ASCII大小写
+unsigned long long hash_key_mem(const char *str,size_t len,unsigned int seed);
+
+/// @brief 计算查询键带种子的64位哈希值,线格式与点分格式的结果相同
+unsigned long long hash_key_seed(const struct domain_key *key,unsigned int seed);
+
+/// @brief 设置点分格式查询键,忽略末尾的根点
+/// @retval 可能匹配返回1 不可能匹配返回0
+int domain_key_set(struct domain_key *key,const char *buf,size_t len);
+
+/// @brief 设置线格式查询键
+/// @param[out] qname 由key引用,生命周期需覆盖key
+/// @retval 可能匹配返回1 不可能匹配返回0 格式错误返回错误代码负值
+int domain_key_set_qname(struct domain_key *key,struct dns_qname *qname,
+		const unsigned char *msg,size_t msg_len,size_t offset);
+
+/// @brief 将查询键复制为点分格式,不以'\0'结尾
+/// @param[out] buf 至少DOMAIN_MAX_LENGTH字节
+/// @retval 点分格式的长度
+size_t domain_key_copy(const struct domain_key *key,char *buf);
+
+/// @brief 比较查询键与db中的域名
+/// @retval 相等1 不相等0
+int domain_key_equal(const struct domain_key *key,const char *name);
+
+/// 索引的结构统计
+struct domain_index_stat
+{
+	size_t records;       ///< 已建立索引的记录个数
+	size_t live;          ///< 有效记录个数
+	size_t tombstones;    ///< 删除后留下的无效记录个数,不含最小完美哈希的空槽
+	size_t mph_slots;     ///< 最小完美哈希的槽个数
+	size_t chained;       ///< 哈希链中的记录个数
+	size_t glob_rules;    ///< 通配规则个数
+	size_t glob_states;   ///< 通配规则DFA的状态个数
+	size_t trie_keys;     ///< 压缩trie中的域名个数
+	size_t trie_bytes;    ///< 压缩trie占用的字节数
+	size_t bucket_num;    ///< 桶个数
+	size_t used_buckets;  ///< 非空桶个数
+	size_t max_chain;     ///< 最长链的长度,移除记录后可能偏大
+	size_t bytes_used;    ///< 当前内容占用的字节数
+	size_t bytes_alloc;   ///< 已分配的字节数
+};
+
+/// @brief 计算不小于n个链中记录,满足目标负载的桶个数
+static inline size_t domain_index_bucket_num(size_t n)
+{
+	size_t num=DOMAIN_INDEX_MIN_BUCKETS;
+	while(num*DOMAIN_INDEX_LOAD_PERCENT<n*100)
+		num<<=1;
+	return num;
+}
+
+/// @brief 初始化索引
+/// @param[in] bucket_num 最多使用的桶个数,2的幂,通常为domain_index_bucket_num(cap)
+/// @param[in] cap 可索引的记录个数
+/// @retval 成功0 失败错误代码负值
+int init_domain_index(struct domain_index *idx,size_t bucket_num,size_t cap);
+
+/// @brief 在NUMA节点node上初始化索引,用户态忽略node
+/// @retval 成功0 失败错误代码负值
+int init_domain_index_node(struct domain_index *idx,size_t bucket_num,size_t cap,int node);
+
+/// @brief 在NUMA节点node上初始化使用压缩trie的索引,重建优先使用db中的trie
+/// 	keys和哈希链数组在重建时按trie之后的记录数分配
+/// @retval 成功0 失败错误代码负值
+int init_domain_index_trie(struct domain_index *idx,size_t bucket_num,size_t cap,int node);
+
+/// @brief 销毁索引,并释放内存
+void destory_domain_index(struct domain_index *idx);
+
+/// @brief 清空索引内容,不释放内存
+void reset_domain_index(struct domain_index *idx);
+
+/// @brief 将下标为index,哈希为hash的记录加入索引
+/// @retval 成功0 失败错误代码负值
+int domain_index_add(struct domain_index *idx,size_t index,unsigned int hash);
+
+/// @brief 依据db中type类别的有效域名重建索引
+/// 	载入最小完美哈希索引,其余的记录加入哈希链
+/// @retval 成功返回加入哈希链的记录数 失败错误代码负值
+int domain_index_build(struct domain_index *idx,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 分段重建的第一步,清空索引并载入最小完美哈希索引和通配规则DFA
+/// 	domain_index_build依次调用三步,内核将中间一步按区间分给多个cpu
+/// @retval 成功返回需要复制的记录数 失败错误代码负值
+int domain_index_build_begin(struct domain_index *idx,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 复制[start,end)之间的有效域名,并计算需要加入哈希链的记录的哈希值
+/// 	不同的区间互不重叠,可以同时执行
+/// @retval 成功返回需要加入哈希链的记录数 失败错误代码负值
+int domain_index_build_range(struct domain_index *idx,struct bc_domain_db *db,enum domain_type type,
+		size_t start,size_t end);
+
+/// @brief 分段重建的最后一步,依据各区间的结果建立哈希链
+/// @param[in] chained 各区间返回值之和,用于选择桶个数
+/// @retval 成功返回加入哈希链的记录数 失败错误代码负值
+int domain_index_build_end(struct domain_index *idx,size_t chained);
+
+/// @brief 将下标为index的记录以域名name加入索引,已有的记录先移除
+/// 	只能加入最小完美哈希覆盖范围之后的字面域名,通配规则需要重新编译,
+/// 	链中记录超过目标负载时扩大桶个数
+/// @retval 成功0 需要重建索引时返回错误代码负值
+int domain_index_insert(struct domain_index *idx,size_t index,const char *name);
+
+/// @brief 将下标为index的记录从索引中移除
+void domain_index_remove(struct domain_index *idx,size_t index);
+
+/// @brief 将src的内容复制到dst,两者须以相同的参数初始化
+/// @retval 成功0 失败错误代码负值
+int domain_index_copy(struct domain_index *dst,const struct domain_index *src);
+
+/// @brief 统计索引的结构
+void domain_index_get_stat(const struct domain_index *idx,struct domain_index_stat *stat);
+
+/// @brief 在索引中查找key,并给出匹配的记录,用于统计各记录的命中次数
+/// @retval 匹配的记录下标 匹配通配规则DOMAIN_INDEX_GLOB 匹配失败DOMAIN_INDEX_MISS
+int domain_index_lookup(const struct domain_index *idx,const struct domain_key *key);
+
+/// @brief 同domain_index_lookup,并给出比较的次数,供跟踪点使用
+/// @param[out] probes trie,最小完美哈希和通配规则各计一次,哈希链按访问的节点计
+int domain_index_lookup_probes(const struct domain_index *idx,const struct domain_key *key,
+		unsigned int *probes);
+
+/// @brief 在索引中查找key,只访问索引自身的内存
+/// @retval 匹配成功1 匹配失败0
+int domain_index_match(const struct domain_index *idx,const struct domain_key *key);
+
+#endif /// _BC_DOMAIN_INDEX_H
@@ -0,0 +1,288 @@
+/*
+ * @file bc_domain_mph.c
+ * @breif 最小完美哈希索引(CHD)的编译,用户程序在发布更新时调用
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <error.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bc_domain_mph.h"
+#include "bc_domain_glob.h"
+#include "bc_domain_order.h"
+#include "bc_domain_trie.h"
+
+/// @brief 比较两个域名,用于qsort
+static int mph_key_cmp(const void *a,const void *b)
+{
+	return strcmp(*(const char* const*)a,*(const char* const*)b);
+}
+
+/// @brief 返回域名所在的记录
+static inline const struct domain_name *mph_key_name(const char *key)
+{
+	return (const struct domain_name*)(key-offsetof(struct domain_name,name));
+}
+
+/// @brief 以一个种子尝试编译
+/// @param[in] hashes 各域名的64位哈希
+/// @param[out] disp,slots 各桶位移,各域名所在的槽
+/// @retval 成功0 失败-EAGAIN
+static int try_build_mph(const unsigned long long *hashes,size_t n,
+		unsigned int slot_num,unsigned int bucket_num,
+		unsigned short *disp,unsigned int *slots)
+{
+	unsigned int *count=NULL;    ///< 各桶域名个数
+	unsigned int *start=NULL;    ///< 各桶域名在keys中的起始位置
+	unsigned int *keys=NULL;     ///< 按桶排列的域名下标
+	unsigned int *order=NULL;    ///< 按大小降序排列的桶
+	unsigned char *used=NULL;    ///< 槽是否已占用
+	unsigned int pos[64];        ///< 当前桶内各域名的槽
+	unsigned int max=0;
+	size_t i=0;
+	int err=-ENOMEM;
+
+	count=(unsigned int*)calloc(bucket_num+1,sizeof(unsigned int));
+	start=(unsigned int*)calloc(bucket_num+1,sizeof(unsigned int));
+	keys=(unsigned int*)calloc(n,sizeof(unsigned int));
+	order=(unsigned int*)calloc(bucket_num,sizeof(unsigned int));
+	used=(unsigned char*)calloc(slot_num,1);
+	if(NULL==count||NULL==start||NULL==keys||NULL==order||NULL==used)
+		goto out;
+	/// 按桶分组
+	for(i=0;i<n;i++)
+		count[domain_mph_bucket(hashes[i],bucket_num)]++;
+	for(i=0;i<bucket_num;i++)
+	{
+		start[i+1]=start[i]+count[i];
+		if(count[i]>max)
+			max=count[i];
+	}
+	err=-EAGAIN;
+	if(max>sizeof(pos)/sizeof(pos[0]))
+		goto out;
+	memset(count,0,bucket_num*sizeof(unsigned int));
+	for(i=0;i<n;i++)
+	{
+		unsigned int b=domain_mph_bucket(hashes[i],bucket_num);
+		keys[start[b]+count[b]++]=i;
+	}
+	/// 桶按大小降序处理(计数排序)
+	{
+		size_t k=0;
+		unsigned int size=0;
+		for(size=max;size>0;size--)
+			for(i=0;i<bucket_num;i++)
+				if(count[i]==size)
+					order[k++]=i;
+		for(i=0;i<bucket_num;i++)
+			if(0==count[i])
+				order[k++]=i;
+	}
+	memset(disp,0,bucket_num*sizeof(unsigned short));
+	for(i=0;i<bucket_num;i++)
+	{
+		unsigned int b=order[i];
+		unsigned int d=0;
+		if(0==count[b])
+			break;
+		/// 寻找使桶内所有域名落入空槽且互不冲突的位移
+		for(d=0;d<DOMAIN_MPH_DISP_MAX;d++)
+		{
+			unsigned int j=0,k=0;
+			for(j=0;j<count[b];j++)
+			{
+				pos[j]=domain_mph_pos(hashes[keys[start[b]+j]],d,slot_num);
+				if(used[pos[j]])
+					break;
+				for(k=0;k<j;k++)
+					if(pos[k]==pos[j])
+						break;
+				if(k<j)
+					break;
+			}
+			if(j==count[b])
+				break;
+		}
+		if(d==DOMAIN_MPH_DISP_MAX)
+			goto out;
+		disp[b]=d;
+		{
+			unsigned int j=0;
+			for(j=0;j<count[b];j++)
+			{
+				used[pos[j]]=1;
+				slots[keys[start[b]+j]]=pos[j];
+			}
+		}
+	}
+	err=0;
+out:
+	free(count);
+	free(start);
+	free(keys);
+	free(order);
+	free(used);
+	return err;
+}
+
+/// @brief 对n个域名编译最小完美哈希
+/// @retval 成功0 失败错误代码负值
+int build_domain_mph(const char **names,size_t n,size_t slot_num,
+		struct domain_mph *mph,unsigned int *slots)
+{
+	unsigned long long *hashes=NULL;
+	unsigned int bucket_num=n/DOMAIN_MPH_LAMBDA+1;
+	unsigned int seed=0;
+	size_t i=0;
+	int tries=0;
+	int err=-EAGAIN;
+
+	if(NULL==names||NULL==mph||NULL==slots||0==n||slot_num<n)
+		return -EINVAL;
+	hashes=(unsigned long long*)malloc(n*sizeof(unsigned long long));
+	if(NULL==hashes)
+		return -ENOMEM;
+	seed=(unsigned int)time(NULL)^(unsigned int)getpid();
+	for(tries=0;tries<DOMAIN_MPH_SEED_TRIES&&-EAGAIN==err;tries++)
+	{
+		seed=mph_mix32(seed+tries);
+		for(i=0;i<n;i++)
+		{
+			struct domain_key key;
+			domain_key_set(&key,names[i],strlen(names[i]));
+			hashes[i]=hash_key_seed(&key,seed);
+		}
+		err=try_build_mph(hashes,n,slot_num,bucket_num,mph->disp,slots);
+	}
+	free(hashes);
+	if(err<0)
+		return err;
+	mph->seed=seed;
+	mph->key_num=n;
+	mph->slot_num=slot_num;
+	mph->bucket_num=bucket_num;
+	return 0;
+}
+
+/// @brief 对db中type类别的有效域名编译最小完美哈希,并按槽重排域名记录
+/// 	通配规则不进入最小完美哈希,排在各槽之后,并编译为DFA
+/// @retval 成功0 失败错误代码负值
+int compile_domain_mph(struct bc_domain_db *db,enum domain_type type)
+{
+	struct domain_name *names=NULL;    ///< 有效的域名记录,通配规则位于末尾
+	struct domain_name *ordered=NULL;  ///< 按槽排列的记录,空槽为无效记录
+	const char **keys=NULL;
+	unsigned int *slots=NULL;
+	struct domain_mph *mph=NULL;
+	size_t max_len=0;
+	size_t len=0;
+	size_t n=0;
+	size_t globs=0;
+	size_t slot_num=0;
+	size_t i=0;
+	int err=0;
+
+	if(NULL==db||type<0||type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	max_len=db->domain_names.domain_type_max_len[type];
+	len=get_domain_name_num(db,type);
+	names=(struct domain_name*)calloc(len+1,sizeof(struct domain_name));
+	keys=(const char**)calloc(len+1,sizeof(char*));
+	slots=(unsigned int*)calloc(len+1,sizeof(unsigned int));
+	mph=(struct domain_mph*)calloc(1,DOMAIN_MPH_SIZE(max_len));
+	if(NULL==names||NULL==keys||NULL==slots||NULL==mph)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	/// 读出有效域名,通配规则从数组末尾向前存放
+	for(i=0;i<len;i++)
+	{
+		if((err=get_domain_name(names+n,db,type,i))<0)
+			goto out;
+		if(!names[n].is_vaild)
+			continue;
+		if(is_domain_glob(names[n].name))
+		{
+			globs++;
+			names[len-globs]=names[n];
+			continue;
+		}
+		keys[n]=names[n].name;
+		n++;
+	}
+	/// 并行的写进程可能加入相同的域名,相同的键无法编译,排序后去重
+	if(n>1)
+	{
+		size_t k=0;
+		qsort(keys,n,sizeof(char*),mph_key_cmp);
+		for(i=1;i<n;i++)
+		{
+			if(strcmp(keys[i],keys[k])!=0)
+				keys[++k]=keys[i];
+		}
+		n=k+1;
+	}
+	/// 负载约0.99,空槽为无效记录,通配规则另占记录
+	slot_num=n+n/100+1;
+	if(slot_num+globs>max_len)
+		slot_num=max_len-globs;
+	if(0==n||build_domain_mph(keys,n,slot_num,mph,slots)<0)
+	{
+		/// 不建立索引,只压缩记录
+		if(n>0)
+			error_at_line(0,EAGAIN,__FILE__,__LINE__,"build mph for type %d failed,use hash only",type);
+		memset(mph,0,sizeof(struct domain_mph));
+		slot_num=n;
+		for(i=0;i<n;i++)
+			slots[i]=i;
+	}
+	/// 先撤销旧索引,再按槽重写记录
+	{
+		struct domain_mph empty;
+		memset(&empty,0,sizeof(empty));
+		if((err=set_domain_mph(&empty,db,type))<0)
+			goto out;
+	}
+	if(slot_num+globs>0&&(ordered=(struct domain_name*)calloc(slot_num+globs,sizeof(struct domain_name)))==NULL)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	for(i=0;i<n;i++)
+		ordered[slots[i]]=*mph_key_name(keys[i]);
+	for(i=0;i<globs;i++)
+		ordered[slot_num+i]=names[len-1-i];
+	db->domain_names.domain_type_len[type]=slot_num+globs;
+	for(i=0;i<slot_num+globs;i++)
+	{
+		if((err=set_domain_name(ordered+i,db,type,i))<0)
+			goto out;
+	}
+	/// 之后预留的记录在发布前读到的是无效记录
+	if(len>slot_num+globs&&(err=clear_domain_names(db,type,slot_num+globs,len))<0)
+		goto out;
+	if((err=set_domain_mph(mph,db,type))<0)
+		goto out;
+	/// 编译失败时已输出错误,通配规则不生效,其余记录照常发布
+	compile_domain_glob(db,type);
+	/// 有序索引只供用户程序查询,失败时查询退化为内存中排序
+	compile_domain_order(db,type);
+	/// 压缩trie超出trie区时写入空的trie,内核改用最小完美哈希
+	compile_domain_trie(db,type);
+	err=save_bc_domain_names(db);
+out:
+	free(names);
+	free(ordered);
+	free(keys);
+	free(slots);
+	free(mph);
+	return err;
+}
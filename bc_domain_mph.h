@@ -0,0 +1,64 @@
+/*
+ * bc_domain_mph模块头文件
+ * 	  最小完美哈希索引(CHD),用户程序在发布更新时编译,
+ * 	  内核查找时一次探测,一次比较
+ */
+#ifndef _BC_DOMAIN_MPH_H
+#define _BC_DOMAIN_MPH_H
+
+#include "bc_domain_names.h"
+#include "bc_domain_index.h"
+
+/// 编译失败时更换种子的次数
+#define DOMAIN_MPH_SEED_TRIES 16
+/// 位移的取值范围
+#define DOMAIN_MPH_DISP_MAX 65536
+
+/// @brief 32位混合函数
+static inline unsigned int mph_mix32(unsigned int x)
+{
+	x^=x>>16;
+	x*=0x85ebca6bu;
+	x^=x>>13;
+	x*=0xc2b2ae35u;
+	x^=x>>16;
+	return x;
+}
+
+/// @brief 哈希值h在位移d下的槽位置
+static inline unsigned int domain_mph_pos(unsigned long long h,unsigned int d,unsigned int slot_num)
+{
+	return mph_mix32((unsigned int)h^(d*0x9e3779b9u))%slot_num;
+}
+
+/// @brief 哈希值h所在的桶
+static inline unsigned int domain_mph_bucket(unsigned long long h,unsigned int bucket_num)
+{
+	return (unsigned int)(h>>32)%bucket_num;
+}
+
+/// @brief 查找哈希值h对应的槽,调用者需保证mph->slot_num>0
+static inline unsigned int domain_mph_slot(const struct domain_mph *mph,unsigned long long h)
+{
+	return domain_mph_pos(h,mph->disp[domain_mph_bucket(h,mph->bucket_num)],mph->slot_num);
+}
+
+#ifdef USER_SPACE
+
+/// @brief 对n个域名编译最小完美哈希
+/// @param[in] names,n 域名
+/// @param[in] slot_num 槽个数,不小于n
+/// @param[out] mph 索引,disp至少容纳n/DOMAIN_MPH_LAMBDA+1个桶
+/// @param[out] slots 各域名所在的槽
+/// @retval 成功0 失败错误代码负值
+int build_domain_mph(const char **names,size_t n,size_t slot_num,
+		struct domain_mph *mph,unsigned int *slots);
+
+/// @brief 对db中type类别的有效域名编译最小完美哈希,并按槽重排域名记录
+/// 	编译失败时只压缩掉无效记录,不建立索引
+/// @retval 成功0 失败错误代码负值
+int compile_domain_mph(struct bc_domain_db *db,enum domain_type type);
+
+#endif /// USER_SPACE
+
+#endif /// _BC_DOMAIN_MPH_H
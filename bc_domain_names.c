@@ -16,11 +16,21 @@
 #include <errno.h>
 #include <error.h>
 #include <getopt.h>
+#include <ctype.h>
 #include <curl/curl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
 
 #include <bigmem.h>
 #include "bc_domain_names.h"
+#include "bc_domain_normalize.h"
+#include "bc_domain_mph.h"
+#include "bc_domain_glob.h"
+#include "bc_domain_order.h"
 #define MAX_PATH 512
+/// 重建一个类别时数据源的最大个数
+#define MAX_BUILD_SOURCES 16
 const char *g_program="bc_domain_name";
 
 /// 定义输出,考虑后面的cgi输出
@@ -44,6 +54,17 @@ struct option g_opts[]={
 	{"search",required_argument,NULL,'s'},
 	{"build",required_argument,NULL,'b'},
 	{"clean",required_argument,NULL,'c'},
+	{"hits",required_argument,NULL,'H'},
+	{"misses",required_argument,NULL,'M'},
+	{"prefix",required_argument,NULL,'p'},
+	{"under",required_argument,NULL,'u'},
+	{"range",required_argument,NULL,'g'},
+	{"export",required_argument,NULL,'x'},
+	{"watch",required_argument,NULL,'w'},
+	{"reset",no_argument,NULL,'z'},
+	{"format",required_argument,NULL,'f'},
+	{"db",required_argument,NULL,'D'},
+	{"init",no_argument,NULL,'I'},
 	{"debug",no_argument,NULL,'e'},
 	{"help",no_argument,NULL,'h'},
 	{NULL,0,NULL,0}
@@ -59,25 +80,54 @@ const char *g_domain_type[DOMAIN_TYPE_NUM]={
 	"shopping"
 };
 
+/// 输出格式
+enum output_format{TEXT_FORMAT=0,TSV_FORMAT,JSON_FORMAT,NUM_FORMAT};
+
+/// 输出格式名称
+const char *g_output_format[NUM_FORMAT]={
+	"text",
+	"tsv",
+	"json"
+};
+
+/// 标准输出缓冲区大小
+#define OUTPUT_BUF_SIZE (1<<20)
+
 /// 命令行参数结构
 enum handle_type{ADD_HANDLE=0,DEL_HANDLE,BUILD_HANDLE,SEARCH_HANDLE,READ_HANDLE
-	,CLEAN_HANDLE,NUM_HANDLE};
+	,CLEAN_HANDLE,HITS_HANDLE,PREFIX_HANDLE,UNDER_HANDLE,RANGE_HANDLE,EXPORT_HANDLE,WATCH_HANDLE,MISSES_HANDLE,NUM_HANDLE};
 
 struct argument
 {
 	enum handle_type handle;   ///< 处理类型
 	bool is_debug;             ///< 是否开启debug
+	enum output_format format; ///< --read和--search的输出格式
+	char db_path[MAX_PATH];    ///< db路径,为空时使用默认路径
+	bool is_init;              ///< 是否在db_path创建空db
+	bool is_reset;             ///< --hits输出后是否清零计数
 	union{
 		/// domain,type结构
 		struct {
 			char name[DOMAIN_MAX_LENGTH];
 			enum domain_type type;
 		}domain;
-		/// path,type结构
+		/// path[,path...],type结构
 		struct {
-			char path[MAX_PATH];
+			char path[MAX_BUILD_SOURCES][MAX_PATH];
+			size_t path_num;
 			enum domain_type type;
 		}dbfile;
+		/// 有序查询结构
+		struct {
+			char from[DOMAIN_MAX_LENGTH];   ///< 前缀,区域或区间起点
+			char to[DOMAIN_MAX_LENGTH];     ///< 区间终点,不包含
+			enum domain_type type;
+			bool rev;                       ///< 导出时按倒序域名排序
+		}order;
+		/// 监视结构
+		struct {
+			char manifest[MAX_PATH];        ///< 清单文件
+		}watch;
 	}argu;
 }g_argu;
 
@@ -93,8 +143,31 @@ static void usage(int err)
 		printf("\t-d|--del domain_name,type 在type中删除域名\n");
 		printf("\t-r|--read type 显示数据库存储的域名\n");
 		printf("\t-s|--search domain_name,type 在type类别中搜索域名\n");
-		printf("\t-b|--build path,type 依据文件path(或url)内容重建type数据库\n");
+		printf("\t-b|--build path[,path...],type 依据文件path(或url)内容重建type数据库\n");
+		printf("\t\t至多%d个数据源,url同时下载并边下载边解析,合并去重后写入,任一失败时保留原有记录\n",MAX_BUILD_SOURCES);
+		printf("\t\t每行一个域名,'#'后为注释,自动转小写,去除根点,\n");
+		printf("\t\tUnicode域名转换为punycode,非法和重复域名被丢弃\n");
+		printf("\t\t含'*'(任意个字符,可跨越'.')或'?'('.'以外的单个字符)的为通配规则,\n");
+		printf("\t\t如cdn*.example.com,*.s3.amazonaws.com,ad?.tracker.net\n");
 		printf("\t-c|--clean type 清除数据库中的域名\n");
+		printf("\t重建和清除时编译最小完美哈希索引和通配规则,添加的域名在类别满时触发整理\n");
+		printf("\t多个进程可以并行增删域名,重建,清除和整理时独占db\n");
+		printf("\t-H|--hits type 按命中次数从高到低显示type类别的有效域名,需加载模块并开启hit_counters\n");
+		printf("\t-M|--misses type 按次数从高到低显示type类别中查询最多的未匹配域名及误差,需加载模块并开启miss_sketch\n");
+		printf("\t\t域名已在类别中的标记为listed,通常是内核尚未载入的新增域名\n");
+		printf("\t-z|--reset 与--hits或--misses同时使用,输出后清零该类别的统计\n");
+		printf("\t-p|--prefix prefix,type 按字典序显示type类别中以prefix开头的域名\n");
+		printf("\t-u|--under zone,type 显示type类别中zone本身及其子域名,同一区域的相邻\n");
+		printf("\t-g|--range from,to,type 按字典序显示type类别中[from,to)之间的域名\n");
+		printf("\t-x|--export type[,rev] 按字典序导出type类别的有效域名,rev时按倒序域名排序\n");
+		printf("\t\t以上查询使用发布时建立的有序索引,通配规则不在其中\n");
+		printf("\t-w|--watch manifest 监视清单中的本地数据源,清单每行格式与--build相同\n");
+		printf("\t\t文件写入或替换后只读取该类别的数据源,增删与db不同的域名并一次提交,\n");
+		printf("\t\t连续的写入合并为一次同步,修改清单后需重新启动\n");
+		printf("\t-f|--format text|tsv|json --read,--search,--hits,--misses和有序查询的输出格式,默认text\n");
+		printf("\t-D|--db path 指定db,默认为/dev/%s,不存在时经/proc/%s和/dev/mem访问\n",
+				REGION_DEV_NAME,PROC_NAME);
+		printf("\t-I|--init 在--db指定的文件中创建空db,没有模块时用于测试\n");
 		printf("\t-h|--help 显示本信息\n");
 		printf("\t-e|--debug 显示调试信息\n");
 		printf("\n目前支持的type:\n");
@@ -134,10 +207,11 @@ static int parse_string(const char *str,struct argument *argu)
 	if(NULL==buf)
 		return -ENOMEM;
 	memcpy(buf,str,strlen(str)+1);
-	/// 以','为分隔进行str解析
+	/// 以','为分隔进行str解析,最后一项为类型
 	int err=0;
 	char *saveptr=NULL;
 	char *tok=NULL;
+	char *next=NULL;
 	do{
 		/// 解析string
 		if((tok=strtok_r(buf,",",&saveptr))==NULL)
@@ -145,25 +219,41 @@ static int parse_string(const char *str,struct argument *argu)
 			err=-EINVAL;
 			break;
 		}
-		if(argu->handle==BUILD_HANDLE)
+		if(argu->handle!=BUILD_HANDLE)
 		{
 			strncpy(argu->argu.domain.name,tok,DOMAIN_MAX_LENGTH-1);
 			argu->argu.domain.name[DOMAIN_MAX_LENGTH-1]='\0';
+			tok=strtok_r(NULL,",",&saveptr);
 		}
 		else
 		{
-			strncpy(argu->argu.dbfile.path,tok,MAX_PATH-1);
-			argu->argu.dbfile.path[MAX_PATH-1]='\0';
+			/// 重建时类型之前可以有多个数据源
+			argu->argu.dbfile.path_num=0;
+			while((next=strtok_r(NULL,",",&saveptr))!=NULL)
+			{
+				if(argu->argu.dbfile.path_num>=MAX_BUILD_SOURCES)
+				{
+					err=-E2BIG;
+					break;
+				}
+				strncpy(argu->argu.dbfile.path[argu->argu.dbfile.path_num],tok,MAX_PATH-1);
+				argu->argu.dbfile.path[argu->argu.dbfile.path_num++][MAX_PATH-1]='\0';
+				tok=next;
+			}
+			if(err<0)
+				break;
+			if(0==argu->argu.dbfile.path_num)
+				tok=NULL;
 		}
 		/// 解析域名类型
-		if((tok=strtok_r(NULL,",",&saveptr))==NULL)
+		if(NULL==tok)
 		{
 			err=-EINVAL;
 			break;
 		}
 		if((err=parse_domain_type(tok))<0)
 			break;
-		if(argu->handle==BUILD_HANDLE)
+		if(argu->handle!=BUILD_HANDLE)
 			argu->argu.domain.type=(enum domain_type)err;
 		else
 			argu->argu.dbfile.type=(enum domain_type)err;
@@ -173,18 +263,156 @@ static int parse_string(const char *str,struct argument *argu)
 	return err;
 }
 
+/// @brief 解析有序查询的参数,格式为 域名,...,type[,rev]
+/// @param[in] names 类别之前的域名个数,前缀和区域为1,区间为2,导出为0
+/// @retval 成功0,失败错误代码的负值
+static int parse_order_string(const char *str,struct argument *argu,int names)
+{
+	char *buf=NULL;
+	char *saveptr=NULL;
+	char *tok=NULL;
+	char *field[2]={argu->argu.order.from,argu->argu.order.to};
+	int err=0;
+	int i=0;
+	if(NULL==str||(buf=strdup(str))==NULL)
+		return -EINVAL;
+	argu->argu.order.from[0]='\0';
+	argu->argu.order.to[0]='\0';
+	argu->argu.order.rev=false;
+	/// 域名与db中一样转为小写,去掉末尾的根点
+	for(i=0;i<names&&0==err;i++)
+	{
+		size_t len=0;
+		if((tok=strtok_r(i>0?NULL:buf,",",&saveptr))==NULL||(len=strlen(tok))>=DOMAIN_MAX_LENGTH)
+		{
+			err=-EINVAL;
+			break;
+		}
+		if(len>0&&'.'==tok[len-1])
+			tok[--len]='\0';
+		for(len=0;'\0'!=tok[len];len++)
+			field[i][len]=tolower((unsigned char)tok[len]);
+		field[i][len]='\0';
+	}
+	if(0==err&&(tok=strtok_r(names>0?NULL:buf,",",&saveptr))==NULL)
+		err=-EINVAL;
+	if(0==err&&(err=parse_domain_type(tok))>=0)
+	{
+		argu->argu.order.type=(enum domain_type)err;
+		err=0;
+		/// 只有导出支持倒序
+		if((tok=strtok_r(NULL,",",&saveptr))!=NULL)
+		{
+			if(0==names&&strcasecmp(tok,"rev")==0)
+				argu->argu.order.rev=true;
+			else
+				err=-EINVAL;
+		}
+	}
+	free(buf);
+	return err;
+}
+
+/// @brief 将字符串解析为输出格式
+/// @retval 成功output_format值, 失败错误代码负值
+static int parse_output_format(const char *str)
+{
+	int i=0;
+	for(i=0;i<NUM_FORMAT;i++)
+	{
+		if(strcasecmp(str,g_output_format[i])==0)
+			return i;
+	}
+	return -EINVAL;
+}
+
+/// @brief 输出json字符串,转义引号,反斜杠和控制字符
+static void print_json_string(const char *str)
+{
+	const char *p=str;
+	DB_PRINT("\"");
+	for(;*p;p++)
+	{
+		unsigned char c=*p;
+		if('"'!=c&&'\\'!=c&&c>=0x20)
+			continue;
+		/// 输出不需转义的部分
+		DB_PRINT("%.*s",(int)(p-str),str);
+		if(c<0x20)
+			DB_PRINT("\\u%04x",c);
+		else
+			DB_PRINT("\\%c",c);
+		str=p+1;
+	}
+	DB_PRINT("%s\"",str);
+}
+
+/// @brief 输出机器可读格式的开头
+static void print_domain_begin(enum domain_type type)
+{
+	if(TSV_FORMAT==g_argu.format)
+		DB_PRINT("index\tname\tvalid\n");
+	else if(JSON_FORMAT==g_argu.format)
+		DB_PRINT("{\"type\":\"%s\",\"domains\":[",g_domain_type[type]);
+}
+
+/// @brief 以机器可读格式输出一条记录
+/// @param[in] count 已输出的记录个数
+static void print_domain(const struct domain_name *name,size_t index,size_t count)
+{
+	if(TSV_FORMAT==g_argu.format)
+		DB_PRINT("%zu\t%s\t%d\n",index,name->name,name->is_vaild?1:0);
+	else if(JSON_FORMAT==g_argu.format)
+	{
+		DB_PRINT("%s{\"index\":%zu,\"name\":",count>0?",":"",index);
+		print_json_string(name->name);
+		DB_PRINT(",\"valid\":%s}",name->is_vaild?"true":"false");
+	}
+}
+
+/// @brief 输出机器可读格式的结尾
+static void print_domain_end(size_t total)
+{
+	if(JSON_FORMAT==g_argu.format)
+		DB_PRINT("],\"total\":%zu}\n",total);
+}
+
 /// @brief 解析程序的命令行参数
 /// @param[in] argc,argv 命令行参数
 static void parse_argument(int argc,char **argv)
 {
 	g_argu.is_debug=false;
+	g_argu.handle=NUM_HANDLE;
 	int ch;
 	int err=0;
 	bool no_argu=true;
-	while((ch=getopt_long(argc,argv,":a:d:b:s:r:c:he",g_opts,NULL))!=-1)
+	while((ch=getopt_long(argc,argv,":a:d:b:s:r:c:H:M:p:u:g:x:w:f:D:Izhe",g_opts,NULL))!=-1)
 	{
 		switch(ch)
 		{
+			case 'D':
+				if(strlen(optarg)>=MAX_PATH)
+				{
+					error_at_line(0,ENAMETOOLONG,__FILE__,__LINE__,"db path too long");
+					usage(EXIT_FAILURE);
+				}
+				strcpy(g_argu.db_path,optarg);
+				continue;
+			case 'I':
+				g_argu.is_init=true;
+				break;
+			case 'z':
+				g_argu.is_reset=true;
+				continue;
+			case 'f':
+				if((err=parse_output_format(optarg))<0)
+				{
+					error_at_line(0,-err,__FILE__,__LINE__,"parse format error:%s",optarg);
+					usage(EXIT_FAILURE);
+				}
+				g_argu.format=(enum output_format)err;
+				/// 只指定格式时仍需要其他操作
+				continue;
 			case 'a':
 				g_argu.handle=ADD_HANDLE;
 				if((err=parse_string(optarg,&g_argu))<0)
@@ -240,6 +468,67 @@ static void parse_argument(int argc,char **argv)
 				g_argu.argu.domain.name[0]='\0';
 				g_argu.argu.domain.type=(enum domain_type)err;
 				break;
+			case 'H':
+				g_argu.handle=HITS_HANDLE;
+				if((err=parse_domain_type(optarg))<0)
+				{
+					error_at_line(0,-err,__FILE__,__LINE__,"parse string for HITS error:%s",optarg);
+					usage(EXIT_FAILURE);
+				}
+				g_argu.argu.domain.name[0]='\0';
+				g_argu.argu.domain.type=(enum domain_type)err;
+				break;
+			case 'M':
+				g_argu.handle=MISSES_HANDLE;
+				if((err=parse_domain_type(optarg))<0)
+				{
+					error_at_line(0,-err,__FILE__,__LINE__,"parse string for MISSES error:%s",optarg);
+					usage(EXIT_FAILURE);
+				}
+				g_argu.argu.domain.name[0]='\0';
+				g_argu.argu.domain.type=(enum domain_type)err;
+				break;
+			case 'p':
+				g_argu.handle=PREFIX_HANDLE;
+				if((err=parse_order_string(optarg,&g_argu,1))<0)
+				{
+					error_at_line(0,-err,__FILE__,__LINE__,"parse string for PREFIX error:%s",optarg);
+					usage(EXIT_FAILURE);
+				}
+				break;
+			case 'u':
+				g_argu.handle=UNDER_HANDLE;
+				if((err=parse_order_string(optarg,&g_argu,1))<0)
+				{
+					error_at_line(0,-err,__FILE__,__LINE__,"parse string for UNDER error:%s",optarg);
+					usage(EXIT_FAILURE);
+				}
+				break;
+			case 'g':
+				g_argu.handle=RANGE_HANDLE;
+				if((err=parse_order_string(optarg,&g_argu,2))<0)
+				{
+					error_at_line(0,-err,__FILE__,__LINE__,"parse string for RANGE error:%s",optarg);
+					usage(EXIT_FAILURE);
+				}
+				break;
+			case 'x':
+				g_argu.handle=EXPORT_HANDLE;
+				if((err=parse_order_string(optarg,&g_argu,0))<0)
+				{
+					error_at_line(0,-err,__FILE__,__LINE__,"parse string for EXPORT error:%s",optarg);
+					usage(EXIT_FAILURE);
+				}
+				break;
+			case 'w':
+				g_argu.handle=WATCH_HANDLE;
+				if(strlen(optarg)>=MAX_PATH)
+				{
+					error_at_line(0,ENAMETOOLONG,__FILE__,__LINE__,"manifest path too long");
+					usage(EXIT_FAILURE);
+				}
+				strcpy(g_argu.argu.watch.manifest,optarg);
+				break;
 			case 'h':
 				usage(EXIT_SUCCESS);
 			case '?':
@@ -270,131 +559,475 @@ static int check_type(enum domain_type type)
 	return 1;
 }
 
-/// @breif 打开本地file
-static FILE* local_open(const char *path)
+/// 数据源中一行的最大长度,超出的部分丢弃,其余仍按一行处理
+#define BUILD_LINE_MAX 1024
+/// 读取本地数据源的块大小
+#define BUILD_READ_SIZE (64*1024)
+
+/// 重建一个类别时合并各数据源的镜像,全部数据源读取成功后才写入db
+struct build_image
+{
+	struct domain_set set;          ///< 各数据源共用的去重集合
+	char *pool;                     ///< 按到达顺序接受的域名,以'\0'分隔
+	size_t pool_len;
+	size_t pool_cap;
+	size_t num;                     ///< 接受的域名个数
+	size_t max;                     ///< 类别容量
+	struct domain_norm_stat stat;
+	int err;                        ///< 出错时的错误代码负值,之后的内容被丢弃
+};
+
+/// 一个数据源,边读取边按行解析
+struct build_source
+{
+	const char *path;
+	struct build_image *image;
+	char line[BUILD_LINE_MAX];      ///< 尚未结束的一行
+	size_t line_len;
+	size_t bytes;                   ///< 已读取的字节数
+};
+
+/// @brief 释放镜像
+static void clean_build_image(struct build_image *image)
+{
+	free(image->pool);
+	image->pool=NULL;
+	clean_domain_set(&image->set);
+}
+
+/// @brief 判断数据源是否为url
+static bool is_remote_source(const char *path)
+{
+	return strncasecmp(path,"http://",strlen("http://"))==0||
+		strncasecmp(path,"https://",strlen("https://"))==0;
+}
+
+/// @brief 规范化一行并加入镜像
+static void build_image_line(struct build_image *image,const char *line,size_t len)
+{
+	char name[DOMAIN_MAX_LENGTH];
+	size_t name_len=0;
+	int ret=0;
+	int err=0;
+	if(image->err<0)
+		return;
+	image->stat.total++;
+	/// 规范化
+	ret=normalize_domain(line,len,name,&name_len);
+	if(DOMAIN_NORM_SKIP==ret)
+	{
+		image->stat.skipped++;
+		return;
+	}
+	if(DOMAIN_NORM_INVALID==ret)
+	{
+		image->stat.invalid++;
+		DEBUG_PRINT(0,"invalid domain in line %zu",image->stat.total);
+		return;
+	}
+	/// 去重,各数据源共用一个集合
+	if((err=domain_set_insert(&image->set,name,name_len))<=0)
+	{
+		if(err<0)
+			image->err=err;
+		else
+			image->stat.duplicate++;
+		return;
+	}
+	if(image->num>=image->max)
+	{
+		DEBUG_PRINT(0,"domain in file is too max,MAX:%zu",image->max);
+		image->stat.overflow++;
+		return;
+	}
+	if(image->pool_len+name_len+1>image->pool_cap)
+	{
+		size_t cap=image->pool_cap<BUILD_READ_SIZE?BUILD_READ_SIZE:image->pool_cap*2;
+		char *pool=(char*)realloc(image->pool,cap);
+		if(NULL==pool)
+		{
+			image->err=-ENOMEM;
+			return;
+		}
+		image->pool=pool;
+		image->pool_cap=cap;
+	}
+	memcpy(image->pool+image->pool_len,name,name_len+1);
+	image->pool_len+=name_len+1;
+	image->num++;
+	image->stat.accepted++;
+	if(DOMAIN_NORM_REWRITE==ret)
+		image->stat.rewritten++;
+}
+
+/// @brief 按行解析数据源读到的内容,未结束的一行留到下次
+static void build_source_feed(struct build_source *src,const char *data,size_t len)
+{
+	size_t i=0;
+	src->bytes+=len;
+	for(i=0;i<len;i++)
+	{
+		if('\n'==data[i])
+		{
+			build_image_line(src->image,src->line,src->line_len);
+			src->line_len=0;
+		}
+		else if(src->line_len<BUILD_LINE_MAX)
+			src->line[src->line_len++]=data[i];
+	}
+}
+
+/// @brief 数据源结束,解析最后一行
+static void build_source_end(struct build_source *src)
+{
+	if(src->line_len>0)
+		build_image_line(src->image,src->line,src->line_len);
+	src->line_len=0;
+}
+
+/// @brief libcurl写回调,收到的内容直接解析
+static size_t build_source_write(void *ptr,size_t size,size_t nmeb,void *stream)
 {
-	return fopen(path,"r");
+	struct build_source *src=(struct build_source*)stream;
+	/// 出错后返回0使传输中止
+	if(src->image->err<0)
+		return 0;
+	build_source_feed(src,(const char*)ptr,size*nmeb);
+	return size*nmeb;
 }
 
-/// @brief libcurl写文件回调函数
-static size_t write_data(void *ptr,size_t size,size_t nmeb,void *stream)
+/// @brief 读取本地数据源
+/// @retval 成功0 失败错误代码负值
+static int read_local_source(struct build_source *src)
 {
-	int written = fwrite(ptr,size,nmeb,(FILE*)stream);
-	return written;
+	static char buf[BUILD_READ_SIZE];
+	FILE *fp=NULL;
+	size_t len=0;
+	int err=0;
+	if((fp=fopen(src->path,"r"))==NULL)
+	{
+		err=-errno;
+		error_at_line(0,-err,__FILE__,__LINE__,"open %s failed",src->path);
+		return err;
+	}
+	while((len=fread(buf,1,sizeof(buf),fp))>0)
+		build_source_feed(src,buf,len);
+	if(ferror(fp))
+	{
+		err=-EIO;
+		error_at_line(0,EIO,__FILE__,__LINE__,"read %s failed",src->path);
+	}
+	else
+		build_source_end(src);
+	fclose(fp);
+	return err;
+}
+
+/// @brief 在一个multi句柄上同时下载各远程数据源,边下载边解析
+/// 	同一主机的连接由multi句柄的连接缓存复用,总时间取决于最慢的数据源
+/// @retval 全部成功0 任一失败错误代码负值,此时其余传输被中止
+static int fetch_remote_sources(struct build_source *srcs,size_t num)
+{
+	CURL *easy[MAX_BUILD_SOURCES];
+	CURLM *multi=NULL;
+	CURLMsg *msg=NULL;
+	size_t n=0;
+	size_t i=0;
+	int running=0;
+	int left=0;
+	int err=0;
+	memset(easy,0,sizeof(easy));
+	if((multi=curl_multi_init())==NULL)
+		return -ENOMEM;
+	/// HTTP/2的数据源在一个连接上复用
+	curl_multi_setopt(multi,CURLMOPT_PIPELINING,CURLPIPE_MULTIPLEX);
+	for(i=0;i<num;i++)
+	{
+		if(!is_remote_source(srcs[i].path))
+			continue;
+		if((easy[n]=curl_easy_init())==NULL)
+		{
+			err=-ENOMEM;
+			goto out;
+		}
+		curl_easy_setopt(easy[n],CURLOPT_URL,srcs[i].path);
+		curl_easy_setopt(easy[n],CURLOPT_WRITEFUNCTION,build_source_write);
+		curl_easy_setopt(easy[n],CURLOPT_WRITEDATA,srcs+i);
+		curl_easy_setopt(easy[n],CURLOPT_PRIVATE,srcs+i);
+		curl_easy_setopt(easy[n],CURLOPT_FOLLOWLOCATION,1L);
+		/// HTTP错误码视为失败,不把错误页面当作域名列表
+		curl_easy_setopt(easy[n],CURLOPT_FAILONERROR,1L);
+		curl_easy_setopt(easy[n],CURLOPT_ACCEPT_ENCODING,"");
+		curl_multi_add_handle(multi,easy[n]);
+		n++;
+	}
+	while(n>0)
+	{
+		CURLMcode mc=curl_multi_perform(multi,&running);
+		if(CURLM_OK==mc&&running>0)
+			mc=curl_multi_poll(multi,NULL,0,1000,NULL);
+		if(CURLM_OK!=mc)
+		{
+			error_at_line(0,EIO,__FILE__,__LINE__,"curl multi error:%s",curl_multi_strerror(mc));
+			err=-EIO;
+			goto out;
+		}
+		/// 完成的数据源解析最后一行
+		while((msg=curl_multi_info_read(multi,&left))!=NULL)
+		{
+			struct build_source *src=NULL;
+			double total=0;
+			if(CURLMSG_DONE!=msg->msg)
+				continue;
+			curl_easy_getinfo(msg->easy_handle,CURLINFO_PRIVATE,(char**)&src);
+			if(CURLE_OK!=msg->data.result)
+			{
+				error_at_line(0,EIO,__FILE__,__LINE__,"fetch %s failed:%s",
+						src->path,curl_easy_strerror(msg->data.result));
+				err=-EIO;
+				goto out;
+			}
+			curl_easy_getinfo(msg->easy_handle,CURLINFO_TOTAL_TIME,&total);
+			DEBUG_PRINT(0,"fetch %s ok,%zu bytes in %.3fs",src->path,src->bytes,total);
+			build_source_end(src);
+		}
+		if(0==running)
+			break;
+	}
+out:
+	for(i=0;i<n;i++)
+	{
+		curl_multi_remove_handle(multi,easy[i]);
+		curl_easy_cleanup(easy[i]);
+	}
+	curl_multi_cleanup(multi);
+	return err;
 }
 
-/// @breif 打开远程文件
-static FILE * remote_open(const char *url)
+/// @brief 判断type中是否已有有效的域名name
+/// 	按列区的有效位,长度和哈希值筛选,只比较候选记录的域名
+/// @retval 存在1 不存在0
+static int find_bc_domain(struct bc_domain_db *db,enum domain_type type,const char *name)
 {
-	FILE* fp = tmpfile();
-	if(fp==NULL)
-		return NULL;
-	CURL *curl;
-	curl = curl_easy_init();
-	curl_easy_setopt(curl,CURLOPT_URL,url);
-	curl_easy_setopt(curl,CURLOPT_WRITEFUNCTION,write_data);
-	curl_easy_setopt(curl,CURLOPT_WRITEDATA,fp);
-	curl_easy_perform(curl);
-	curl_easy_cleanup(curl);
-	rewind(fp);
-	return fp;
+	struct domain_columns cols;
+	size_t len=strlen(name);
+	unsigned int hash=domain_name_hash(name,len);
+	size_t i=0;
+	size_t k=0;
+	for(i=0;get_domain_columns(&cols,db,type,i)>0;i+=cols.num)
+	{
+		for(k=0;k<cols.num;k++)
+		{
+			struct domain_name buf;
+			const struct domain_name *n=NULL;
+			if(!domain_column_valid(&cols,i+k)||cols.len[k]!=len||cols.hash[k]!=hash)
+				continue;
+			if((n=get_domain_name_ref(db,type,i+k,&buf))==NULL)
+				continue;
+			if(n->is_vaild&&strcmp(n->name,name)==0)
+				return 1;
+		}
+	}
+	return 0;
 }
 
-/// @brief 依据path获取fp指针, path为域名文件，或远程url域名文件
-/// @retval 成功fp指针  失败返回NULL
-static FILE* domain_file_open(const char *path)
+/// @brief 发布index处的name后去掉并发添加的重复记录
+/// 	同名的两条记录中去掉下标较大的一条并写入删除日志.各进程都先发布再扫描,
+/// 	任意两条同名记录至少有一方的进程能看到另一方,因此最终只保留下标最小的一条
+/// @retval 本记录被去掉1 保留0 失败错误代码负值
+static int dedup_bc_domain(struct bc_domain_db *db,enum domain_type type,
+		const struct domain_name *name,size_t index,bool *is_update)
 {
-	const char *str_id="http://";
-	if(strncasecmp(path,str_id,strlen(str_id))==0)
-		return remote_open(path);
-	return local_open(path);
+	struct domain_columns cols;
+	size_t len=strlen(name->name);
+	unsigned int hash=domain_name_hash(name->name,len);
+	bool is_dup=false;
+	size_t i=0;
+	size_t k=0;
+	int err=0;
+	/// 发布的有效位先于扫描对其他进程可见
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for(i=0;(err=get_domain_columns(&cols,db,type,i))>0;i+=cols.num)
+	{
+		for(k=0;k<cols.num;k++)
+		{
+			struct domain_name buf;
+			struct domain_name drop;
+			const struct domain_name *n=NULL;
+			size_t hi=i+k>index?i+k:index;
+			if(i+k==index||!domain_column_valid(&cols,i+k)||cols.len[k]!=len||cols.hash[k]!=hash)
+				continue;
+			if((n=get_domain_name_ref(db,type,i+k,&buf))==NULL||!n->is_vaild||strcmp(n->name,name->name)!=0)
+				continue;
+			memcpy(&drop,name,sizeof(drop));
+			drop.is_vaild=false;
+			if((err=set_domain_name(&drop,db,type,hi))<0)
+			{
+				DEBUG_PRINT(-err,"drop duplicate index %zu in %s error",hi,g_domain_type[type]);
+				return err;
+			}
+			if(hi==index)
+			{
+				is_dup=true;
+				continue;
+			}
+			/// 对方进程之后写入的增加日志按db当前内容应用,不会恢复该记录
+			if(append_domain_journal(db,DOMAIN_JOURNAL_DEL,type,hi)<0)
+				*is_update=true;
+		}
+	}
+	if(err<0)
+		return err;
+	return is_dup?1:0;
 }
 
 /// @breif 向bc_domain数据库中添加数据
-static int add_bc_domain(const struct argument *argu,struct bc_domain_db *db)
+/// @param[out] is_update 需要内核完全重建索引时置为true,否则通过修改日志增量更新
+static int add_bc_domain(const struct argument *argu,struct bc_domain_db *db,bool *is_update)
 {
 	enum domain_type type=argu->argu.domain.type;
 	if(check_type(type)!=1)
 		return -EINVAL;
 	DEBUG_PRINT(0,"add db for %s,%s",
 			argu->argu.domain.name,g_domain_type[type]);
-	/// 判断是否需要整理内存碎片
-	if(db->domain_names.domain_type_len[type]>=
-			db->domain_names.domain_type_max_len[type])
+	/// 规范化域名
+	struct domain_name name;
+	size_t len=0;
+	const char *buf=argu->argu.domain.name;
+	int ret=normalize_domain(buf,strlen(buf),name.name,&len);
+	if(DOMAIN_NORM_SKIP==ret||DOMAIN_NORM_INVALID==ret)
+	{
+		error_at_line(0,EINVAL,__FILE__,__LINE__,"invalid domain name:%s",buf);
+		return -EINVAL;
+	}
+	if(DOMAIN_NORM_REWRITE==ret)
+		DB_PRINT("rewrite %s -> %s\n",buf,name.name);
+	name.is_vaild=true;
+	/// 去重
+	if(find_bc_domain(db,type,name.name))
+	{
+		DB_PRINT("%s already in %s\n",name.name,g_domain_type[type]);
+		return 0;
+	}
+	/// 原子地预留记录,类别已满时改为独占加锁,整理内存碎片后重试
+	size_t index=0;
+	int err=reserve_domain_name(db,type,&index);
+	if(-ENOSPC==err)
+	{
+		unlock_bc_domain_db(db);
+		if((err=lock_bc_domain_db(db,true))<0)
+			return err;
+		/// 整理后记录的位置都已改变
 		defrag_mentation(db,type);
-	if(db->domain_names.domain_type_len[type]>=
-			db->domain_names.domain_type_max_len[type])
+		*is_update=true;
+		err=reserve_domain_name(db,type,&index);
+	}
+	if(-ENOSPC==err)
 	{
 		DEBUG_PRINT(ENOMEM,"no mem use");
 		return -ENOMEM;
 	}
-	int index=db->domain_names.domain_type_len[type]++;
-	/// 写入新域名
-	struct domain_name name;
-	size_t len=strlen(argu->argu.domain.name);
-	const char *buf=argu->argu.domain.name;
-	if(len>=DOMAIN_MAX_LENGTH-1)
-		len=DOMAIN_MAX_LENGTH-1;
-	memcpy(name.name,buf,len);
-	name.name[len]='\0';
-	name.is_vaild=true;
-	int err=0;
-	if((err=set_domain_name(&name,db,type,index))<0)
+	if(err<0)
 	{
-		DEBUG_PRINT(-err,"write %s into type(%d) error",name.name,index);
-		goto clean_len;
+		DEBUG_PRINT(-err,"reserve record in type(%d) error",type);
+		return err;
 	}
-	/// 保存bc_domain_names
-	if((err=save_bc_domain_names(db))<0)
+	/// 写入并发布新域名,失败时预留的记录保持无效,整理时去掉
+	if((err=publish_domain_name(&name,db,type,index))<0)
 	{
-		DEBUG_PRINT(-err,"save bc_domain_names error");
-		goto clean_len;
+		DEBUG_PRINT(-err,"write %s into index(%zu) error",name.name,index);
+		return err;
 	}
+	/// 共享锁下其他进程可能同时添加了同一域名
+	if((ret=dedup_bc_domain(db,type,&name,index,is_update))<0)
+		return ret;
+	if(1==ret)
+	{
+		DB_PRINT("%s already in %s\n",name.name,g_domain_type[type]);
+		return 0;
+	}
+	/// 通配规则独占地重新编译该类别的DFA,由内核完全重建索引,编译失败时已输出错误
+	if(is_domain_glob(name.name))
+	{
+		unlock_bc_domain_db(db);
+		if((err=lock_bc_domain_db(db,true))<0)
+			return err;
+		compile_domain_glob(db,type);
+		*is_update=true;
+	}
+	if(!*is_update&&append_domain_journal(db,DOMAIN_JOURNAL_ADD,type,index)<0)
+		*is_update=true;
 	return 0;
-clean_len:
-	db->domain_names.domain_type_len[type]=index;
-	return err;
 }
 
 /// @breif 向bc_domain数据库中删除数据
-static int del_bc_domain(const struct argument *argu,struct bc_domain_db *db)
+/// @param[out] is_update 修改日志写入失败时置为true,由内核完全重建索引
+static int del_bc_domain(const struct argument *argu,struct bc_domain_db *db,bool *is_update)
 {
 	enum domain_type type=argu->argu.domain.type;
 	if(check_type(type)!=1)
 		return -EINVAL;
 	DEBUG_PRINT(0,"del db for %s,%s",
 			argu->argu.domain.name,g_domain_type[type]);
-	/// 设置domain_name对象
+	/// 与添加时相同地规范化域名
 	struct domain_name name;
+	size_t len=0;
 	const char *buf=argu->argu.domain.name;
-	size_t len=strlen(buf);
-	len=len>=DOMAIN_MAX_LENGTH-1?DOMAIN_MAX_LENGTH-1:len;
-	memcpy(name.name,buf,len);
-	name.name[len]='\0';
+	int ret=normalize_domain(buf,strlen(buf),name.name,&len);
+	if(DOMAIN_NORM_SKIP==ret||DOMAIN_NORM_INVALID==ret)
+	{
+		error_at_line(0,EINVAL,__FILE__,__LINE__,"invalid domain name:%s",buf);
+		return -EINVAL;
+	}
+	if(DOMAIN_NORM_REWRITE==ret)
+		DB_PRINT("rewrite %s -> %s\n",buf,name.name);
 	name.is_vaild=false;
-	/// 查找
-	size_t sum=get_domain_name_num(db,type);
-	int i=0;
+	/// 按列区筛选有效且长度和哈希值相同的记录
+	struct domain_columns cols;
+	unsigned int hash=domain_name_hash(name.name,len);
+	size_t i=0;
+	size_t k=0;
 	int err=0;
-	for(i=0;i<sum;++i)
+	bool is_glob=false;
+	for(i=0;(err=get_domain_columns(&cols,db,type,i))>0;i+=cols.num)
 	{
-		struct domain_name n;
-		if((err=get_domain_name(&n,db,type,i))<0)
+		for(k=0;k<cols.num;k++)
 		{
-			DEBUG_PRINT(0,"get domain index %d in %s error",
-					i,g_domain_type[type]);
-			continue;
+			struct domain_name n;
+			if(!domain_column_valid(&cols,i+k)||cols.len[k]!=len||cols.hash[k]!=hash)
+				continue;
+			if((err=get_domain_name(&n,db,type,i+k))<0)
+			{
+				DEBUG_PRINT(0,"get domain index %zu in %s error",
+						i+k,g_domain_type[type]);
+				continue;
+			}
+			if(strcasecmp(n.name,name.name)!=0)
+				continue;
+			if((err=set_domain_name(&name,db,type,i+k))<0)
+			{
+				DEBUG_PRINT(0,"set domain index %zu in %s error",
+						i+k,g_domain_type[type]);
+				continue;
+			}
+			if(append_domain_journal(db,DOMAIN_JOURNAL_DEL,type,i+k)<0)
+				*is_update=true;
+			DEBUG_PRINT(0,"del domain %s in index %zu ok",
+					name.name,i+k);
+			if(n.is_vaild&&is_domain_glob(n.name))
+				is_glob=true;
 		}
-		if(strcasecmp(n.name,name.name)!=0)
-			continue;
-		if((err=set_domain_name(&name,db,type,i))<0)
-		{
-			DEBUG_PRINT(0,"set domain index %d in %s error",
-					i,g_domain_type[type]);
-			continue;
-		}
-		DEBUG_PRINT(0,"del domain %s in index %d ok",
-				name.name,i);
+	}
+	if(err<0)
+		DEBUG_PRINT(-err,"get columns in %s error",g_domain_type[type]);
+	/// 删除了通配规则时独占地重新编译DFA
+	if(is_glob)
+	{
+		unlock_bc_domain_db(db);
+		if((err=lock_bc_domain_db(db,true))<0)
+			return err;
+		compile_domain_glob(db,type);
+		*is_update=true;
 	}
 	return 0;
 }
@@ -415,82 +1048,529 @@ static int search_bc_domain(const struct argument *argu,struct bc_domain_db *db)
 	memcpy(name.name,buf,len);
 	name.name[len]='\0';
 	name.is_vaild=true;
-	/// 查找
-	size_t sum=get_domain_name_num(db,type);
-	int i=0;
+	/// 按列区的长度筛选,短于查询串的记录不读取
+	struct domain_columns cols;
+	struct domain_name span_buf[DOMAIN_SPAN_SIZE];
+	const struct domain_name *span=NULL;
+	size_t span_start=0;
+	size_t span_num=0;
+	size_t i=0;
+	size_t k=0;
+	size_t count=0;
 	int err=0;
-	for(i=0;i<sum;++i)
+	print_domain_begin(type);
+	for(i=0;(err=get_domain_columns(&cols,db,type,i))>0;i+=cols.num)
 	{
-		struct domain_name n;
-		if((err=get_domain_name(&n,db,type,i))<0)
+		for(k=0;k<cols.num;k++)
 		{
-			DEBUG_PRINT(0,"get domain index %d in %s error",
-					i,g_domain_type[type]);
-			continue;
+			const struct domain_name *n=NULL;
+			size_t index=i+k;
+			if(cols.len[k]<len)
+				continue;
+			if(NULL==span||index>=span_start+span_num)
+			{
+				span_start=index;
+				span_num=get_domain_name_num(db,type)-index;
+				if((span=get_domain_name_span(db,type,index,&span_num,span_buf,DOMAIN_SPAN_SIZE))==NULL)
+				{
+					err=-EIO;
+					break;
+				}
+			}
+			n=span+(index-span_start);
+			if(strcasestr(n->name,name.name)==NULL)
+				continue;
+			if(TEXT_FORMAT==g_argu.format)
+				DB_PRINT("%zu %s %s\n",index,n->name,n->is_vaild?"vaild":"no_vaild");
+			else
+				print_domain(n,index,count);
+			count++;
 		}
-		if(strcasestr(n.name,name.name)=='\0')
-			continue;
-		DB_PRINT("%d %s %s\n",i,n.name,n.is_vaild?"vaild":"no_vaild");
+		if(err<0)
+			break;
 	}
-	return 0;
+	print_domain_end(count);
+	return err;
+}
+
+/// @brief 读取type类别的各数据源,合并去重为镜像,远程数据源同时下载
+/// 	成功时由调用者以clean_build_image释放镜像
+/// @retval 全部成功0 任一失败错误代码负值,此时镜像已释放
+static int read_build_image(const struct argument *argu,struct bc_domain_db *db,struct build_image *image)
+{
+	enum domain_type type=argu->argu.dbfile.type;
+	struct build_source *srcs=NULL;
+	size_t num=argu->argu.dbfile.path_num;
+	size_t i=0;
+	int err=0;
+	memset(image,0,sizeof(*image));
+	image->max=db->domain_names.domain_type_max_len[type];
+	/// 初始化去重集合
+	if((err=init_domain_set(&image->set,image->max))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"init domain set error");
+		return err;
+	}
+	if((srcs=(struct build_source*)calloc(num,sizeof(struct build_source)))==NULL)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	for(i=0;i<num;i++)
+	{
+		srcs[i].path=argu->argu.dbfile.path[i];
+		srcs[i].image=image;
+		DEBUG_PRINT(0,"build db for %s,%s",srcs[i].path,g_domain_type[type]);
+	}
+	/// 先读取本地数据源,再同时下载远程数据源
+	for(i=0;i<num&&err>=0;i++)
+	{
+		if(!is_remote_source(srcs[i].path))
+			err=read_local_source(srcs+i);
+	}
+	if(err>=0)
+		err=fetch_remote_sources(srcs,num);
+	if(err>=0&&image->err<0)
+		err=image->err;
+	DB_PRINT("sources:%zu lines:%zu added:%zu rewritten:%zu skipped:%zu invalid:%zu duplicate:%zu overflow:%zu\n",
+			num,image->stat.total,image->stat.accepted,image->stat.rewritten,image->stat.skipped,
+			image->stat.invalid,image->stat.duplicate,image->stat.overflow);
+	/// 任一数据源失败时保留原有的记录
+	if(err<0)
+		error_at_line(0,-err,__FILE__,__LINE__,"build %s keeps the old records",g_domain_type[type]);
+out:
+	free(srcs);
+	if(err<0)
+		clean_build_image(image);
+	return err;
 }
 
 /// @brief 重建bc_domain数据库中数据
+/// 	各数据源合并去重为一个镜像,远程数据源同时下载,全部读取成功后独占db写入
 static int build_bc_domain_db(const struct argument *argu,struct bc_domain_db *db)
 {
 	enum domain_type type=argu->argu.dbfile.type;
 	if(check_type(type)!=1)
 		return -EINVAL;
-	DEBUG_PRINT(0,"build db for %s,%s",
-			argu->argu.dbfile.path,g_domain_type[type]);
-	/// 依据path/url获取fp
-	FILE *fp=domain_file_open(argu->argu.dbfile.path);
-	if(NULL==fp)
+	struct build_image image;
+	size_t i=0;
+	int err=0;
+	if((err=read_build_image(argu,db,&image))<0)
+		return err;
+	/// 下载期间不阻塞其他写进程,写入镜像时独占db
+	if((err=lock_bc_domain_db(db,true))<0)
+		goto out;
+	size_t old_len=db->domain_names.domain_type_len[type];
+	const char *name=image.pool;
+	db->domain_names.domain_type_len[type]=0;
+	for(i=0;i<image.num;i++,name+=strlen(name)+1)
 	{
-		error_at_line(0,errno,__FILE__,__LINE__,"open %s failed",argu->argu.dbfile.path);
-		return -errno;
+		struct domain_name record;
+		size_t index=db->domain_names.domain_type_len[type];
+		memset(&record,0,sizeof(record));
+		record.is_vaild=true;
+		strcpy(record.name,name);
+		db->domain_names.domain_type_len[type]++;
+		if((err=set_domain_name(&record,db,type,index))<0)
+		{
+			db->domain_names.domain_type_len[type]--;
+			DEBUG_PRINT(-err,"set domain name %s in %zu error",record.name,index);
+			err=0;
+		}
 	}
-	/// 重置bc_domain_names
-	db->domain_names.domain_type_len[type]=0;
-	/// 读取文件重建db
+	/// 清除旧的多余记录,之后并行写入的进程预留记录时不会读到
+	if(old_len>db->domain_names.domain_type_len[type])
+		err=clear_domain_names(db,type,db->domain_names.domain_type_len[type],old_len);
+	/// 编译最小完美哈希索引,按槽重排并保存bc_domain_name
+	if(err>=0&&(err=compile_domain_mph(db,type))<0)
+		DEBUG_PRINT(-err,"compile domain mph error");
+out:
+	clean_build_image(&image);
+	return err;
+}
+
+/// @brief 将type类别同步为各数据源的内容,只增删不同的域名
+/// 	差异作为一批修改日志发布,内核一次应用;差异超过日志容量,
+/// 	整理了类别或改变了通配规则时重新编译各索引并完全重建
+/// @retval 成功0 失败错误代码负值,数据源读取失败时保留原有的记录
+static int sync_bc_domain_db(const struct argument *argu,struct bc_domain_db *db)
+{
+	enum domain_type type=argu->argu.dbfile.type;
+	if(check_type(type)!=1)
+		return -EINVAL;
+	struct build_image image;
+	struct domain_set live;
+	struct domain_journal_entry *entries=NULL;
+	struct domain_iter it;
+	const struct domain_name *n=NULL;
+	const char *name=NULL;
+	size_t changes=0;
+	size_t added=0;
+	size_t deleted=0;
+	size_t index=0;
+	size_t i=0;
+	bool is_update=false;
+	bool is_glob=false;
+	int ret=0;
+	int err=0;
+	if((err=read_build_image(argu,db,&image))<0)
+		return err;
+	memset(&live,0,sizeof(live));
+	if((entries=(struct domain_journal_entry*)calloc(DOMAIN_JOURNAL_SIZE,sizeof(*entries)))==NULL)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	if((err=lock_bc_domain_db(db,true))<0)
+		goto out;
+	if((err=init_domain_set(&live,db->domain_names.domain_type_len[type]+image.num))<0)
+		goto unlock;
+	/// 删除不在数据源中的域名和重复的有效记录
+	if((err=domain_iter_init(&it,db,type))<0)
+		goto unlock;
+	while((n=domain_iter_next(&it,&index))!=NULL)
+	{
+		struct domain_name record;
+		size_t len=0;
+		if(!n->is_vaild)
+			continue;
+		len=strlen(n->name);
+		if((ret=domain_set_insert(&live,n->name,len))>0)
+			ret=domain_set_insert(&image.set,n->name,len);
+		else if(0==ret)
+			ret=1;
+		if(ret<0)
+		{
+			err=ret;
+			goto unlock;
+		}
+		if(0==ret)
+			continue;
+		memcpy(&record,n,sizeof(record));
+		record.is_vaild=false;
+		if((err=set_domain_name(&record,db,type,index))<0)
+		{
+			DEBUG_PRINT(-err,"del domain %s in %zu error",record.name,index);
+			goto unlock;
+		}
+		if(is_domain_glob(record.name))
+			is_glob=true;
+		if(changes<DOMAIN_JOURNAL_SIZE)
+		{
+			entries[changes].op=DOMAIN_JOURNAL_DEL;
+			entries[changes].type=type;
+			entries[changes].index=index;
+		}
+		changes++;
+		deleted++;
+	}
+	if((err=it.err)<0)
+		goto unlock;
+	/// 追加新的域名,类别已满时整理后重试,记录的位置改变后只能完全重建
+	for(i=0,name=image.pool;i<image.num;i++,name+=strlen(name)+1)
+	{
+		struct domain_name record;
+		if((ret=domain_set_insert(&live,name,strlen(name)))<0)
+		{
+			err=ret;
+			goto unlock;
+		}
+		if(0==ret)
+			continue;
+		if(-ENOSPC==(err=reserve_domain_name(db,type,&index)))
+		{
+			defrag_mentation(db,type);
+			is_update=true;
+			err=reserve_domain_name(db,type,&index);
+		}
+		if(err<0)
+		{
+			DEBUG_PRINT(-err,"reserve record in type(%d) error",type);
+			goto unlock;
+		}
+		memset(&record,0,sizeof(record));
+		record.is_vaild=true;
+		strcpy(record.name,name);
+		if((err=publish_domain_name(&record,db,type,index))<0)
+		{
+			DEBUG_PRINT(-err,"write %s into index(%zu) error",record.name,index);
+			goto unlock;
+		}
+		if(is_domain_glob(record.name))
+			is_glob=true;
+		if(changes<DOMAIN_JOURNAL_SIZE)
+		{
+			entries[changes].op=DOMAIN_JOURNAL_ADD;
+			entries[changes].type=type;
+			entries[changes].index=index;
+		}
+		changes++;
+		added++;
+	}
+	/// 提交
+	if(changes>DOMAIN_JOURNAL_SIZE)
+	{
+		if((err=compile_domain_mph(db,type))<0)
+			DEBUG_PRINT(-err,"compile domain mph error");
+		is_update=true;
+	}
+	else if(is_glob)
+	{
+		compile_domain_glob(db,type);
+		is_update=true;
+	}
+	if(err>=0&&!is_update&&append_domain_journals(db,entries,changes)<0)
+		is_update=true;
+	if(err>=0&&is_update&&(err=set_update_domain_db(db,true))<0)
+		error_at_line(0,-err,__FILE__,__LINE__,"set update domain error");
+unlock:
+	unlock_bc_domain_db(db);
+	DB_PRINT("sync %s: added:%zu deleted:%zu%s\n",g_domain_type[type],added,deleted,
+			is_update?" rebuild":"");
+out:
+	free(entries);
+	clean_domain_set(&live);
+	clean_build_image(&image);
+	return err;
+}
+
+/// 最后一次修改后等待多久再同步,合并连续的写入
+#define WATCH_DEBOUNCE_MS 100
+/// 第一次修改后最多等待多久同步,持续写入时也不会一直推迟
+#define WATCH_MAX_DELAY_MS 500
+/// 读取inotify事件的缓冲区大小
+#define WATCH_EVENT_BUF 4096
+
+/// --watch监视的一个类别
+struct watch_category
+{
+	struct argument argu;                 ///< 数据源和类别,与--build相同
+	int wd[MAX_BUILD_SOURCES];            ///< 各数据源所在目录的监视描述符
+	const char *base[MAX_BUILD_SOURCES];  ///< 各数据源的文件名
+	bool is_dirty;                        ///< 是否有未同步的修改
+	long long first_ms;                   ///< 第一次未同步修改的时间
+	long long last_ms;                    ///< 最后一次修改的时间
+};
+
+/// @brief 单调时钟的毫秒数
+static long long watch_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (long long)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+/// @brief 解析清单文件,每行 path[,path...],type ,与--build的参数相同,'#'后为注释
+/// @param[out] cats 各类别,每个类别至多一行
+/// @retval 成功返回类别个数 失败错误代码负值
+static int parse_watch_manifest(const char *path,struct watch_category *cats)
+{
+	FILE *fp=NULL;
 	char *line=NULL;
-	size_t n=0;
+	size_t cap=0;
+	size_t lineno=0;
+	ssize_t len=0;
+	int num=0;
 	int err=0;
-	while(getline(&line,&n,fp)!=-1)
+	if((fp=fopen(path,"r"))==NULL)
 	{
-		size_t index=db->domain_names.domain_type_len[type]++;
-		if(index>=db->domain_names.domain_type_max_len[type])
+		err=-errno;
+		error_at_line(0,-err,__FILE__,__LINE__,"open manifest %s failed",path);
+		return err;
+	}
+	while(err>=0&&(len=getline(&line,&cap,fp))>=0)
+	{
+		struct watch_category *cat=cats+num;
+		char *p=line;
+		char *end=NULL;
+		size_t i=0;
+		int j=0;
+		lineno++;
+		if((end=strchr(p,'#'))!=NULL)
+			*end='\0';
+		while(isspace((unsigned char)*p))
+			p++;
+		end=p+strlen(p);
+		while(end>p&&isspace((unsigned char)end[-1]))
+			*--end='\0';
+		if('\0'==*p)
+			continue;
+		if(num>=DOMAIN_TYPE_NUM)
 		{
-			DEBUG_PRINT(0,"domain in file is too max,MAX:",
-					db->domain_names.domain_type_max_len[type]);
-			err=-EFAULT;
+			err=-E2BIG;
+			error_at_line(0,E2BIG,__FILE__,__LINE__,"%s:%zu too many lines",path,lineno);
 			break;
 		}
-		/// 写入db
-		size_t len=strlen(line)-1;
-		struct domain_name name;
-		len=len>=DOMAIN_MAX_LENGTH-1?DOMAIN_MAX_LENGTH-1:len;
-		memcpy(name.name,line,len);
-		name.name[len]='\0';
-		name.is_vaild=true;
-		if((err=set_domain_name(&name,db,type,index))<0)
+		memset(cat,0,sizeof(*cat));
+		cat->argu.handle=BUILD_HANDLE;
+		if((err=parse_string(p,&cat->argu))<0)
 		{
-			db->domain_names.domain_type_len[type]--;
-			DEBUG_PRINT(-err,"set domain name %s in %d error",
-					name.name,index);
-			err=0;
-			continue;
+			error_at_line(0,-err,__FILE__,__LINE__,"%s:%zu parse error",path,lineno);
+			break;
+		}
+		for(j=0;j<num;j++)
+		{
+			if(cats[j].argu.argu.dbfile.type==cat->argu.argu.dbfile.type)
+				err=-EEXIST;
+		}
+		for(i=0;i<cat->argu.argu.dbfile.path_num&&err>=0;i++)
+		{
+			/// inotify只能监视本地文件
+			if(is_remote_source(cat->argu.argu.dbfile.path[i]))
+				err=-EINVAL;
 		}
+		if(err<0)
+		{
+			error_at_line(0,-err,__FILE__,__LINE__,"%s:%zu type repeated or url source",path,lineno);
+			break;
+		}
+		num++;
 	}
-	/// 保存bc_domain_name
-	if((err=save_bc_domain_names(db))<0)
-		DEBUG_PRINT(-err,"save bc_domain_names error");
-file_close:
-	if(NULL!=fp)
+	free(line);
+	fclose(fp);
+	return err<0?err:num;
+}
+
+/// @brief 对数据源所在的目录加监视,写入后关闭和移入的文件都会产生事件
+/// 	监视目录而不是文件,以改名方式原子替换的文件仍能被监视到
+/// @retval 成功0 失败错误代码负值
+static int add_watch_category(int fd,struct watch_category *cat)
+{
+	char dir[MAX_PATH];
+	size_t i=0;
+	int err=0;
+	for(i=0;i<cat->argu.argu.dbfile.path_num;i++)
 	{
-		fclose(fp);
-		fp=NULL;
+		const char *path=cat->argu.argu.dbfile.path[i];
+		const char *slash=strrchr(path,'/');
+		if(NULL==slash)
+		{
+			strcpy(dir,".");
+			cat->base[i]=path;
+		}
+		else
+		{
+			size_t len=slash==path?1:slash-path;
+			memcpy(dir,path,len);
+			dir[len]='\0';
+			cat->base[i]=slash+1;
+		}
+		if((cat->wd[i]=inotify_add_watch(fd,dir,IN_CLOSE_WRITE|IN_MOVED_TO))<0)
+		{
+			err=-errno;
+			error_at_line(0,-err,__FILE__,__LINE__,"watch %s failed",dir);
+			return err;
+		}
+		DEBUG_PRINT(0,"watch %s in %s for %s",cat->base[i],dir,
+				g_domain_type[cat->argu.argu.dbfile.type]);
 	}
+	return 0;
+}
+
+/// @brief 按一个inotify事件标记修改了的类别
+static void mark_watch_event(struct watch_category *cats,int num,
+		const struct inotify_event *event,long long now)
+{
+	size_t i=0;
+	int j=0;
+	for(j=0;j<num;j++)
+	{
+		struct watch_category *cat=cats+j;
+		bool hit=(event->mask&IN_Q_OVERFLOW)!=0;
+		for(i=0;i<cat->argu.argu.dbfile.path_num&&!hit;i++)
+		{
+			if(cat->wd[i]==event->wd&&event->len>0&&strcmp(cat->base[i],event->name)==0)
+				hit=true;
+		}
+		if(!hit)
+			continue;
+		if(!cat->is_dirty)
+			cat->first_ms=now;
+		cat->is_dirty=true;
+		cat->last_ms=now;
+	}
+}
+
+/// @brief 监视清单中的数据源,修改后将对应的类别同步为文件内容
+/// 	启动时先同步一次;空闲时阻塞在poll上,不占用CPU
+/// @retval 只在出错时返回错误代码负值
+static int watch_bc_domain_db(const struct argument *argu,struct bc_domain_db *db)
+{
+	static struct watch_category cats[DOMAIN_TYPE_NUM];
+	static char buf[WATCH_EVENT_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd pfd;
+	long long now=0;
+	int num=0;
+	int fd=-1;
+	int err=0;
+	int i=0;
+	if((num=parse_watch_manifest(argu->argu.watch.manifest,cats))<0)
+		return num;
+	if((fd=inotify_init1(IN_CLOEXEC))<0)
+	{
+		err=-errno;
+		error_at_line(0,-err,__FILE__,__LINE__,"inotify init error");
+		return err;
+	}
+	for(i=0;i<num;i++)
+	{
+		if((err=add_watch_category(fd,cats+i))<0)
+			goto out;
+		cats[i].is_dirty=true;
+	}
+	pfd.fd=fd;
+	pfd.events=POLLIN;
+	while(true)
+	{
+		int timeout=-1;
+		ssize_t len=0;
+		char *p=NULL;
+		/// 同步已到期的类别,计算下一个到期时间
+		now=watch_now_ms();
+		for(i=0;i<num;i++)
+		{
+			long long due=0;
+			if(!cats[i].is_dirty)
+				continue;
+			due=cats[i].last_ms+WATCH_DEBOUNCE_MS;
+			if(due>cats[i].first_ms+WATCH_MAX_DELAY_MS)
+				due=cats[i].first_ms+WATCH_MAX_DELAY_MS;
+			if(due>now)
+			{
+				if(timeout<0||due-now<timeout)
+					timeout=due-now;
+				continue;
+			}
+			cats[i].is_dirty=false;
+			/// 失败时已输出错误并保留原有记录,等待下一次修改
+			if((err=sync_bc_domain_db(&cats[i].argu,db))<0)
+				DEBUG_PRINT(-err,"sync %s error",g_domain_type[cats[i].argu.argu.dbfile.type]);
+			fflush(stdout);
+		}
+		if(poll(&pfd,1,timeout)<0)
+		{
+			if(EINTR==errno)
+				continue;
+			err=-errno;
+			error_at_line(0,-err,__FILE__,__LINE__,"poll inotify error");
+			goto out;
+		}
+		if(!(pfd.revents&POLLIN))
+			continue;
+		if((len=read(fd,buf,sizeof(buf)))<0)
+		{
+			if(EINTR==errno||EAGAIN==errno)
+				continue;
+			err=-errno;
+			error_at_line(0,-err,__FILE__,__LINE__,"read inotify error");
+			goto out;
+		}
+		now=watch_now_ms();
+		for(p=buf;p<buf+len;p+=sizeof(struct inotify_event)+((struct inotify_event*)p)->len)
+			mark_watch_event(cats,num,(const struct inotify_event*)p,now);
+	}
+out:
+	close(fd);
 	return err;
 }
 
@@ -502,11 +1582,13 @@ static int clean_bc_domain_db(const struct argument *argu,struct bc_domain_db *d
 		return -EINVAL;
 	DEBUG_PRINT(0,"read db for %s",
 			g_domain_type[type]);
-	/// 清除type数据库
+	/// 清除type数据库及其最小完美哈希索引
+	int err=0;
+	if((err=clear_domain_names(db,type,0,db->domain_names.domain_type_len[type]))<0)
+		DEBUG_PRINT(-err,"clear domain names error");
 	db->domain_names.domain_type_len[type]=0;
 	/// 保存
-	int err=0;
-	if((err=save_bc_domain_names(db))<0)
+	if((err=compile_domain_mph(db,type))<0)
 		DEBUG_PRINT(-err,"save bc_domain_names error");
 	return err;
 }
@@ -519,48 +1601,346 @@ static int read_bc_domain_db(const struct argument *argu,struct bc_domain_db *db
 		return -EINVAL;
 	DEBUG_PRINT(0,"read db for %s",
 			g_domain_type[type]);
-	/// 获取数据数目
+	/// 遍历记录
+	struct domain_iter it;
+	const struct domain_name *name=NULL;
+	size_t i=0;
+	size_t sum=0;
 	int err=0;
-	int i=0;
-	size_t sum=get_domain_name_num(db,type);
-	for(i=0;i<sum;++i)
+	if((err=domain_iter_init(&it,db,type))<0)
+		return err;
+	print_domain_begin(type);
+	while((name=domain_iter_next(&it,&i))!=NULL)
 	{
-		struct domain_name name;
-		if((err=get_domain_name(&name,db,type,i))<0)
+		if(TEXT_FORMAT==g_argu.format)
+			DB_PRINT("%zu %s %s\n",i,name->name,
+					name->is_vaild?"valid":"no_valid");
+		else
+			print_domain(name,i,sum);
+		sum++;
+	}
+	if(TEXT_FORMAT==g_argu.format)
+		DB_PRINT("-------------------\ntotal:%zu\n",sum);
+	print_domain_end(sum);
+	return it.err;
+}
+
+/// 一条记录的命中次数
+struct domain_hit
+{
+	size_t index;            ///< 记录下标
+	unsigned long count;     ///< 命中次数
+};
+
+/// @brief 按命中次数从高到低排序,次数相同时按下标
+static int domain_hit_cmp(const void *a,const void *b)
+{
+	const struct domain_hit *x=(const struct domain_hit*)a;
+	const struct domain_hit *y=(const struct domain_hit*)b;
+	if(x->count!=y->count)
+		return x->count<y->count?1:-1;
+	return x->index<y->index?-1:x->index>y->index;
+}
+
+/// @brief 从HITS_PROC_PATH读取type类别的命中次数
+/// @param[out] hits 按记录下标存放,大小为max_len
+/// @param[out] glob 通配规则的命中次数
+/// @retval 成功0 失败错误代码负值
+static int read_domain_hits(enum domain_type type,unsigned long *hits,size_t max_len,unsigned long *glob)
+{
+	FILE *fp=fopen(HITS_PROC_PATH,"r");
+	char index[32];
+	unsigned long count=0;
+	int t=0;
+	if(NULL==fp)
+	{
+		error_at_line(0,errno,__FILE__,__LINE__,"open %s failed,is the module loaded?",HITS_PROC_PATH);
+		return -errno;
+	}
+	while(fscanf(fp,"%d %31s %lu",&t,index,&count)==3)
+	{
+		char *end=NULL;
+		size_t i=0;
+		if(t!=type)
+			continue;
+		if(strcmp(index,"glob")==0)
 		{
-			DEBUG_PRINT(-err,"read domain %d of %s error",
-					i,g_domain_type[type]);
+			*glob=count;
+			continue;
+		}
+		i=strtoul(index,&end,10);
+		if('\0'==*end&&i<max_len)
+			hits[i]=count;
+	}
+	fclose(fp);
+	return 0;
+}
+
+/// @brief 清零type类别的命中次数
+/// @retval 成功0 失败错误代码负值
+static int reset_domain_hits(enum domain_type type)
+{
+	FILE *fp=fopen(HITS_PROC_PATH,"w");
+	int err=0;
+	if(NULL==fp)
+		return -errno;
+	if(fprintf(fp,"%d\n",type)<0)
+		err=-EIO;
+	if(fclose(fp)!=0&&0==err)
+		err=-errno;
+	return err;
+}
+
+/// @brief 按命中次数从高到低输出type类别的有效域名,从未命中的记录排在最后
+/// 	计数为每个cpu的近似值,发布或整理后清零
+static int hits_bc_domain(const struct argument *argu,struct bc_domain_db *db)
+{
+	enum domain_type type=argu->argu.domain.type;
+	if(check_type(type)!=1)
+		return -EINVAL;
+	DEBUG_PRINT(0,"hits for %s",g_domain_type[type]);
+	size_t max_len=db->domain_names.domain_type_max_len[type];
+	unsigned long *hits=(unsigned long*)calloc(max_len+1,sizeof(unsigned long));
+	struct domain_hit *order=(struct domain_hit*)calloc(max_len+1,sizeof(struct domain_hit));
+	struct domain_iter it;
+	const struct domain_name *name=NULL;
+	unsigned long glob=0;
+	size_t i=0;
+	size_t n=0;
+	size_t dead=0;
+	int err=0;
+	if(NULL==hits||NULL==order)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	if((err=read_domain_hits(type,hits,max_len,&glob))<0)
+		goto out;
+	/// 只统计有效的字面域名,通配规则编译为一个自动机,只有合计的次数
+	if((err=domain_iter_init(&it,db,type))<0)
+		goto out;
+	while((name=domain_iter_next(&it,&i))!=NULL)
+	{
+		if(!name->is_vaild||is_domain_glob(name->name))
+			continue;
+		order[n].index=i;
+		order[n].count=hits[i];
+		if(0==hits[i])
+			dead++;
+		n++;
+	}
+	if((err=it.err)<0)
+		goto out;
+	qsort(order,n,sizeof(struct domain_hit),domain_hit_cmp);
+	if(TSV_FORMAT==g_argu.format)
+		DB_PRINT("hits\tindex\tname\n");
+	else if(JSON_FORMAT==g_argu.format)
+		DB_PRINT("{\"type\":\"%s\",\"domains\":[",g_domain_type[type]);
+	for(i=0;i<n;i++)
+	{
+		struct domain_name cur;
+		if((err=get_domain_name(&cur,db,type,order[i].index))<0)
+			goto out;
+		if(TEXT_FORMAT==g_argu.format)
+			DB_PRINT("%lu %zu %s\n",order[i].count,order[i].index,cur.name);
+		else if(TSV_FORMAT==g_argu.format)
+			DB_PRINT("%lu\t%zu\t%s\n",order[i].count,order[i].index,cur.name);
+		else
+		{
+			DB_PRINT("%s{\"hits\":%lu,\"index\":%zu,\"name\":",i>0?",":"",
+					order[i].count,order[i].index);
+			print_json_string(cur.name);
+			DB_PRINT("}");
+		}
+	}
+	if(TEXT_FORMAT==g_argu.format)
+		DB_PRINT("-------------------\ntotal:%zu never_hit:%zu glob_hits:%lu\n",n,dead,glob);
+	else if(JSON_FORMAT==g_argu.format)
+		DB_PRINT("],\"total\":%zu,\"never_hit\":%zu,\"glob_hits\":%lu}\n",n,dead,glob);
+	/// 输出后清零,下一个统计周期重新计数
+	if(argu->is_reset&&(err=reset_domain_hits(type))<0)
+		error_at_line(0,-err,__FILE__,__LINE__,"reset hits of %s error",g_domain_type[type]);
+out:
+	free(hits);
+	free(order);
+	return err;
+}
+
+/// @brief 清零type类别的未匹配域名统计
+/// @retval 成功0 失败错误代码负值
+static int reset_domain_misses(enum domain_type type)
+{
+	FILE *fp=fopen(MISSES_PROC_PATH,"w");
+	int err=0;
+	if(NULL==fp)
+		return -errno;
+	if(fprintf(fp,"%d\n",type)<0)
+		err=-EIO;
+	if(fclose(fp)!=0&&0==err)
+		err=-errno;
+	return err;
+}
+
+/// @brief 按次数从高到低输出type类别中查询最多的未匹配域名
+/// 	次数为各cpu的Space-Saving统计合并的近似值,真实次数与其之差不超过误差
+static int misses_bc_domain(const struct argument *argu,struct bc_domain_db *db)
+{
+	enum domain_type type=argu->argu.domain.type;
+	if(check_type(type)!=1)
+		return -EINVAL;
+	DEBUG_PRINT(0,"misses for %s",g_domain_type[type]);
+	FILE *fp=fopen(MISSES_PROC_PATH,"r");
+	char name[DOMAIN_MAX_LENGTH+1];
+	unsigned long count=0;
+	unsigned long error=0;
+	size_t n=0;
+	size_t listed=0;
+	int t=0;
+	int err=0;
+	if(NULL==fp)
+	{
+		err=-errno;
+		error_at_line(0,-err,__FILE__,__LINE__,"open %s failed,is the module loaded?",MISSES_PROC_PATH);
+		return err;
+	}
+	if(TSV_FORMAT==g_argu.format)
+		DB_PRINT("misses\terror\tlisted\tname\n");
+	else if(JSON_FORMAT==g_argu.format)
+		DB_PRINT("{\"type\":\"%s\",\"domains\":[",g_domain_type[type]);
+	while(fscanf(fp,"%d %lu %lu %128s",&t,&count,&error,name)==4)
+	{
+		int is_listed=0;
+		if(t!=type)
 			continue;
+		/// 已在类别中的域名通常是内核尚未载入的新增域名
+		if((is_listed=find_bc_domain(db,type,name)))
+			listed++;
+		if(TEXT_FORMAT==g_argu.format)
+			DB_PRINT("%lu %lu %s%s\n",count,error,name,is_listed?" listed":"");
+		else if(TSV_FORMAT==g_argu.format)
+			DB_PRINT("%lu\t%lu\t%d\t%s\n",count,error,is_listed,name);
+		else
+		{
+			DB_PRINT("%s{\"misses\":%lu,\"error\":%lu,\"listed\":%s,\"name\":",n>0?",":"",
+					count,error,is_listed?"true":"false");
+			print_json_string(name);
+			DB_PRINT("}");
 		}
-		DB_PRINT("%d %s %s\n",i,name.name,
-				name.is_vaild?"valid":"no_valid");
+		n++;
+	}
+	fclose(fp);
+	if(TEXT_FORMAT==g_argu.format)
+		DB_PRINT("-------------------\ntotal:%zu listed:%zu\n",n,listed);
+	else if(JSON_FORMAT==g_argu.format)
+		DB_PRINT("],\"total\":%zu,\"listed\":%zu}\n",n,listed);
+	/// 输出后清零,下一个统计周期重新计数
+	if(argu->is_reset&&(err=reset_domain_misses(type))<0)
+		error_at_line(0,-err,__FILE__,__LINE__,"reset misses of %s error",g_domain_type[type]);
+	return err;
+}
+
+/// @brief 按有序索引查询type类别,前缀,区域,区间查询和导出共用
+/// 	从第一个不小于起点的域名开始顺序输出,越过终止条件后结束
+static int order_bc_domain(const struct argument *argu,struct bc_domain_db *db)
+{
+	enum domain_type type=argu->argu.order.type;
+	const char *from=argu->argu.order.from;
+	const char *to=argu->argu.order.to;
+	size_t plen=strlen(from);
+	struct domain_order_view view;
+	struct domain_order_cursor cur;
+	bool rev=false;
+	size_t count=0;
+	int index=0;
+	int err=0;
+	if(check_type(type)!=1)
+		return -EINVAL;
+	DEBUG_PRINT(0,"order query %s,%s for %s",from,to,g_domain_type[type]);
+	if((err=load_domain_order_view(&view,db,type))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"load domain order error");
+		return err;
 	}
-	DB_PRINT("-------------------\ntotal:%d\n",sum);
+	/// 区域查询和倒序导出按倒序域名
+	rev=UNDER_HANDLE==argu->handle||(EXPORT_HANDLE==argu->handle&&argu->argu.order.rev);
+	domain_order_seek(&cur,&view,rev,from);
+	print_domain_begin(type);
+	while((index=domain_order_next(&cur))>=0)
+	{
+		struct domain_name name;
+		const char *cur_name=cur.name;
+		if(PREFIX_HANDLE==argu->handle&&strncmp(cur_name,from,plen)!=0)
+			break;
+		if(RANGE_HANDLE==argu->handle&&strcmp(cur_name,to)>=0)
+			break;
+		if(UNDER_HANDLE==argu->handle)
+		{
+			/// 倒序相邻的域名以zone结尾,其中不以'.'分隔的不属于该区域
+			if(strlen(cur_name)<plen||strcmp(cur_name+strlen(cur_name)-plen,from)!=0)
+				break;
+			if(!domain_is_under(cur_name,from))
+				continue;
+		}
+		if(TEXT_FORMAT==g_argu.format)
+		{
+			if(EXPORT_HANDLE==argu->handle)
+				DB_PRINT("%s\n",cur_name);
+			else
+				DB_PRINT("%d %s\n",index,cur_name);
+		}
+		else
+		{
+			strcpy(name.name,cur_name);
+			name.is_vaild=true;
+			print_domain(&name,index,count);
+		}
+		count++;
+	}
+	if(TEXT_FORMAT==g_argu.format&&EXPORT_HANDLE!=argu->handle)
+		DB_PRINT("-------------------\ntotal:%zu\n",count);
+	print_domain_end(count);
+	clean_domain_order_view(&view);
 	return 0;
 }
 
 /// @brief 依据struct argument完成对bc_domain数据库的处理
 static int bc_domain_handle(const struct argument *argu,struct bc_domain_db *db)
 {
-	bool is_update=false;   ///< 是否设置db更新标志
+	bool is_update=false;   ///< 是否设置db更新标志,增删单个域名时只写修改日志
+	bool is_locked=false;
 	int err=0;
 	if(NULL==db||NULL==argu)
 		return -EINVAL;
+	/// 增删单个域名的进程之间可以并行,改写整个类别时独占db
+	switch(argu->handle)
+	{
+		case ADD_HANDLE:
+		case DEL_HANDLE:
+		case CLEAN_HANDLE:
+			if((err=lock_bc_domain_db(db,CLEAN_HANDLE==argu->handle))<0)
+				return err;
+			is_locked=true;
+			break;
+		case BUILD_HANDLE:
+			/// 读取数据源时不加锁,写入时独占
+			is_locked=true;
+			break;
+		default:
+			break;
+	}
 	switch(argu->handle)
 	{
 		case ADD_HANDLE:
 			DEBUG_PRINT(0,"begin add handle for %s,%s",
 					argu->argu.domain.name,
 					g_domain_type[argu->argu.domain.type]);
-			err=add_bc_domain(argu,db);
-			is_update=true;
+			err=add_bc_domain(argu,db,&is_update);
 			break;
 		case DEL_HANDLE:
 			DEBUG_PRINT(0,"begin del handle for %s,%s",
 					argu->argu.domain.name,
 					g_domain_type[argu->argu.domain.type]);
-			err=del_bc_domain(argu,db);
-			is_update=true;
+			err=del_bc_domain(argu,db,&is_update);
 			break;
 		case SEARCH_HANDLE:
 			DEBUG_PRINT(0,"begin search handle for %s,%s",
@@ -574,6 +1954,24 @@ static int bc_domain_handle(const struct argument *argu,struct bc_domain_db *db)
 			err=read_bc_domain_db(argu,db);
 			is_update=false;
 			break;
+		case HITS_HANDLE:
+			DEBUG_PRINT(0,"%s","begin hits handle");
+			err=hits_bc_domain(argu,db);
+			is_update=false;
+			break;
+		case MISSES_HANDLE:
+			DEBUG_PRINT(0,"%s","begin misses handle");
+			err=misses_bc_domain(argu,db);
+			is_update=false;
+			break;
+		case PREFIX_HANDLE:
+		case UNDER_HANDLE:
+		case RANGE_HANDLE:
+		case EXPORT_HANDLE:
+			DEBUG_PRINT(0,"%s","begin order handle");
+			err=order_bc_domain(argu,db);
+			is_update=false;
+			break;
 		case CLEAN_HANDLE:
 			DEBUG_PRINT(0,"%s","begin clean handle");
 			err=clean_bc_domain_db(argu,db);
@@ -581,42 +1979,70 @@ static int bc_domain_handle(const struct argument *argu,struct bc_domain_db *db)
 			break;
 		case BUILD_HANDLE:
 			DEBUG_PRINT(0,"begin build handle for %s,%s",
-					argu->argu.dbfile.path,
+					argu->argu.dbfile.path[0],
 					g_domain_type[argu->argu.dbfile.type]);
 			err=build_bc_domain_db(argu,db);
 			is_update=true;
 			break;
+		case WATCH_HANDLE:
+			/// 每次同步各自加锁并设置更新标志
+			DEBUG_PRINT(0,"begin watch handle for %s",argu->argu.watch.manifest);
+			err=watch_bc_domain_db(argu,db);
+			is_update=false;
+			break;
 		default:
 			fprintf(stderr,"cannot support current handle,and exit!\n");
 			err=-EINVAL;
 			break;
 	}
-	if(0!=err)
-		return err;
 	/// 设置更新标志
-	if(is_update)
+	if(0==err&&is_update)
 	{
 		if((err=set_update_domain_db(db,is_update))<0)
 			error_at_line(0,-err,__FILE__,__LINE__,"set update domain error");
 		DEBUG_PRINT(0,"set update flags");
 	}
+	if(is_locked)
+		unlock_bc_domain_db(db);
 	return err;
 }
 
 int main(int argc,char **argv)
 {
 	int err=0;
+#ifndef CGI
+	/// 全缓冲输出,大量记录时只受I/O限制
+	static char out_buf[OUTPUT_BUF_SIZE];
+	setvbuf(stdout,out_buf,_IOFBF,sizeof(out_buf));
+#endif
 	/// 初始化curl
 	curl_global_init(CURL_GLOBAL_ALL);
+	/// 解析命令行参数
+	parse_argument(argc,argv);
 	/// 载入冰川域名数据库
 	struct bc_domain_db db; 
-	if((load_bc_domain_db(PROC_PATH,&db))<0)
+	if(g_argu.is_init)
+	{
+		if('\0'==g_argu.db_path[0])
+		{
+			error_at_line(0,EINVAL,__FILE__,__LINE__,"--init needs --db path");
+			return EXIT_FAILURE;
+		}
+		if((err=create_bc_domain_db(g_argu.db_path,&db))<0)
+		{
+			error_at_line(0,-err,__FILE__,__LINE__,"bc_domain_db create error");
+			return EXIT_FAILURE;
+		}
+		DEBUG_PRINT(0,"create db %s",g_argu.db_path);
+		if(NUM_HANDLE==g_argu.handle)
+			return 0;
+	}
+	else if((err=load_bc_domain_db('\0'==g_argu.db_path[0]?
+					get_bc_domain_db_path():g_argu.db_path,&db))<0)
 	{
 		error_at_line(0,-err,__FILE__,__LINE__,"bc_domain_db load error");
-		return err;
+		return EXIT_FAILURE;
 	}
-	/// 解析命令行参数
-	parse_argument(argc,argv);
 	/// 处理结果
 	if((err=bc_domain_handle(&g_argu,&db))<0)
 		error_at_line(0,-err,__FILE__,__LINE__,"bc_domain_handle error");
@@ -17,10 +17,22 @@
 #include <stdbool.h>
 #include <bigmem.h>
 #endif
+#include "bc_domain_region.h"
 
 /// bigmem的内存proc映射
 #define PROC_NAME "bc_domain_mem"
 #define PROC_PATH "/proc/"PROC_NAME
+/// 各记录命中次数的proc文件,每行为"类别 记录下标 次数",通配规则的下标为glob,
+/// 写入类别编号时清零该类别的计数
+#define HITS_PROC_NAME "bc_domain_hits"
+#define HITS_PROC_PATH "/proc/"HITS_PROC_NAME
+/// 各类别查询最多的未匹配域名的proc文件,每行为"类别 次数 误差 域名",按次数从高到低,
+/// 写入类别编号时清零该类别的统计
+#define MISSES_PROC_NAME "bc_domain_misses"
+#define MISSES_PROC_PATH "/proc/"MISSES_PROC_NAME
+
+/// db头部的标识
+#define BC_DOMAIN_MAGIC 0x37646362
 
 /// 域名的最大长度
 #define DOMAIN_MAX_LENGTH 128
@@ -58,41 +70,325 @@ struct domain_name
 	char name[DOMAIN_MAX_LENGTH];  ///< 域名
 };
 
+/// 最小完美哈希每个桶平均的域名个数,位移为16位时约2.7bit/域名
+#define DOMAIN_MPH_LAMBDA 6
+
+/// 最小完美哈希索引(CHD),由用户程序在发布时编译,位于域名数组之后
+/// 类别的前slot_num条记录按槽排列,第i条记录即为落在槽i的域名
+struct domain_mph
+{
+	unsigned int seed;          ///< 哈希种子
+	unsigned int key_num;       ///< 编译时的有效域名个数
+	unsigned int slot_num;      ///< 槽个数,0表示没有索引
+	unsigned int bucket_num;    ///< 位移数组长度
+	unsigned short disp[];      ///< 各桶的位移
+};
+
+/// 容纳max_count个域名的最小完美哈希区大小
+#define DOMAIN_MPH_SIZE(max_count) ((sizeof(struct domain_mph)+\
+		((max_count)/DOMAIN_MPH_LAMBDA+1)*sizeof(unsigned short)+7)&~(size_t)7)
+
+/// 通配规则DFA的状态个数上限,包括拒绝状态0,常见的规则每条约占10个状态
+#define DOMAIN_GLOB_MAX_STATES 4096
+/// 字符类个数上限:字母,数字,'-','_','.'各一类,其余字符一类
+#define DOMAIN_GLOB_MAX_CLASSES 40
+/// 拒绝状态与初始状态
+#define DOMAIN_GLOB_DEAD 0
+#define DOMAIN_GLOB_START 1
+/// 转移表中目标状态为接受状态的标志
+#define DOMAIN_GLOB_ACCEPT 0x8000
+
+/// 通配规则编译成的DFA,由用户程序在发布时编译,位于最小完美哈希区之后
+struct domain_glob
+{
+	unsigned int rule_num;        ///< 编译的规则个数,0表示没有自动机
+	unsigned short state_num;     ///< 状态个数
+	unsigned short class_num;     ///< 字符类个数
+	unsigned char classes[256];   ///< 各字节所属的字符类,大写字母与小写字母同类
+	unsigned short trans[];       ///< 转移表trans[state*class_num+class],带DOMAIN_GLOB_ACCEPT标志
+};
+
+/// 通配规则区大小
+#define DOMAIN_GLOB_SIZE ((sizeof(struct domain_glob)+\
+		DOMAIN_GLOB_MAX_STATES*DOMAIN_GLOB_MAX_CLASSES*sizeof(unsigned short)+7)&~(size_t)7)
+
+/// 有序索引,用户程序在发布时建立,用于前缀,区间查询和有序导出
+/// 	items前count项为按域名排序的记录下标,后count项为按倒序域名排序的记录下标,
+/// 	均为Eytzinger(BFS)排列:第k项(从1开始)的子节点为2k和2k+1
+struct domain_order
+{
+	unsigned int num;         ///< 建立时的记录个数,之后追加的记录不在索引中
+	unsigned int count;       ///< 建立时的有效字面域名个数
+	unsigned int items[];     ///< 正序与倒序两个Eytzinger数组
+};
+
+/// 容纳max_count个域名的有序索引区大小
+#define DOMAIN_ORDER_SIZE(max_count) ((sizeof(struct domain_order)+\
+		2*(max_count)*sizeof(unsigned int)+7)&~(size_t)7)
+
+/// 压缩trie,用户程序在发布时对有效的字面域名建立,位于有序索引区之后
+/// 	域名按字符从后向前插入,同一区域下的域名共享路径,以LOUDS编码树形,
+/// 	没有分支的路径合并为一条边,边上第一个字符之后的字符保存在串池中,
+/// 	只剩一个域名的子树即为带尾串的叶节点,
+/// 	各部分在data中的字节偏移由节点,边串和域名个数算出
+struct domain_trie
+{
+	unsigned int key_num;       ///< 域名个数,0表示没有trie
+	unsigned int num;           ///< 建立时的记录个数,之后追加的记录不在trie中
+	unsigned int node_num;      ///< 节点个数,根为0号节点
+	unsigned int link_num;      ///< 入边多于一个字符的节点个数
+	unsigned int link_bytes;    ///< 串池的字节数,含各边串末尾的'\0'
+	unsigned int record_bits;   ///< 每个记录下标占用的位数
+	unsigned int louds;         ///< LOUDS位向量:各节点依次为子节点个数个1和一个0
+	unsigned int select;        ///< LOUDS中每DOMAIN_TRIE_SELECT_STEP个0的位置
+	unsigned int labels;        ///< 各节点入边上的第一个字符,兄弟节点按字符升序
+	unsigned int terminal;      ///< 节点是否为域名结尾的位向量及其秩目录
+	unsigned int link;          ///< 节点入边是否多于一个字符的位向量及其秩目录
+	unsigned int link_index;    ///< 每DOMAIN_TRIE_LINK_STEP个边串的起始偏移
+	unsigned int link_pool;     ///< 以'\0'分隔的边串,字符仍为从后向前的顺序
+	unsigned int records;       ///< 按结尾节点顺序排列的记录下标,每个占record_bits位
+	unsigned int size;          ///< data的字节数
+	unsigned int reserved;
+	unsigned long long data[];
+};
+
+/// 压缩trie区为每个域名预留的字节数,常见的域名列表每个域名约占10字节,
+/// 超出时不使用trie
+#define DOMAIN_TRIE_NAME_BYTES 48
+
+/// 容纳max_count个域名的压缩trie区大小
+#define DOMAIN_TRIE_SIZE(max_count) ((sizeof(struct domain_trie)+\
+		(max_count)*DOMAIN_TRIE_NAME_BYTES+1024+7)&~(size_t)7)
+
+/// 列区,各类别按列保存记录的有效位图,域名哈希值和域名长度,位于域名数组之后
+/// 	扫描记录时先读取列区判断有效性,并按长度和哈希值筛选,只对候选记录读取域名;
+/// 	各列依次为:有效位图(每个64位字对应64条记录),哈希数组,长度数组
+#define DOMAIN_VALID_WORDS(max_count) (((max_count)+63)/64)
+
+/// 容纳max_count个域名的列区大小
+#define DOMAIN_COLUMN_SIZE(max_count) ((DOMAIN_VALID_WORDS(max_count)*sizeof(unsigned long long)+\
+		(max_count)*(sizeof(unsigned int)+sizeof(unsigned char))+7)&~(size_t)7)
+
+/// 修改日志的记录个数,必须为2的幂,内核落后超过该个数时完全重建索引
+#define DOMAIN_JOURNAL_SIZE 1024
+
+/// 修改日志的操作
+enum domain_journal_op{DOMAIN_JOURNAL_ADD=1,   ///< 追加或改写记录
+	DOMAIN_JOURNAL_DEL                         ///< 记录置为无效
+};
+
+/// 修改日志的一条记录,序号为seq的记录位于环中seq%DOMAIN_JOURNAL_SIZE处
+struct domain_journal_entry
+{
+	unsigned long long seq;     ///< 序号,从1开始,0表示空
+	unsigned int index;         ///< 被修改的记录下标
+	unsigned char type;         ///< 域名类别
+	unsigned char op;           ///< enum domain_journal_op
+};
+
+/// 修改日志区大小
+#define DOMAIN_JOURNAL_AREA_SIZE (DOMAIN_JOURNAL_SIZE*sizeof(struct domain_journal_entry))
+
 /// 域名集 分类结构
 struct bc_domain_names
 {
+	unsigned int magic;                          ///< BC_DOMAIN_MAGIC
 	size_t domain_type_start[DOMAIN_TYPE_NUM];   ///< 各类 域名集合 起始索引
 	size_t domain_type_len[DOMAIN_TYPE_NUM];     ///< 各类 域名集合 的长度
 	size_t domain_type_max_len[DOMAIN_TYPE_NUM];  ///< 各类域名 集合最大长度
-	bool is_update;                               ///< 设置更新标识
+	size_t domain_column_start[DOMAIN_TYPE_NUM];  ///< 各类 列区 起始偏移
+	size_t domain_mph_start[DOMAIN_TYPE_NUM];     ///< 各类 最小完美哈希区 起始偏移
+	size_t domain_glob_start[DOMAIN_TYPE_NUM];    ///< 各类 通配规则区 起始偏移
+	size_t domain_order_start[DOMAIN_TYPE_NUM];   ///< 各类 有序索引区 起始偏移
+	size_t domain_trie_start[DOMAIN_TYPE_NUM];    ///< 各类 压缩trie区 起始偏移
+	bool is_update;                               ///< 设置更新标识,内核完全重建索引
+	unsigned long long journal_seq;               ///< 最后一条修改日志的序号,紧随is_update以便一次读取
+	size_t journal_start;                         ///< 修改日志区 起始偏移
+	unsigned long long journal_reserved;          ///< 写进程已预留的最大日志序号,不小于journal_seq
 	struct domain_name names[];     ///< 域名数组
 };
 
 /// 域名集 数据结构
+/// 	region.base非NULL时数据位于共享内存区,否则位于bigmem
 struct bc_domain_db
 {
 	struct bc_domain_names domain_names;  
 	struct big_mem mem;
+	struct domain_region region;
+#ifdef USER_SPACE
+	int lock_fd;                          ///< 写进程之间加文件锁的文件,-1表示不加锁
+#endif
 };
 
+/// db的存储方式
+enum domain_backend{DOMAIN_BACKEND_BIGMEM=0,   ///< bigmem,用户态经/dev/mem映射
+	DOMAIN_BACKEND_REGION                      ///< 模块自有的共享内存区,经字符设备映射
+};
+
+/// @brief 依据各类域名的最大个数设置布局
+/// @retval db所需的字节数
+size_t init_bc_domain_layout(struct bc_domain_names *names);
+
+/// @brief 依据头部计算db所需的字节数
+size_t get_bc_domain_db_size(const struct bc_domain_names *names);
+
+/// @brief 从db的存储中读取len字节
+/// @retval 成功0 失败错误代码负值
+int read_domain_db(struct bc_domain_db *db,size_t offset,void *buf,size_t len);
+
+/// @brief 向db的存储中写入len字节
+/// @retval 成功0 失败错误代码负值
+int write_domain_db(struct bc_domain_db *db,size_t offset,const void *buf,size_t len);
+
+/// @brief 返回db存储中[offset,offset+len)的直接指针
+/// @retval 存储为共享内存区时返回指针 否则返回NULL
+const void *get_domain_db_ptr(struct bc_domain_db *db,size_t offset,size_t len);
+
+/// get_domain_name_span在bigmem存储上每次读取的记录个数,约为一页
+#define DOMAIN_SPAN_SIZE 32
+
+/// @brief 返回type类别从index开始的一段连续记录
+/// 	存储为共享内存区时直接返回指向记录的指针,不复制;
+/// 	bigmem存储一次读取至多buf_num条记录到buf中并返回buf
+/// @param[in,out] num 输入为需要的记录个数,输出为返回的记录个数
+/// @retval 记录指针 越界或出错返回NULL
+const struct domain_name *get_domain_name_span(struct bc_domain_db *db,enum domain_type type,
+		size_t index,size_t *num,struct domain_name *buf,size_t buf_num);
+
+/// @brief 返回type类别下标为index的记录,共享内存区中不复制,bigmem存储读取到buf中
+/// @retval 记录指针 越界或出错返回NULL
+static inline const struct domain_name *get_domain_name_ref(struct bc_domain_db *db,
+		enum domain_type type,size_t index,struct domain_name *buf)
+{
+	size_t num=1;
+	return get_domain_name_span(db,type,index,&num,buf,1);
+}
+
+/// get_domain_columns每次返回的记录个数,64的倍数
+#define DOMAIN_COLUMN_BATCH 512
+
+/// 一段记录的列,共享内存区中直接指向列区,否则指向各缓冲区
+struct domain_columns
+{
+	size_t start;                      ///< 第一条记录的下标,64的倍数
+	size_t num;                        ///< 记录个数
+	const unsigned long long *valid;   ///< 有效位图,第i位对应记录start+i
+	const unsigned int *hash;          ///< 域名的domain_name_hash
+	const unsigned char *len;          ///< 域名长度,空记录为0
+	unsigned long long valid_buf[DOMAIN_COLUMN_BATCH/64];
+	unsigned int hash_buf[DOMAIN_COLUMN_BATCH];
+	unsigned char len_buf[DOMAIN_COLUMN_BATCH];
+};
+
+/// @brief 计算列区中保存的域名哈希值,忽略ASCII大小写
+unsigned int domain_name_hash(const char *name,size_t len);
+
+/// @brief 读取type类别从start开始至多DOMAIN_COLUMN_BATCH条记录的列
+/// @param[in] start 64的倍数
+/// @retval 成功返回记录个数,越界返回0 失败错误代码负值
+int get_domain_columns(struct domain_columns *cols,struct bc_domain_db *db,
+		enum domain_type type,size_t start);
+
+/// @brief 列中下标为index的记录是否有效
+static inline bool domain_column_valid(const struct domain_columns *cols,size_t index)
+{
+	size_t i=index-cols->start;
+	return (cols->valid[i/64]>>(i%64))&1;
+}
+
 #ifndef USER_SPACE
 
 /// @brief 内核函数，初始化bc_domain_db
-int init_bc_domain_db(struct bc_domain_db *db);
+int init_bc_domain_db(struct bc_domain_db *db,enum domain_backend backend);
 /// @brief 内核函数, 清除bc_domain_db，并释放内存
 int clean_bc_domain_db(struct bc_domain_db *db);
 
 #else   ///USE_SPACE
 
 /// @brief 用户函数,从文件中反序列化db结构
+/// 	path为字符设备或非空的普通文件时直接映射共享内存区,否则按bigmem描述载入
 int load_bc_domain_db(const char *path,struct bc_domain_db *db);
 void unload_bc_domain_db(struct bc_domain_db *db);
+/// @brief 用户函数,创建与模块布局相同的空db,用于没有模块时的测试
+/// @param[in] path 为NULL时使用memfd,否则为共享文件(如/dev/shm下的文件)
+int create_bc_domain_db(const char *path,struct bc_domain_db *db);
+/// @brief 用户函数,返回默认的db路径,模块提供字符设备时优先使用
+const char *get_bc_domain_db_path(void);
 /// @breif 整理数据结构中的内存，避免碎片
 void defrag_mentation(struct bc_domain_db *db,enum domain_type type);
 
+/// @brief 用户函数,对db加文件锁并重新读取头部
+/// 	增删单个域名的写进程共享加锁,经原子操作预留记录和日志序号,可以并行执行;
+/// 	重建,清空,整理等改写整个类别的操作独占加锁.bigmem存储总是独占加锁
+/// @retval 成功0 失败错误代码负值
+int lock_bc_domain_db(struct bc_domain_db *db,bool exclusive);
+/// @brief 用户函数,释放文件锁
+void unlock_bc_domain_db(struct bc_domain_db *db);
+
+/// @brief 用户函数,预留type类别末尾的一条记录
+/// 	共享内存区中以原子操作增加头部的记录个数,并行的写进程得到不同的下标;
+/// 	预留的记录在发布前为无效记录,内核和其他进程读到时跳过
+/// @param[out] index 预留的记录下标
+/// @retval 成功0 类别已满返回-ENOSPC 失败错误代码负值
+int reserve_domain_name(struct bc_domain_db *db,enum domain_type type,size_t *index);
+
+/// @brief 用户函数,写入预留的记录并发布
+/// 	先写入置为无效的记录,再以release语义写入有效标识,读到有效标识时域名已完整
+/// @retval 成功0 失败错误代码负值
+int publish_domain_name(const struct domain_name *name,struct bc_domain_db *db,
+		enum domain_type type,size_t index);
+
+/// @brief 用户函数,将type类别[from,to)的记录清零
+/// 	缩短类别后调用,之后预留的记录在发布前不会读到旧的有效域名
+/// @retval 成功0 失败错误代码负值
+int clear_domain_names(struct bc_domain_db *db,enum domain_type type,size_t from,size_t to);
+
+/// 迭代器每批读取的记录个数
+#define DOMAIN_ITER_BATCH 256
+
+/// 域名记录迭代器,按批读取记录,逐条返回指向记录的指针
+struct domain_iter
+{
+	struct bc_domain_db *db;
+	enum domain_type type;
+	size_t index;        ///< 下一条记录的下标
+	size_t end;          ///< 迭代结束的下标
+	size_t batch_start;  ///< 当前批第一条记录的下标
+	size_t batch_len;    ///< 当前批的记录个数
+	const struct domain_name *span;  ///< 当前批,共享内存区中直接指向记录,否则指向batch
+	int err;             ///< 读取出错时的错误代码负值
+	struct domain_name batch[DOMAIN_ITER_BATCH];
+};
+
+/// @brief 初始化迭代器,遍历type类别的全部记录
+/// @retval 成功0 失败错误代码负值
+int domain_iter_init(struct domain_iter *it,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 返回下一条记录,指针在下一次调用前有效
+/// @param[out] index 记录下标,可为NULL
+/// @retval 记录指针 结束或出错返回NULL,出错时it->err为错误代码负值
+const struct domain_name *domain_iter_next(struct domain_iter *it,size_t *index);
+
+/// @brief 用户函数,向修改日志追加一条记录并发布新的序号
+/// 	须在记录本身和头部写入之后调用,内核依据日志增量更新索引.
+/// 	并行的写进程原子地预留序号,按序号顺序发布
+/// @retval 成功0 等待之前的写进程超时或序号已被跳过时返回-EAGAIN,须完全重建 失败错误代码负值
+int append_domain_journal(struct bc_domain_db *db,enum domain_journal_op op,
+		enum domain_type type,size_t index);
+
+/// @brief 用户函数,向修改日志追加一批记录,作为一次修改发布
+/// 	entries的op,type和index由调用者填写,seq在追加时填写;
+/// 	内核一次应用到发布的序号,不会只看到其中一部分
+/// @retval 成功0 超过日志容量返回-E2BIG,须完全重建 其余同append_domain_journal
+int append_domain_journals(struct bc_domain_db *db,struct domain_journal_entry *entries,size_t num);
 
 #endif  /// USER_SPACE
 
+/// @brief 读取序号为seq的修改日志
+/// @retval 成功0 失败错误代码负值,记录已被覆盖时entry->seq与seq不同
+int read_domain_journal(struct bc_domain_db *db,unsigned long long seq,
+		struct domain_journal_entry *entry);
+
 /// @brief 设置更新标识
 int set_update_domain_db(struct bc_domain_db *db,bool isupdate);
 
@@ -107,9 +403,45 @@ int get_domain_name(struct domain_name *name,struct bc_domain_db *db,enum domain
 /// @retval 成功0 失败错误代码的负值
 int set_domain_name(const struct domain_name *name,struct bc_domain_db *db,enum domain_type type,size_t index);
 
-/// @briefe 保存bc_domain_names结构
-/// @retval 成功返回0 失败返回错误代码负值
-int save_bc_domain_names(struct bc_domain_db *db);
+/// @brief 读取type类别的最小完美哈希索引
+/// @param[in] size mph缓冲区大小
+/// @retval 成功0 失败错误代码的负值
+int get_domain_mph(struct domain_mph *mph,size_t size,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 写入type类别的最小完美哈希索引
+/// @retval 成功0 失败错误代码的负值
+int set_domain_mph(const struct domain_mph *mph,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 读取type类别的通配规则DFA
+/// @param[in] size glob缓冲区大小
+/// @retval 成功0 失败错误代码的负值,失败时glob->rule_num为0
+int get_domain_glob(struct domain_glob *glob,size_t size,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 读取type类别的通配规则DFA所需的缓冲区大小
+/// @retval 有规则时返回DFA的字节数 没有规则或DFA无效返回0
+size_t get_domain_glob_size(struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 写入type类别的通配规则DFA
+/// @retval 成功0 失败错误代码的负值
+int set_domain_glob(const struct domain_glob *glob,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 读取type类别的有序索引
+/// @param[in] size order缓冲区大小
+/// @retval 成功0 失败错误代码的负值,失败时order->count为0
+int get_domain_order(struct domain_order *order,size_t size,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 写入type类别的有序索引
+/// @retval 成功0 失败错误代码的负值
+int set_domain_order(const struct domain_order *order,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 读取type类别的压缩trie
+/// @param[in] size trie缓冲区大小
+/// @retval 成功0 失败错误代码的负值,失败时trie->key_num为0
+int get_domain_trie(struct domain_trie *trie,size_t size,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 写入type类别的压缩trie
+/// @retval 成功0 失败错误代码的负值
+int set_domain_trie(const struct domain_trie *trie,struct bc_domain_db *db,enum domain_type type);
 
 /// @briefe 保存bc_domain_names结构
 /// @retval 成功返回0 失败返回错误代码负值
@@ -0,0 +1,246 @@
+/*
+ * @file bc_domain_normalize.c
+ * @breif 域名入库前的规范化处理
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <idn2.h>
+
+#include "bc_domain_normalize.h"
+
+/// 域名总长度上限(RFC1035,不含根点)
+#define DOMAIN_NAME_LIMIT 253
+/// 标签长度上限
+#define DOMAIN_LABEL_LIMIT 63
+
+/// @brief 是否为空白字符
+static inline bool is_blank(char c)
+{
+	return ' '==c||'\t'==c||'\r'==c||'\n'==c||'\v'==c||'\f'==c;
+}
+
+/// @brief 校验规范化后的域名,'*'和'?'作为通配字符出现在标签中
+/// @retval 合法1 非法0
+static int check_domain(const char *name,size_t len)
+{
+	size_t i=0;
+	size_t label=0;   ///< 当前标签长度
+	if(0==len||len>DOMAIN_NAME_LIMIT||len>=DOMAIN_MAX_LENGTH)
+		return 0;
+	for(i=0;i<len;i++)
+	{
+		char c=name[i];
+		if('.'==c)
+		{
+			/// 空标签,或标签以'-'结尾
+			if(0==label||'-'==name[i-1])
+				return 0;
+			label=0;
+			continue;
+		}
+		if(!((c>='a'&&c<='z')||(c>='0'&&c<='9')||'-'==c||'_'==c||'*'==c||'?'==c))
+			return 0;
+		if('-'==c&&0==label)
+			return 0;
+		if(++label>DOMAIN_LABEL_LIMIT)
+			return 0;
+	}
+	return label>0&&'-'!=name[len-1];
+}
+
+/// @brief 规范化一行域名
+/// @retval enum domain_norm_ret
+int normalize_domain(const char *str,size_t len,char *out,size_t *out_len)
+{
+	const char *end=NULL;
+	const char *p=NULL;
+	bool rewrite=false;
+	bool ascii=true;
+	size_t n=0;
+	size_t i=0;
+
+	if(NULL==str||NULL==out||NULL==out_len)
+		return DOMAIN_NORM_INVALID;
+	/// 去掉注释
+	if((end=memchr(str,'#',len))!=NULL)
+		len=end-str;
+	/// 去掉首尾空白
+	while(len>0&&is_blank(*str))
+	{
+		str++;
+		len--;
+	}
+	while(len>0&&is_blank(str[len-1]))
+		len--;
+	if(0==len)
+		return DOMAIN_NORM_SKIP;
+	/// 中间仍有空白,不是单个域名
+	for(p=str;p<str+len;p++)
+	{
+		if(is_blank(*p))
+			return DOMAIN_NORM_INVALID;
+		if(*p&0x80)
+			ascii=false;
+	}
+	/// 去掉根点和开头的点,"*."开头的为通配规则,保留
+	if(len>0&&'.'==str[len-1])
+	{
+		len--;
+		rewrite=true;
+	}
+	if(len>0&&'.'==str[0])
+	{
+		str++;
+		len--;
+		rewrite=true;
+	}
+	if(0==len||len>=DOMAIN_MAX_LENGTH*4)
+		return DOMAIN_NORM_INVALID;
+	if(ascii)
+	{
+		if(len>=DOMAIN_MAX_LENGTH)
+			return DOMAIN_NORM_INVALID;
+		/// 转小写
+		for(i=0;i<len;i++)
+		{
+			char c=str[i];
+			if(c>='A'&&c<='Z')
+			{
+				c+='a'-'A';
+				rewrite=true;
+			}
+			out[i]=c;
+		}
+		n=len;
+	}
+	else
+	{
+		/// Unicode域名转换为A-label,仅在出现非ASCII字符时调用libidn2
+		char buf[DOMAIN_MAX_LENGTH*4+1];
+		char *ace=NULL;
+		memcpy(buf,str,len);
+		buf[len]='\0';
+		if(idn2_to_ascii_8z(buf,&ace,IDN2_NFC_INPUT|IDN2_NONTRANSITIONAL)!=IDN2_OK
+				&&idn2_to_ascii_8z(buf,&ace,IDN2_NFC_INPUT|IDN2_TRANSITIONAL)!=IDN2_OK)
+			return DOMAIN_NORM_INVALID;
+		n=strlen(ace);
+		if(n>=DOMAIN_MAX_LENGTH)
+		{
+			idn2_free(ace);
+			return DOMAIN_NORM_INVALID;
+		}
+		for(i=0;i<n;i++)
+			out[i]=(ace[i]>='A'&&ace[i]<='Z')?ace[i]+'a'-'A':ace[i];
+		idn2_free(ace);
+		rewrite=true;
+	}
+	out[n]='\0';
+	if(!check_domain(out,n))
+		return DOMAIN_NORM_INVALID;
+	*out_len=n;
+	return rewrite?DOMAIN_NORM_REWRITE:DOMAIN_NORM_OK;
+}
+
+/// @brief 集合使用的哈希函数(FNV-1a)
+static unsigned int set_hash(const char *name,size_t len)
+{
+	unsigned int hash=2166136261u;
+	size_t i=0;
+	for(i=0;i<len;i++)
+	{
+		hash^=(unsigned char)name[i];
+		hash*=16777619u;
+	}
+	return hash;
+}
+
+/// @brief 初始化去重集合
+/// @retval 成功0 失败错误代码负值
+int init_domain_set(struct domain_set *set,size_t hint)
+{
+	size_t size=16;
+	if(NULL==set)
+		return -EINVAL;
+	/// 负载不超过1/2
+	while(size<hint*2)
+		size<<=1;
+	set->slots=(struct domain_set_slot*)calloc(size,sizeof(struct domain_set_slot));
+	if(NULL==set->slots)
+		return -ENOMEM;
+	set->size=size;
+	set->num=0;
+	return 0;
+}
+
+/// @brief 清除去重集合,并释放内存
+void clean_domain_set(struct domain_set *set)
+{
+	size_t i=0;
+	if(NULL==set||NULL==set->slots)
+		return;
+	for(i=0;i<set->size;i++)
+		free(set->slots[i].name);
+	free(set->slots);
+	set->slots=NULL;
+	set->size=0;
+	set->num=0;
+}
+
+/// @brief 扩大集合
+static int grow_domain_set(struct domain_set *set)
+{
+	struct domain_set_slot *slots=NULL;
+	size_t size=set->size<<1;
+	size_t i=0;
+	slots=(struct domain_set_slot*)calloc(size,sizeof(struct domain_set_slot));
+	if(NULL==slots)
+		return -ENOMEM;
+	for(i=0;i<set->size;i++)
+	{
+		size_t pos=0;
+		if(NULL==set->slots[i].name)
+			continue;
+		pos=set->slots[i].hash&(size-1);
+		while(NULL!=slots[pos].name)
+			pos=(pos+1)&(size-1);
+		slots[pos]=set->slots[i];
+	}
+	free(set->slots);
+	set->slots=slots;
+	set->size=size;
+	return 0;
+}
+
+/// @brief 向集合中加入域名
+/// @retval 新加入1 已存在0 失败错误代码负值
+int domain_set_insert(struct domain_set *set,const char *name,size_t len)
+{
+	unsigned int hash=0;
+	size_t pos=0;
+	int err=0;
+	if(NULL==set||NULL==set->slots||NULL==name)
+		return -EINVAL;
+	if((set->num+1)*2>set->size&&(err=grow_domain_set(set))<0)
+		return err;
+	hash=set_hash(name,len);
+	pos=hash&(set->size-1);
+	while(NULL!=set->slots[pos].name)
+	{
+		struct domain_set_slot *slot=set->slots+pos;
+		if(slot->hash==hash&&slot->len==len&&memcmp(slot->name,name,len)==0)
+			return 0;
+		pos=(pos+1)&(set->size-1);
+	}
+	if((set->slots[pos].name=(char*)malloc(len+1))==NULL)
+		return -ENOMEM;
+	memcpy(set->slots[pos].name,name,len);
+	set->slots[pos].name[len]='\0';
+	set->slots[pos].hash=hash;
+	set->slots[pos].len=len;
+	set->num++;
+	return 1;
+}
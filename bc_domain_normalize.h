@@ -0,0 +1,70 @@
+/*
+ * @file bc_domain_normalize.h
+ * @breif 域名入库前的规范化处理
+ *        去除注释/空白,转小写,去除根点,保留通配字符'*'和'?',
+ *        Unicode域名转换为punycode(A-label),校验并去重
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#ifndef _BC_DOMAIN_NORMALIZE_H_
+#define _BC_DOMAIN_NORMALIZE_H_
+
+#include <stddef.h>
+#include "bc_domain_names.h"
+
+/// 规范化结果
+enum domain_norm_ret{
+	DOMAIN_NORM_OK=0,       ///< 合法,内容未改写
+	DOMAIN_NORM_REWRITE,    ///< 合法,内容经过改写(大小写,根点,IDN)
+	DOMAIN_NORM_SKIP,       ///< 空行或注释行
+	DOMAIN_NORM_INVALID     ///< 非法域名
+};
+
+/// 规范化统计
+struct domain_norm_stat
+{
+	size_t total;        ///< 处理的行数
+	size_t accepted;     ///< 写入的域名数
+	size_t rewritten;    ///< 写入的域名中经过改写的个数
+	size_t skipped;      ///< 空行或注释
+	size_t invalid;      ///< 非法域名
+	size_t duplicate;    ///< 重复域名
+	size_t overflow;     ///< 超出类别容量而丢弃的域名
+};
+
+/// 去重集合,开放定址
+struct domain_set_slot
+{
+	unsigned int hash;   ///< 域名哈希
+	unsigned int len;    ///< 域名长度
+	char *name;          ///< 域名,NULL表示空槽
+};
+
+struct domain_set
+{
+	struct domain_set_slot *slots;  ///< 槽数组
+	size_t size;                    ///< 槽个数,2的幂
+	size_t num;                     ///< 已有域名个数
+};
+
+/// @brief 规范化一行域名
+/// @param[in] str,len 原始内容,不要求以'\0'结尾
+/// @param[out] out 规范化后的域名,长度至少DOMAIN_MAX_LENGTH
+/// @param[out] out_len 规范化后域名长度
+/// @retval enum domain_norm_ret
+int normalize_domain(const char *str,size_t len,char *out,size_t *out_len);
+
+/// @brief 初始化去重集合
+/// @param[in] hint 预计域名个数
+/// @retval 成功0 失败错误代码负值
+int init_domain_set(struct domain_set *set,size_t hint);
+
+/// @brief 清除去重集合,并释放内存
+void clean_domain_set(struct domain_set *set);
+
+/// @brief 向集合中加入域名
+/// @retval 新加入1 已存在0 失败错误代码负值
+int domain_set_insert(struct domain_set *set,const char *name,size_t len);
+
+#endif /// _BC_DOMAIN_NORMALIZE_H_
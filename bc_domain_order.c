@@ -0,0 +1,317 @@
+/*
+ * @file bc_domain_order.c
+ * @breif 有序索引的建立与查询,用户程序使用
+ * 	  数组按Eytzinger(BFS)排列,查找时逐层下降,只以比较结果计算下一个位置,
+ * 	  并预取之后第4层的节点
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#include <errno.h>
+#include <error.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bc_domain_order.h"
+#include "bc_domain_glob.h"
+
+/// @brief 正序比较,用于qsort
+static int order_cmp_fwd(const void *a,const void *b)
+{
+	return strcmp(*(const char* const*)a,*(const char* const*)b);
+}
+
+/// @brief 倒序比较,用于qsort
+static int order_cmp_rev(const void *a,const void *b)
+{
+	return domain_rev_cmp(*(const char* const*)a,*(const char* const*)b);
+}
+
+/// @brief 按rev比较两个域名
+static inline int order_cmp(bool rev,const char *a,const char *b)
+{
+	return rev?domain_rev_cmp(a,b):strcmp(a,b);
+}
+
+/// @brief 将names中的n个域名排序,得到记录下标
+/// @param[in] keys 指向base中各域名的指针,排序后顺序改变
+/// @param[in] first base中第一项对应的记录下标
+/// @param[out] sorted 排序后的记录下标
+static void order_sort(const char **keys,size_t n,char (*base)[DOMAIN_MAX_LENGTH],
+		size_t first,bool rev,unsigned int *sorted)
+{
+	size_t i=0;
+	qsort(keys,n,sizeof(char*),rev?order_cmp_rev:order_cmp_fwd);
+	for(i=0;i<n;i++)
+		sorted[i]=first+(keys[i]-base[0])/DOMAIN_MAX_LENGTH;
+}
+
+/// @brief 返回视图中记录index的域名
+/// 	追加的记录已在内存中,索引中的记录从db读取,共享内存区中不复制
+/// @param[in] buf bigmem存储读取记录的缓冲区
+static const char *order_name(const struct domain_order_view *view,size_t index,struct domain_name *buf)
+{
+	const struct domain_name *name=NULL;
+	if(index>=view->order->num)
+		return view->tail_names[index-view->order->num];
+	if(NULL==(name=get_domain_name_ref(view->db,view->type,index,buf)))
+		return "";
+	return name->name;
+}
+
+/// @brief 记录index是否有效
+static inline bool order_valid(const struct domain_order_view *view,size_t index)
+{
+	return index<view->num&&((view->valid[index/64]>>(index%64))&1);
+}
+
+/// @brief 将有序数组sorted按中序填入Eytzinger数组items的第k项为根的子树
+/// @retval 已填入的个数
+static size_t order_fill(unsigned int *items,const unsigned int *sorted,size_t i,size_t k,size_t n)
+{
+	if(k>n)
+		return i;
+	i=order_fill(items,sorted,i,2*k,n);
+	items[k-1]=sorted[i++];
+	return order_fill(items,sorted,i,2*k+1,n);
+}
+
+/// @brief Eytzinger数组中第k项的中序后继
+/// @retval 后继位置 没有后继返回0
+static inline size_t order_succ(size_t k,size_t n)
+{
+	if(2*k+1<=n)
+	{
+		for(k=2*k+1;2*k<=n;k*=2);
+		return k;
+	}
+	/// 去掉末尾连续的右子节点,回到以左子节点进入的祖先
+	return k>>__builtin_ffsl(~k);
+}
+
+/// @brief 在n项的Eytzinger数组items中查找第一个不小于key的域名
+/// @retval 位置 全部小于key返回0
+static size_t order_lower_bound(const struct domain_order_view *view,const unsigned int *items,
+		size_t n,bool rev,const char *key)
+{
+	struct domain_name buf;
+	size_t k=1;
+	while(k<=n)
+	{
+		/// 16个下标位于同一缓存行,提前取得4层之后的节点
+		__builtin_prefetch(items+16*k-1);
+		k=2*k+(order_cmp(rev,order_name(view,items[k-1],&buf),key)<0);
+	}
+	return k>>__builtin_ffsl(~k);
+}
+
+/// @brief 对db中type类别的有效字面域名建立有序索引并写入db
+/// @retval 成功返回索引中的域名个数 失败错误代码负值
+int compile_domain_order(struct bc_domain_db *db,enum domain_type type)
+{
+	struct domain_order *order=NULL;
+	char (*names)[DOMAIN_MAX_LENGTH]=NULL;
+	const char **keys=NULL;
+	unsigned int *sorted=NULL;
+	struct domain_iter it;
+	const struct domain_name *name=NULL;
+	size_t max_len=0;
+	size_t n=0;
+	size_t i=0;
+	int err=0;
+
+	if(NULL==db||type<0||type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	max_len=db->domain_names.domain_type_max_len[type];
+	order=(struct domain_order*)calloc(1,DOMAIN_ORDER_SIZE(max_len));
+	names=(char(*)[DOMAIN_MAX_LENGTH])calloc(max_len+1,DOMAIN_MAX_LENGTH);
+	keys=(const char**)calloc(max_len+1,sizeof(char*));
+	sorted=(unsigned int*)calloc(max_len+1,sizeof(unsigned int));
+	if(NULL==order||NULL==names||NULL==keys||NULL==sorted)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	if((err=domain_iter_init(&it,db,type))<0)
+		goto out;
+	while((name=domain_iter_next(&it,&i))!=NULL&&i<max_len)
+	{
+		/// 通配规则不参与排序
+		if(!name->is_vaild||is_domain_glob(name->name))
+			continue;
+		strncpy(names[i],name->name,DOMAIN_MAX_LENGTH-1);
+		keys[n++]=names[i];
+	}
+	if((err=it.err)<0)
+		goto out;
+	order->num=get_domain_name_num(db,type);
+	order->count=n;
+	order_sort(keys,n,names,0,false,sorted);
+	order_fill(order->items,sorted,0,1,n);
+	order_sort(keys,n,names,0,true,sorted);
+	order_fill(order->items+n,sorted,0,1,n);
+	if((err=set_domain_order(order,db,type))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"write domain order for type %d error",type);
+		goto out;
+	}
+	err=n;
+out:
+	free(order);
+	free(names);
+	free(keys);
+	free(sorted);
+	return err;
+}
+
+/// @brief 载入type类别的有序索引,有效位图和追加的记录
+/// 	建立索引之后删除的记录依据有效位图跳过,追加的记录在内存中排序,
+/// 	不再复制全部记录
+/// @retval 成功0 失败错误代码负值
+int load_domain_order_view(struct domain_order_view *view,struct bc_domain_db *db,enum domain_type type)
+{
+	struct domain_columns cols;
+	struct domain_name buf[DOMAIN_SPAN_SIZE];
+	const struct domain_name *span=NULL;
+	const char **keys=NULL;
+	size_t max_len=0;
+	size_t first=0;
+	size_t i=0;
+	int err=0;
+
+	if(NULL==view||NULL==db||type<0||type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	memset(view,0,sizeof(*view));
+	view->db=db;
+	view->type=type;
+	max_len=db->domain_names.domain_type_max_len[type];
+	view->num=get_domain_name_num(db,type);
+	if(view->num>max_len)
+		view->num=max_len;
+	view->valid=(unsigned long long*)calloc(DOMAIN_VALID_WORDS(view->num)+1,sizeof(unsigned long long));
+	view->order=(struct domain_order*)calloc(1,DOMAIN_ORDER_SIZE(max_len));
+	if(NULL==view->valid||NULL==view->order)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	for(i=0;i<view->num&&(err=get_domain_columns(&cols,db,type,i))>0;i+=cols.num)
+	{
+		size_t num=cols.num<view->num-i?cols.num:view->num-i;
+		memcpy(view->valid+i/64,cols.valid,DOMAIN_VALID_WORDS(num)*sizeof(unsigned long long));
+	}
+	if(err<0)
+		goto out;
+	err=0;
+	/// 没有或无法使用有序索引时,全部记录视为追加的记录
+	if(get_domain_order(view->order,DOMAIN_ORDER_SIZE(max_len),db,type)<0||view->order->num>view->num)
+	{
+		view->order->num=0;
+		view->order->count=0;
+	}
+	first=view->order->num;
+	view->tail_names=(char(*)[DOMAIN_MAX_LENGTH])calloc(view->num-first+1,DOMAIN_MAX_LENGTH);
+	view->tail[0]=(unsigned int*)calloc(view->num-first+1,sizeof(unsigned int));
+	view->tail[1]=(unsigned int*)calloc(view->num-first+1,sizeof(unsigned int));
+	keys=(const char**)calloc(view->num-first+1,sizeof(char*));
+	if(NULL==view->tail_names||NULL==view->tail[0]||NULL==view->tail[1]||NULL==keys)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	for(i=first;i<view->num;i++)
+	{
+		size_t num=view->num-i;
+		if(!order_valid(view,i))
+			continue;
+		if(NULL==(span=get_domain_name_span(db,type,i,&num,buf,DOMAIN_SPAN_SIZE)))
+		{
+			err=-EFAULT;
+			goto out;
+		}
+		/// 通配规则不参与排序
+		if(!span->is_vaild||is_domain_glob(span->name))
+			continue;
+		strncpy(view->tail_names[i-first],span->name,DOMAIN_MAX_LENGTH-1);
+		keys[view->tail_num++]=view->tail_names[i-first];
+	}
+	order_sort(keys,view->tail_num,view->tail_names,first,false,view->tail[0]);
+	order_sort(keys,view->tail_num,view->tail_names,first,true,view->tail[1]);
+out:
+	free(keys);
+	if(err<0)
+		clean_domain_order_view(view);
+	return err;
+}
+
+/// @brief 释放有序视图
+void clean_domain_order_view(struct domain_order_view *view)
+{
+	if(NULL==view)
+		return;
+	free(view->valid);
+	free(view->order);
+	free(view->tail_names);
+	free(view->tail[0]);
+	free(view->tail[1]);
+	memset(view,0,sizeof(*view));
+}
+
+/// @brief 将游标定位到第一个不小于key的域名
+void domain_order_seek(struct domain_order_cursor *cur,const struct domain_order_view *view,
+		bool rev,const char *key)
+{
+	const unsigned int *items=view->order->items+(rev?view->order->count:0);
+	const unsigned int *tail=view->tail[rev?1:0];
+	size_t lo=0;
+	size_t hi=view->tail_num;
+	cur->view=view;
+	cur->rev=rev;
+	cur->k=order_lower_bound(view,items,view->order->count,rev,key);
+	/// 追加的记录通常很少,二分查找即可
+	while(lo<hi)
+	{
+		size_t mid=lo+(hi-lo)/2;
+		if(order_cmp(rev,view->tail_names[tail[mid]-view->order->num],key)<0)
+			lo=mid+1;
+		else
+			hi=mid;
+	}
+	cur->t=lo;
+}
+
+/// @brief 返回游标处的记录并前进
+/// @retval 记录下标 结束返回-1
+int domain_order_next(struct domain_order_cursor *cur)
+{
+	const struct domain_order_view *view=cur->view;
+	const unsigned int *items=view->order->items+(cur->rev?view->order->count:0);
+	const unsigned int *tail=view->tail[cur->rev?1:0];
+	size_t n=view->order->count;
+	while(cur->k||cur->t<view->tail_num)
+	{
+		unsigned int index=0;
+		const char *name=NULL;
+		/// 建立索引之后删除的记录,不读取域名
+		if(cur->k&&!order_valid(view,items[cur->k-1]))
+		{
+			cur->k=order_succ(cur->k,n);
+			continue;
+		}
+		if(cur->k)
+			name=order_name(view,items[cur->k-1],&cur->buf);
+		if(0==cur->k||(cur->t<view->tail_num&&
+					order_cmp(cur->rev,view->tail_names[tail[cur->t]-view->order->num],name)<0))
+		{
+			index=tail[cur->t++];
+			cur->name=view->tail_names[index-view->order->num];
+			return index;
+		}
+		index=items[cur->k-1];
+		cur->k=order_succ(cur->k,n);
+		cur->name=name;
+		return index;
+	}
+	cur->name=NULL;
+	return -1;
+}
@@ -0,0 +1,88 @@
+/*
+ * bc_domain_order模块头文件
+ * 	  有序索引,用户程序在发布时对有效的字面域名按正序和倒序排序,
+ * 	  以Eytzinger排列保存在db中,用于前缀,区间,子域名查询和有序导出
+ * 	  倒序指从最后一个字符开始比较,同一区域下的域名相邻
+ */
+#ifndef _BC_DOMAIN_ORDER_H
+#define _BC_DOMAIN_ORDER_H
+
+#include "bc_domain_names.h"
+
+/// @brief 从最后一个字符开始比较两个域名
+/// @retval 同strcmp
+static inline int domain_rev_cmp(const char *a,const char *b)
+{
+	size_t i=strlen(a);
+	size_t j=strlen(b);
+	while(i>0&&j>0)
+	{
+		unsigned char x=a[--i];
+		unsigned char y=b[--j];
+		if(x!=y)
+			return x<y?-1:1;
+	}
+	return (i>0)-(j>0);
+}
+
+/// @brief 判断name是否为zone本身或其子域名
+static inline bool domain_is_under(const char *name,const char *zone)
+{
+	size_t len=strlen(name);
+	size_t zlen=strlen(zone);
+	if(0==zlen)
+		return true;
+	if(len<zlen||memcmp(name+len-zlen,zone,zlen)!=0)
+		return false;
+	return len==zlen||'.'==name[len-zlen-1];
+}
+
+/// 查询时从db载入的有序视图
+/// 	只载入有序索引,有效位图和建立索引之后追加的记录,
+/// 	索引中的域名在查找和遍历经过时才从db读取
+struct domain_order_view
+{
+	struct bc_domain_db *db;
+	enum domain_type type;
+	size_t num;                        ///< 记录个数
+	unsigned long long *valid;         ///< 有效位图,删除的记录保留原有域名以维持顺序
+	struct domain_order *order;        ///< db中的有序索引
+	char (*tail_names)[DOMAIN_MAX_LENGTH];  ///< 追加的记录的域名,第i项为记录order->num+i
+	unsigned int *tail[2];             ///< 建立索引之后追加的有效记录,分别按正序和倒序排列
+	size_t tail_num;                   ///< 追加的有效记录个数
+};
+
+/// 游标,按顺序合并Eytzinger数组与追加的记录
+struct domain_order_cursor
+{
+	const struct domain_order_view *view;
+	bool rev;      ///< 是否按倒序域名
+	size_t k;      ///< Eytzinger数组中的位置,从1开始,0表示结束
+	size_t t;      ///< tail中的位置
+	const char *name;         ///< domain_order_next返回的记录的域名,下次调用前有效
+	struct domain_name buf;   ///< bigmem存储读取记录的缓冲区
+};
+
+/// @brief 对db中type类别的有效字面域名建立有序索引并写入db
+/// 	在最小完美哈希编译之后调用,记录下标以重排后的为准
+/// @retval 成功返回索引中的域名个数 失败错误代码负值
+int compile_domain_order(struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 载入type类别的有序索引,有效位图和追加的记录
+/// 	视图引用db,使用期间db须保持载入
+/// @retval 成功0 失败错误代码负值
+int load_domain_order_view(struct domain_order_view *view,struct bc_domain_db *db,enum domain_type type);
+
+/// @brief 释放有序视图
+void clean_domain_order_view(struct domain_order_view *view);
+
+/// @brief 将游标定位到第一个不小于key的域名
+/// @param[in] rev 为true时按倒序域名比较
+void domain_order_seek(struct domain_order_cursor *cur,const struct domain_order_view *view,
+		bool rev,const char *key);
+
+/// @brief 返回游标处的记录并前进,记录的域名置于cur->name
+/// @retval 记录下标 结束返回-1
+int domain_order_next(struct domain_order_cursor *cur);
+
+#endif /// _BC_DOMAIN_ORDER_H
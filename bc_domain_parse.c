@@ -0,0 +1,266 @@
+/*
+ * @file bc_domain_parse.c
+ * @breif 从报文内容中直接定位主机名,内核与用户态共用
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#ifndef USER_SPACE
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#else
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#endif
+
+#include "bc_domain_names.h"
+#include "bc_domain_parse.h"
+
+/// @brief 是否为空白字符
+static inline int is_space_char(char c)
+{
+	return ' '==c||'\t'==c||'\r'==c||'\n'==c;
+}
+
+/// @brief 从Host头的值或SNI中定位主机名
+/// @retval 成功返回buf中主机名起始位置 失败返回NULL
+const char *bc_domain_host_extract(const char *buf,size_t len,size_t *host_len)
+{
+	const char *colon=NULL;
+	if(NULL==buf||NULL==host_len)
+		return NULL;
+	/// 去掉首尾空白
+	while(len>0&&is_space_char(*buf))
+	{
+		buf++;
+		len--;
+	}
+	while(len>0&&is_space_char(buf[len-1]))
+		len--;
+	if(0==len)
+		return NULL;
+	if('['==*buf)
+	{
+		/// IPv6字面量 [addr]:port
+		const char *end=memchr(buf,']',len);
+		if(NULL==end)
+			return NULL;
+		buf++;
+		len=end-buf;
+	}
+	else if((colon=memchr(buf,':',len))!=NULL)
+	{
+		/// 只有一个':'时为端口,多个':'为未加括号的IPv6地址
+		if(NULL==memchr(colon+1,':',buf+len-colon-1))
+			len=colon-buf;
+	}
+	/// 去掉根点
+	while(len>0&&'.'==buf[len-1])
+		len--;
+	if(0==len||len>=DOMAIN_MAX_LENGTH)
+		return NULL;
+	*host_len=len;
+	return buf;
+}
+#ifndef USER_SPACE
+EXPORT_SYMBOL(bc_domain_host_extract);
+#endif
+
+/// @brief 在HTTP请求头中定位Host头的主机名
+/// @retval 成功返回buf中主机名起始位置 失败返回NULL
+const char *bc_domain_http_host(const char *buf,size_t len,size_t *host_len)
+{
+	const char *end=buf+len;
+	const char *line=NULL;
+	if(NULL==buf||NULL==host_len)
+		return NULL;
+	/// 跳过请求行
+	if((line=memchr(buf,'\n',len))==NULL)
+		return NULL;
+	line++;
+	while(line<end)
+	{
+		const char *eol=memchr(line,'\n',end-line);
+		size_t line_len=(NULL==eol?end:eol)-line;
+		/// 空行为请求头结束
+		if(0==line_len||(1==line_len&&'\r'==*line))
+			break;
+		if(line_len>5&&strncasecmp(line,"host:",5)==0)
+			return bc_domain_host_extract(line+5,line_len-5,host_len);
+		if(NULL==eol)
+			break;
+		line=eol+1;
+	}
+	return NULL;
+}
+#ifndef USER_SPACE
+EXPORT_SYMBOL(bc_domain_http_host);
+#endif
+
+/// TLS常量
+#define TLS_HANDSHAKE 0x16
+#define TLS_CLIENT_HELLO 0x01
+#define TLS_EXT_SERVER_NAME 0x0000
+#define TLS_SNI_HOST_NAME 0x00
+
+/// @brief 读取网络字节序的16位整数
+static inline size_t get_be16(const unsigned char *p)
+{
+	return ((size_t)p[0]<<8)|p[1];
+}
+
+/// @brief 在TLS ClientHello中定位SNI主机名
+/// @retval 成功返回buf中主机名起始位置 失败返回NULL
+const char *bc_domain_tls_sni(const unsigned char *buf,size_t len,size_t *host_len)
+{
+	size_t pos=0;
+	size_t end=0;
+	size_t ext_end=0;
+	if(NULL==buf||NULL==host_len)
+		return NULL;
+	/// 记录层头部:类型(1) 版本(2) 长度(2)
+	if(len<5||TLS_HANDSHAKE!=buf[0])
+		return NULL;
+	end=5+get_be16(buf+3);
+	if(end>len)
+		end=len;
+	/// 握手头部:类型(1) 长度(3) 版本(2) 随机数(32)
+	pos=5;
+	if(pos+38>end||TLS_CLIENT_HELLO!=buf[pos])
+		return NULL;
+	pos+=38;
+	/// session id
+	if(pos+1>end)
+		return NULL;
+	pos+=1+buf[pos];
+	/// cipher suites
+	if(pos+2>end)
+		return NULL;
+	pos+=2+get_be16(buf+pos);
+	/// compression methods
+	if(pos+1>end)
+		return NULL;
+	pos+=1+buf[pos];
+	/// extensions
+	if(pos+2>end)
+		return NULL;
+	ext_end=pos+2+get_be16(buf+pos);
+	if(ext_end>end)
+		ext_end=end;
+	pos+=2;
+	while(pos+4<=ext_end)
+	{
+		size_t type=get_be16(buf+pos);
+		size_t ext_len=get_be16(buf+pos+2);
+		pos+=4;
+		if(pos+ext_len>ext_end)
+			return NULL;
+		if(TLS_EXT_SERVER_NAME==type)
+		{
+			/// server_name_list长度(2) 类型(1) 长度(2) 主机名
+			size_t name_len=0;
+			if(ext_len<5||TLS_SNI_HOST_NAME!=buf[pos+2])
+				return NULL;
+			name_len=get_be16(buf+pos+3);
+			if(5+name_len>ext_len)
+				return NULL;
+			return bc_domain_host_extract((const char*)buf+pos+5,name_len,host_len);
+		}
+		pos+=ext_len;
+	}
+	return NULL;
+}
+#ifndef USER_SPACE
+EXPORT_SYMBOL(bc_domain_tls_sni);
+#endif
+
+/// 线格式域名最大长度(RFC1035)
+#define DNS_NAME_WIRE_MAX 255
+
+/// @brief 校验线格式域名,压缩指针只允许在报文范围内向前跳转
+/// @retval 成功0 失败错误代码负值
+int bc_domain_qname_parse(const unsigned char *msg,size_t msg_len,size_t offset,struct dns_qname *qname)
+{
+	size_t pos=offset;
+	size_t wire=0;    ///< 线格式长度
+	size_t len=0;     ///< 点分格式长度
+	if(NULL==msg||NULL==qname)
+		return -EINVAL;
+	while(1)
+	{
+		unsigned char c=0;
+		if(pos>=msg_len)
+			return -EINVAL;
+		c=msg[pos];
+		if(0xc0==(c&0xc0))
+		{
+			/// 压缩指针,只能指向当前位置之前,保证不成环
+			size_t target=0;
+			if(pos+1>=msg_len)
+				return -EINVAL;
+			target=((size_t)(c&0x3f)<<8)|msg[pos+1];
+			if(target>=pos)
+				return -EINVAL;
+			pos=target;
+			continue;
+		}
+		/// 0x40,0x80为已废弃的扩展标签类型
+		if(c&0xc0)
+			return -EINVAL;
+		wire+=1+c;
+		if(wire>DNS_NAME_WIRE_MAX)
+			return -EINVAL;
+		if(0==c)
+			break;
+		if(pos+1+c>msg_len)
+			return -EINVAL;
+		/// 标签中含'.'时无法与点分格式一一对应
+		if(memchr(msg+pos+1,'.',c)!=NULL)
+			return -EINVAL;
+		len+=(len>0?1:0)+c;
+		pos+=1+c;
+	}
+	qname->msg=msg;
+	qname->msg_len=msg_len;
+	qname->offset=offset;
+	qname->len=len;
+	return 0;
+}
+#ifndef USER_SPACE
+EXPORT_SYMBOL(bc_domain_qname_parse);
+#endif
+
+/// @brief ASCII转小写
+static inline unsigned char fold_char(unsigned char c)
+{
+	return (c>='A'&&c<='Z')?c+'a'-'A':c;
+}
+
+/// @brief 比较线格式域名与点分格式域名,忽略ASCII大小写
+/// @retval 相等1 不相等0
+int bc_domain_qname_equal(const struct dns_qname *qname,const char *name)
+{
+	size_t pos=qname->offset;
+	size_t len=0;
+	const unsigned char *label=NULL;
+	const unsigned char *p=(const unsigned char*)name;
+	bool first=true;
+	while((label=dns_qname_label(qname,&pos,&len))!=NULL)
+	{
+		size_t i=0;
+		if(!first&&'.'!=*p++)
+			return 0;
+		first=false;
+		for(i=0;i<len;i++,p++)
+		{
+			if('\0'==*p||fold_char(label[i])!=fold_char(*p))
+				return 0;
+		}
+	}
+	return '\0'==*p;
+}
+#ifndef USER_SPACE
+EXPORT_SYMBOL(bc_domain_qname_equal);
+#endif
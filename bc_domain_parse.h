@@ -0,0 +1,71 @@
+/*
+ * bc_domain_parse模块头文件
+ * 	  从报文内容中直接定位主机名,不复制,不分配内存
+ * 	  内核与用户态共用
+ */
+#ifndef _BC_DOMAIN_PARSE_H
+#define _BC_DOMAIN_PARSE_H
+
+#ifndef USER_SPACE
+#include <linux/types.h>
+#else
+#include <stddef.h>
+#endif
+
+/// @brief 从Host头的值或SNI中定位主机名
+/// 	去除首尾空白,":port",IPv6字面量的"[]"以及末尾的根点
+/// @param[in] buf,len 原始内容,不要求以'\0'结尾
+/// @param[out] host_len 主机名长度
+/// @retval 成功返回buf中主机名起始位置 失败返回NULL
+const char *bc_domain_host_extract(const char *buf,size_t len,size_t *host_len);
+
+/// @brief 在HTTP请求头中定位Host头的主机名
+/// @param[in] buf,len HTTP请求报文内容
+/// @param[out] host_len 主机名长度
+/// @retval 成功返回buf中主机名起始位置 失败返回NULL
+const char *bc_domain_http_host(const char *buf,size_t len,size_t *host_len);
+
+/// @brief 在TLS ClientHello中定位SNI主机名
+/// @param[in] buf,len TLS记录层报文内容
+/// @param[out] host_len 主机名长度
+/// @retval 成功返回buf中主机名起始位置 失败返回NULL
+const char *bc_domain_tls_sni(const unsigned char *buf,size_t len,size_t *host_len);
+
+/// DNS线格式域名,如 \x03www\x07example\x03com\x00
+struct dns_qname
+{
+	const unsigned char *msg;   ///< DNS报文起始,压缩指针相对于此
+	size_t msg_len;             ///< 报文长度
+	size_t offset;              ///< 域名在报文中的偏移
+	size_t len;                 ///< 对应点分格式的长度
+};
+
+/// @brief 校验线格式域名,压缩指针只允许在报文范围内向前跳转
+/// @param[in] msg,msg_len DNS报文(只有域名时即为域名本身)
+/// @param[in] offset 域名在报文中的偏移
+/// @retval 成功0 失败错误代码负值
+int bc_domain_qname_parse(const unsigned char *msg,size_t msg_len,size_t offset,struct dns_qname *qname);
+
+/// @brief 比较线格式域名与点分格式域名,忽略ASCII大小写
+/// @retval 相等1 不相等0
+int bc_domain_qname_equal(const struct dns_qname *qname,const char *name);
+
+/// @brief 依次取出已校验域名的各标签
+/// @param[in,out] pos 当前位置,初始为qname->offset
+/// @param[out] len 标签长度
+/// @retval 标签内容 结束返回NULL
+static inline const unsigned char *dns_qname_label(const struct dns_qname *qname,size_t *pos,size_t *len)
+{
+	const unsigned char *msg=qname->msg;
+	size_t p=*pos;
+	/// 跟随压缩指针
+	while(0xc0==(msg[p]&0xc0))
+		p=((size_t)(msg[p]&0x3f)<<8)|msg[p+1];
+	if(0==msg[p])
+		return NULL;
+	*len=msg[p];
+	*pos=p+1+msg[p];
+	return msg+p+1;
+}
+
+#endif /// _BC_DOMAIN_PARSE_H
@@ -0,0 +1,180 @@
+/*
+ * @file bc_domain_region.c
+ * @breif 模块自有的共享内存区,内核中分配并经字符设备映射,用户态映射设备或以memfd模拟
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#ifndef USER_SPACE
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/vmalloc.h>
+#include <linux/string.h>
+
+/// PMD大页的阶
+#define REGION_HUGE_ORDER (PMD_SHIFT-PAGE_SHIFT)
+#else
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/// hugetlb页大小
+#define REGION_HUGE_SIZE (2UL<<20)
+#endif
+
+#include "bc_domain_region.h"
+
+#ifndef USER_SPACE
+
+/// @brief 分配size字节的共享内存区并清零
+/// @retval 成功0 失败错误代码负值
+int init_domain_region(struct domain_region *region,size_t size)
+{
+	const gfp_t gfp=GFP_KERNEL|__GFP_ZERO|__GFP_COMP|__GFP_NOWARN;
+	unsigned int order=0;
+	if(NULL==region||0==size)
+		return -EINVAL;
+	memset(region,0,sizeof(*region));
+	size=PAGE_ALIGN(size);
+	order=get_order(size);
+	/// 能放入一个大页时优先使用大页,在内核线性映射中只占一个TLB项
+	if(order<=REGION_HUGE_ORDER)
+	{
+		region->pages=alloc_pages(gfp|__GFP_NORETRY,REGION_HUGE_ORDER);
+		region->order=REGION_HUGE_ORDER;
+	}
+	if(NULL==region->pages)
+	{
+		region->pages=alloc_pages(gfp,order);
+		region->order=order;
+	}
+	if(NULL!=region->pages)
+	{
+		region->base=page_address(region->pages);
+		region->huge=region->order>=REGION_HUGE_ORDER;
+	}
+	else if((region->base=vmalloc_user(size))==NULL)
+		return -ENOMEM;
+	region->size=size;
+	return 0;
+}
+
+/// @brief 将区域映射到用户态
+/// @retval 成功0 失败错误代码负值
+int mmap_domain_region(const struct domain_region *region,struct vm_area_struct *vma)
+{
+	unsigned long len=vma->vm_end-vma->vm_start;
+	if(NULL==region||NULL==region->base)
+		return -ENODEV;
+	if(0!=vma->vm_pgoff||len>region->size)
+		return -EINVAL;
+	if(NULL==region->pages)
+		return remap_vmalloc_range(vma,region->base,0);
+	return remap_pfn_range(vma,vma->vm_start,page_to_pfn(region->pages),
+			len,vma->vm_page_prot);
+}
+
+/// @brief 释放共享内存区
+void clean_domain_region(struct domain_region *region)
+{
+	if(NULL==region||NULL==region->base)
+		return;
+	if(NULL!=region->pages)
+		__free_pages(region->pages,region->order);
+	else
+		vfree(region->base);
+	memset(region,0,sizeof(*region));
+}
+
+#else  /// USER_SPACE
+
+/// @brief 映射fd的前map_size字节
+static int map_region(struct domain_region *region,int fd,size_t size,size_t map_size)
+{
+	void *base=mmap(NULL,map_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	if(MAP_FAILED==base)
+		return -errno;
+	region->base=base;
+	region->size=size;
+	region->map_size=map_size;
+	region->fd=fd;
+	return 0;
+}
+
+/// @brief 创建size字节的共享内存区并清零
+/// @retval 成功0 失败错误代码负值
+int init_domain_region(struct domain_region *region,const char *path,size_t size)
+{
+	size_t map_size=size;
+	int fd=-1;
+	int err=0;
+	if(NULL==region||0==size)
+		return -EINVAL;
+	memset(region,0,sizeof(*region));
+	region->fd=-1;
+	if(NULL==path)
+	{
+		/// 优先使用hugetlb,没有预留大页时退回普通memfd
+		if((fd=memfd_create(REGION_DEV_NAME,MFD_CLOEXEC|MFD_HUGETLB))>=0)
+		{
+			map_size=(size+REGION_HUGE_SIZE-1)&~(REGION_HUGE_SIZE-1);
+			if(ftruncate(fd,map_size)<0||(err=map_region(region,fd,size,map_size))<0)
+			{
+				close(fd);
+				fd=-1;
+			}
+			else
+			{
+				region->huge=true;
+				return 0;
+			}
+		}
+		map_size=size;
+		fd=memfd_create(REGION_DEV_NAME,MFD_CLOEXEC);
+	}
+	else
+		fd=open(path,O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC,0600);
+	if(fd<0)
+		return -errno;
+	/// 截断后内容全为0
+	if(ftruncate(fd,map_size)<0)
+	{
+		err=-errno;
+		close(fd);
+		return err;
+	}
+	if((err=map_region(region,fd,size,map_size))<0)
+		close(fd);
+	return err;
+}
+
+/// @brief 映射已打开的设备或文件的前size字节
+/// @retval 成功0 失败错误代码负值
+int map_domain_region(struct domain_region *region,int fd,size_t size)
+{
+	if(NULL==region||fd<0||0==size)
+		return -EINVAL;
+	memset(region,0,sizeof(*region));
+	region->fd=-1;
+	return map_region(region,fd,size,size);
+}
+
+/// @brief 解除映射
+void clean_domain_region(struct domain_region *region)
+{
+	if(NULL==region||NULL==region->base)
+		return;
+	munmap(region->base,region->map_size);
+	if(region->fd>=0)
+		close(region->fd);
+	memset(region,0,sizeof(*region));
+	region->fd=-1;
+}
+
+#endif /// USER_SPACE
@@ -0,0 +1,65 @@
+/*
+ * bc_domain_region模块头文件
+ * 	  模块自有的共享内存区,作为bigmem之外的db存储
+ * 	  内核中为连续内存(尽量使用大页),通过字符设备/dev/bc_domain_mem映射到用户态,
+ * 	  用户态直接映射该设备,或以memfd/文件模拟,不需要/dev/mem
+ */
+#ifndef _BC_DOMAIN_REGION_H
+#define _BC_DOMAIN_REGION_H
+
+#ifndef USER_SPACE
+#include <linux/types.h>
+struct page;
+struct vm_area_struct;
+#else
+#include <stddef.h>
+#include <stdbool.h>
+#endif
+
+/// 字符设备名
+#define REGION_DEV_NAME "bc_domain_mem"
+#define REGION_DEV_PATH "/dev/"REGION_DEV_NAME
+
+/// 共享内存区
+struct domain_region
+{
+	void *base;             ///< 起始地址,NULL表示未使用
+	size_t size;            ///< 可用大小
+	bool huge;              ///< 是否由大页构成
+#ifndef USER_SPACE
+	struct page *pages;     ///< 连续页,NULL表示由vmalloc_user分配
+	unsigned int order;     ///< 连续页的阶
+#else
+	size_t map_size;        ///< 映射大小
+	int fd;                 ///< 映射的文件
+#endif
+};
+
+#ifndef USER_SPACE
+
+/// @brief 分配size字节的共享内存区并清零
+/// 	依次尝试PMD大小对齐的连续页,刚好容纳size的连续页,vmalloc_user
+/// @retval 成功0 失败错误代码负值
+int init_domain_region(struct domain_region *region,size_t size);
+
+/// @brief 将区域映射到用户态,供字符设备的mmap调用
+/// @retval 成功0 失败错误代码负值
+int mmap_domain_region(const struct domain_region *region,struct vm_area_struct *vma);
+
+#else  /// USER_SPACE
+
+/// @brief 创建size字节的共享内存区并清零
+/// @param[in] path 为NULL时使用memfd(优先hugetlb),否则创建或截断文件path
+/// @retval 成功0 失败错误代码负值
+int init_domain_region(struct domain_region *region,const char *path,size_t size);
+
+/// @brief 映射已打开的设备或文件的前size字节,成功后fd归region所有
+/// @retval 成功0 失败错误代码负值
+int map_domain_region(struct domain_region *region,int fd,size_t size);
+
+#endif  /// USER_SPACE
+
+/// @brief 释放共享内存区,用户态只解除映射
+void clean_domain_region(struct domain_region *region);
+
+#endif /// _BC_DOMAIN_REGION_H
@@ -0,0 +1,556 @@
+/**
+ * @file bc_domain_replay.c
+ * @brief 离线回放pcap文件,测量域名分类的吞吐与延迟
+ *       从报文中提取DNS QNAME,HTTP Host与TLS SNI,
+ *       使用与内核bc_domain_match相同的索引代码对db快照进行分类
+ *       调用格式
+ *       bc_domain_replay [-t type] [-n loops] file.pcap
+ *
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <bigmem.h>
+#include "bc_domain_names.h"
+#include "bc_domain_index.h"
+#include "bc_domain_parse.h"
+
+const char *g_program="bc_domain_replay";
+
+/// pcap文件格式
+#define PCAP_MAGIC 0xa1b2c3d4
+#define PCAP_MAGIC_NS 0xa1b23c4d
+#define PCAP_HEADER_LEN 24
+#define PCAP_RECORD_LEN 16
+
+/// 链路层类型
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+
+/// 协议常量
+#define ETHERTYPE_IP 0x0800
+#define ETHERTYPE_IPV6 0x86dd
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88a8
+#define IPPROTO_TCP_NUM 6
+#define IPPROTO_UDP_NUM 17
+#define DNS_PORT 53
+#define DNS_HEADER_LEN 12
+
+/// 耗时直方图的桶数,每桶1ns,超出的计入最后一桶
+#define REPLAY_HIST_SIZE 4096
+/// 计时回放中每REPLAY_SAMPLE次查找计时一次
+#define REPLAY_SAMPLE 16
+
+/// 域名来源
+enum name_kind{DNS_NAME=0,HTTP_NAME,TLS_NAME,NAME_KIND_NUM};
+const char *g_name_kind[NAME_KIND_NUM]={"dns","http","tls"};
+
+/// 域名类型名称
+const char *g_domain_type[DOMAIN_TYPE_NUM]={
+	"webpage",
+	"blank",
+	"download",
+	"multimedia",
+	"international",
+	"shopping"
+};
+
+struct option g_opts[]={
+	{"type",required_argument,NULL,'t'},
+	{"db",required_argument,NULL,'D'},
+	{"loops",required_argument,NULL,'n'},
+	{"help",no_argument,NULL,'h'},
+	{NULL,0,NULL,0}
+};
+
+/// 命令行参数
+struct argument
+{
+	const char *path;     ///< pcap文件
+	int type;             ///< 分类的类别,-1为全部类别
+	size_t loops;         ///< 回放次数
+	const char *db_path;  ///< db路径,NULL时使用默认路径
+}g_argu={NULL,-1,1,NULL};
+
+/// pcap文件
+struct pcap_file
+{
+	const unsigned char *data;   ///< 文件内容
+	size_t len;                  ///< 文件长度
+	bool swap;                   ///< 是否需要字节序转换
+	unsigned int linktype;       ///< 链路层类型
+};
+
+/// 回放统计
+struct replay_stat
+{
+	size_t packets;                          ///< 报文数
+	size_t names[NAME_KIND_NUM];             ///< 各来源提取到的域名数
+	size_t lookups;                          ///< 查找次数
+	size_t hits[DOMAIN_TYPE_NUM];            ///< 各类别命中数
+	size_t errors;                           ///< 查找出错次数
+	bool timed;                              ///< 是否对查找抽样计时
+	size_t samples;                          ///< 计时的查找次数
+	uint64_t max_ns;                         ///< 最大耗时
+	size_t hist[REPLAY_HIST_SIZE];           ///< 抽样耗时的直方图
+};
+
+/// db快照及其索引
+struct bc_domain_db g_db;
+struct domain_index g_index[DOMAIN_TYPE_NUM];
+
+static void usage(int err)
+{
+	if(EXIT_SUCCESS!=err)
+		printf("Trye %s -h|--help for more information\n",g_program);
+	else
+	{
+		printf("%s [-t type] [-n loops] file.pcap\n\t 回放pcap文件,测量域名分类性能\n",g_program);
+		printf("\n\t-t|--type type 只对type类别分类,默认全部类别\n");
+		printf("\t-n|--loops n 回放次数,默认1,先不计时回放n次测量吞吐,再抽样计时回放n次测量耗时\n");
+		printf("\t-D|--db path 指定db,可以是bc_domain_names --init创建的文件\n");
+		printf("\t-h|--help 显示本信息\n");
+		printf("\n支持的链路层: ethernet,linux cooked,raw ip,bsd loopback\n");
+	}
+	exit(err);
+}
+
+/// @brief 将字符串解析为domain_type类型
+/// @retval 成功domain_type值, 失败错误代码负值
+static int parse_domain_type(const char *str)
+{
+	int i=0;
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		if(strcasecmp(str,g_domain_type[i])==0)
+			return i;
+	}
+	return -EINVAL;
+}
+
+/// @brief 解析命令行参数
+static void parse_argument(int argc,char **argv)
+{
+	int ch=0;
+	while((ch=getopt_long(argc,argv,":t:n:D:h",g_opts,NULL))!=-1)
+	{
+		switch(ch)
+		{
+			case 'D':
+				g_argu.db_path=optarg;
+				break;
+			case 't':
+				if((g_argu.type=parse_domain_type(optarg))<0)
+				{
+					error_at_line(0,EINVAL,__FILE__,__LINE__,"type error:%s",optarg);
+					usage(EXIT_FAILURE);
+				}
+				break;
+			case 'n':
+				g_argu.loops=strtoul(optarg,NULL,10);
+				if(0==g_argu.loops)
+					usage(EXIT_FAILURE);
+				break;
+			case 'h':
+				usage(EXIT_SUCCESS);
+			case ':':
+				fprintf(stderr,"no argument find for %c\n",optopt);
+				usage(EXIT_FAILURE);
+			default:
+				fprintf(stderr,"no support options:%c\n",optopt);
+				usage(EXIT_FAILURE);
+		}
+	}
+	if(optind>=argc)
+		usage(EXIT_FAILURE);
+	g_argu.path=argv[optind];
+}
+
+/// @brief 读取pcap中的32位整数
+static inline uint32_t pcap_u32(const struct pcap_file *pcap,const unsigned char *p)
+{
+	uint32_t v=0;
+	memcpy(&v,p,sizeof(v));
+	return pcap->swap?__builtin_bswap32(v):v;
+}
+
+/// @brief 读取网络字节序16位整数
+static inline unsigned int be16(const unsigned char *p)
+{
+	return ((unsigned int)p[0]<<8)|p[1];
+}
+
+/// @brief 映射pcap文件并校验文件头
+/// @retval 成功0 失败错误代码负值
+static int open_pcap(const char *path,struct pcap_file *pcap)
+{
+	int fd=-1;
+	struct stat st;
+	uint32_t magic=0;
+	if((fd=open(path,O_RDONLY))<0)
+	{
+		error_at_line(0,errno,__FILE__,__LINE__,"open %s error",path);
+		return -errno;
+	}
+	if(fstat(fd,&st)<0||st.st_size<PCAP_HEADER_LEN)
+	{
+		close(fd);
+		error_at_line(0,EINVAL,__FILE__,__LINE__,"%s is not a pcap file",path);
+		return -EINVAL;
+	}
+	pcap->len=st.st_size;
+	pcap->data=(const unsigned char*)mmap(NULL,pcap->len,PROT_READ,MAP_PRIVATE|MAP_POPULATE,fd,0);
+	close(fd);
+	if(MAP_FAILED==pcap->data)
+	{
+		error_at_line(0,errno,__FILE__,__LINE__,"mmap %s error",path);
+		return -errno;
+	}
+	memcpy(&magic,pcap->data,sizeof(magic));
+	if(PCAP_MAGIC==magic||PCAP_MAGIC_NS==magic)
+		pcap->swap=false;
+	else if(PCAP_MAGIC==__builtin_bswap32(magic)||PCAP_MAGIC_NS==__builtin_bswap32(magic))
+		pcap->swap=true;
+	else
+	{
+		munmap((void*)pcap->data,pcap->len);
+		error_at_line(0,EINVAL,__FILE__,__LINE__,"%s is not a pcap file(pcapng is not supported)",path);
+		return -EINVAL;
+	}
+	pcap->linktype=pcap_u32(pcap,pcap->data+20)&0xffff;
+	return 0;
+}
+
+/// @brief 记录一次查找耗时
+static inline void add_latency(struct replay_stat *stat,uint64_t ns)
+{
+	stat->hist[ns<REPLAY_HIST_SIZE?ns:REPLAY_HIST_SIZE-1]++;
+	stat->samples++;
+	if(ns>stat->max_ns)
+		stat->max_ns=ns;
+}
+
+/// @brief 取单调时钟(ns)
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (uint64_t)ts.tv_sec*1000000000ull+ts.tv_nsec;
+}
+
+/// @brief 对查询键分类,与内核bc_domain_match使用同样的索引查找
+/// 	计时回放中只对每REPLAY_SAMPLE次查找中的一次计时
+static void classify(const struct domain_key *key,struct replay_stat *stat)
+{
+	int type=0;
+	for(type=0;type<DOMAIN_TYPE_NUM;type++)
+	{
+		int err=0;
+		if(g_argu.type>=0&&type!=g_argu.type)
+			continue;
+		if(stat->timed&&0==stat->lookups%REPLAY_SAMPLE)
+		{
+			uint64_t start=now_ns();
+			err=domain_index_match(g_index+type,key);
+			add_latency(stat,now_ns()-start);
+		}
+		else
+			err=domain_index_match(g_index+type,key);
+		stat->lookups++;
+		if(err<0)
+			stat->errors++;
+		else if(err>0)
+			stat->hits[type]++;
+	}
+}
+
+/// @brief 处理UDP负载,提取DNS查询域名
+static void handle_udp(const unsigned char *p,size_t len,struct replay_stat *stat)
+{
+	struct domain_key key;
+	struct dns_qname qname;
+	if(len<8||DNS_PORT!=be16(p+2))
+		return;
+	p+=8;
+	len-=8;
+	/// 只处理查询报文(QR=0,QDCOUNT>0)
+	if(len<=DNS_HEADER_LEN||(p[2]&0x80)||0==be16(p+4))
+		return;
+	if(domain_key_set_qname(&key,&qname,p,len,DNS_HEADER_LEN)<=0)
+		return;
+	stat->names[DNS_NAME]++;
+	classify(&key,stat);
+}
+
+/// @brief 处理TCP负载,提取HTTP Host或TLS SNI
+static void handle_tcp(const unsigned char *p,size_t len,struct replay_stat *stat)
+{
+	size_t off=0;
+	const char *host=NULL;
+	size_t host_len=0;
+	enum name_kind kind=HTTP_NAME;
+	struct domain_key key;
+	if(len<20)
+		return;
+	off=(p[12]>>4)*4;
+	if(off<20||off>=len)
+		return;
+	p+=off;
+	len-=off;
+	/// 依据内容区分TLS与HTTP,不依赖端口
+	if(0x16==p[0])
+	{
+		host=bc_domain_tls_sni(p,len,&host_len);
+		kind=TLS_NAME;
+	}
+	else if(p[0]>='A'&&p[0]<='Z')
+		host=bc_domain_http_host((const char*)p,len,&host_len);
+	if(NULL==host||domain_key_set(&key,host,host_len)<=0)
+		return;
+	stat->names[kind]++;
+	classify(&key,stat);
+}
+
+/// @brief 处理IP报文
+static void handle_ip(const unsigned char *p,size_t len,struct replay_stat *stat)
+{
+	unsigned int proto=0;
+	if(len<1)
+		return;
+	if(4==(p[0]>>4))
+	{
+		size_t hl=(p[0]&0x0f)*4;
+		size_t total=0;
+		if(len<20||hl<20||hl>len)
+			return;
+		/// 只处理首个分片
+		if(be16(p+6)&0x1fff)
+			return;
+		total=be16(p+2);
+		if(total>=hl&&total<len)
+			len=total;
+		proto=p[9];
+		p+=hl;
+		len-=hl;
+	}
+	else if(6==(p[0]>>4))
+	{
+		size_t payload=0;
+		if(len<40)
+			return;
+		payload=be16(p+4);
+		proto=p[6];
+		p+=40;
+		len-=40;
+		if(payload<len)
+			len=payload;
+		/// 跳过扩展头
+		while(0==proto||43==proto||60==proto||44==proto)
+		{
+			size_t ext=0;
+			if(len<8)
+				return;
+			if(44==proto)
+			{
+				if(be16(p+2)&0xfff8)
+					return;
+				ext=8;
+			}
+			else
+				ext=(p[1]+1)*8;
+			if(ext>len)
+				return;
+			proto=p[0];
+			p+=ext;
+			len-=ext;
+		}
+	}
+	else
+		return;
+	if(IPPROTO_UDP_NUM==proto)
+		handle_udp(p,len,stat);
+	else if(IPPROTO_TCP_NUM==proto)
+		handle_tcp(p,len,stat);
+}
+
+/// @brief 处理链路层报文
+static void handle_packet(const struct pcap_file *pcap,const unsigned char *p,size_t len,struct replay_stat *stat)
+{
+	unsigned int ethertype=0;
+	switch(pcap->linktype)
+	{
+		case LINKTYPE_ETHERNET:
+			if(len<14)
+				return;
+			ethertype=be16(p+12);
+			p+=14;
+			len-=14;
+			while((ETHERTYPE_VLAN==ethertype||ETHERTYPE_QINQ==ethertype)&&len>=4)
+			{
+				ethertype=be16(p+2);
+				p+=4;
+				len-=4;
+			}
+			if(ETHERTYPE_IP!=ethertype&&ETHERTYPE_IPV6!=ethertype)
+				return;
+			break;
+		case LINKTYPE_LINUX_SLL:
+			if(len<16)
+				return;
+			p+=16;
+			len-=16;
+			break;
+		case LINKTYPE_NULL:
+			if(len<4)
+				return;
+			p+=4;
+			len-=4;
+			break;
+		case LINKTYPE_RAW:
+			break;
+		default:
+			return;
+	}
+	handle_ip(p,len,stat);
+}
+
+/// @brief 回放一遍pcap文件
+static void replay_pcap(const struct pcap_file *pcap,struct replay_stat *stat)
+{
+	size_t pos=PCAP_HEADER_LEN;
+	while(pos+PCAP_RECORD_LEN<=pcap->len)
+	{
+		size_t caplen=pcap_u32(pcap,pcap->data+pos+8);
+		pos+=PCAP_RECORD_LEN;
+		if(pos+caplen>pcap->len)
+			break;
+		stat->packets++;
+		handle_packet(pcap,pcap->data+pos,caplen,stat);
+		pos+=caplen;
+	}
+}
+
+/// @brief 依据直方图取百分位耗时
+static unsigned int percentile(const struct replay_stat *stat,double p)
+{
+	size_t target=(size_t)(p*stat->samples);
+	size_t sum=0;
+	unsigned int ns=0;
+	if(0==stat->samples)
+		return 0;
+	/// 向上取整
+	if(target<p*stat->samples||0==target)
+		target++;
+	for(ns=0;ns<REPLAY_HIST_SIZE-1;ns++)
+	{
+		sum+=stat->hist[ns];
+		if(sum>=target)
+			break;
+	}
+	return ns;
+}
+
+/// @brief 输出统计结果
+/// @param[in] stat 不计时回放的统计,用于吞吐
+/// @param[in] timed 抽样计时回放的统计,用于耗时
+static void print_stat(const struct replay_stat *stat,const struct replay_stat *timed,double seconds)
+{
+	int i=0;
+	size_t names=0;
+	for(i=0;i<NAME_KIND_NUM;i++)
+		names+=stat->names[i];
+	printf("packets:%zu names:%zu",stat->packets,names);
+	for(i=0;i<NAME_KIND_NUM;i++)
+		printf(" %s:%zu",g_name_kind[i],stat->names[i]);
+	printf(" loops:%zu\n",g_argu.loops);
+	printf("elapsed:%.3fs packets/sec:%.0f lookups/sec:%.0f errors:%zu\n",
+			seconds,seconds>0?stat->packets/seconds:0,
+			seconds>0?stat->lookups/seconds:0,stat->errors);
+	printf("%-16s%s\n","type","hits");
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		if(g_argu.type>=0&&i!=g_argu.type)
+			continue;
+		printf("%-16s%zu\n",g_domain_type[i],stat->hits[i]);
+	}
+	printf("latency(ns) p50:%u p90:%u p99:%u p99.9:%u max:%llu samples:%zu(1/%d)\n",
+			percentile(timed,0.5),percentile(timed,0.9),percentile(timed,0.99),
+			percentile(timed,0.999),(unsigned long long)timed->max_ns,
+			timed->samples,REPLAY_SAMPLE);
+}
+
+/// @brief 依据db快照建立各类别索引
+/// @retval 成功0 失败错误代码负值
+static int build_index(void)
+{
+	int i=0;
+	int err=0;
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		size_t cap=g_db.domain_names.domain_type_max_len[i];
+		if((err=init_domain_index(g_index+i,domain_index_bucket_num(cap),cap))<0)
+			return err;
+		if((err=domain_index_build(g_index+i,&g_db,i))<0)
+			return err;
+	}
+	return 0;
+}
+
+int main(int argc,char **argv)
+{
+	int err=0;
+	size_t i=0;
+	struct pcap_file pcap;
+	struct replay_stat stat;
+	struct replay_stat timed;
+	double seconds=0;
+	uint64_t start=0;
+	parse_argument(argc,argv);
+	memset(&stat,0,sizeof(stat));
+	memset(&timed,0,sizeof(timed));
+	timed.timed=true;
+	/// 载入db并建立索引
+	if((err=load_bc_domain_db(NULL==g_argu.db_path?get_bc_domain_db_path():g_argu.db_path,
+					&g_db))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"bc_domain_db load error");
+		return EXIT_FAILURE;
+	}
+	if((err=build_index())<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"build index error");
+		return EXIT_FAILURE;
+	}
+	if(open_pcap(g_argu.path,&pcap)<0)
+		return EXIT_FAILURE;
+	/// 不计时回放,吞吐不含计时的开销
+	start=now_ns();
+	for(i=0;i<g_argu.loops;i++)
+		replay_pcap(&pcap,&stat);
+	seconds=(now_ns()-start)/1e9;
+	/// 抽样计时回放,只用于耗时分布
+	for(i=0;i<g_argu.loops;i++)
+		replay_pcap(&pcap,&timed);
+	print_stat(&stat,&timed,seconds);
+	munmap((void*)pcap.data,pcap.len);
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+		destory_domain_index(g_index+i);
+	unload_bc_domain_db(&g_db);
+	return 0;
+}
@@ -3,13 +3,36 @@
 #include <linux/kernel.h>
 #include <linux/types.h>
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/percpu.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/random.h>
 #include <linux/uaccess.h>
+#include <linux/workqueue.h>
+#include <linux/cpumask.h>
+#include <linux/ktime.h>
+#include <linux/sort.h>
+#include <linux/ctype.h>
 
 #include "bc_domain_search.h"
 #include "bc_domain_names.h"
+#include "bc_domain_index.h"
+#include "bc_domain_glob.h"
+/// 跟踪点在本文件中实例化
+#define CREATE_TRACE_POINTS
+#include "bc_domain_trace.h"
 
 #define NAME "bc_domain_mem"
 #define BC_DOMAIN_MEM_VERSION "v1.0"
+/// 统计信息proc文件
+#define STATS_PROC_NAME "bc_domain_stats"
+/// 每个cpu的结果缓存项个数,必须为2的幂
+#define DOMAIN_CACHE_SIZE 512
+/// 完全重建时每个工作项复制的记录个数
+#define DOMAIN_BUILD_CHUNK 256
+/// 每个cpu每个类别保留的未匹配域名个数,也是proc文件中每个类别输出的个数
+#define DOMAIN_MISS_SLOTS 32
 
 MODULE_AUTHOR("hzy(hzy.oop@gmail.com) bingchuan inc");
 MODULE_DESCRIPTION("a module support bingchuan domains cache and quick search");
@@ -20,248 +43,709 @@ struct bc_domain_db db;
 /// proc文件
 struct proc_dir_entry *mem_proc=NULL;
 struct proc_dir_entry *dir_proc=NULL;
+struct proc_dir_entry *stats_proc=NULL;
+struct proc_dir_entry *hits_proc=NULL;
+struct proc_dir_entry *misses_proc=NULL;
 /// proc文件内容
 char *read_buf=NULL;
 size_t temp=0;
 
-/// hash表
-struct domain_hash
+/// db的存储方式,bigmem或region
+static char *backend="bigmem";
+module_param(backend,charp,0444);
+MODULE_PARM_DESC(backend,"db storage: bigmem(mapped via /dev/mem) or region(mapped via /dev/"REGION_DEV_NAME")");
+
+/// 是否为每个NUMA节点复制一份查找索引
+static bool numa_replicas=false;
+module_param(numa_replicas,bool,0444);
+MODULE_PARM_DESC(numa_replicas,"replicate the lookup index onto every online numa node");
+/// 是否启用每个cpu的结果缓存,测试索引本身的性能时可以关闭
+static bool result_cache=true;
+module_param(result_cache,bool,0644);
+MODULE_PARM_DESC(result_cache,"cache recent match results per cpu");
+/// 是否统计各记录的命中次数,用于找出从不匹配的记录
+static bool hit_counters=false;
+module_param(hit_counters,bool,0644);
+MODULE_PARM_DESC(hit_counters,"count matches per record, read by bc_domain_names --hits");
+/// 是否统计各类别查询最多的未匹配域名,用于找出列表中缺少的热门域名
+static bool miss_sketch=false;
+module_param(miss_sketch,bool,0644);
+MODULE_PARM_DESC(miss_sketch,"keep a per-cpu space-saving sketch of frequently missed names, read by bc_domain_names --misses");
+/// 是否以压缩trie代替最小完美哈希,域名不再复制到索引中
+static bool trie_index=false;
+module_param(trie_index,bool,0444);
+MODULE_PARM_DESC(trie_index,"look up published names in the compressed trie instead of copying them into the hash index");
+
+/// 单个NUMA节点上的索引副本,内存与锁都位于该节点
+struct domain_db_replica
 {
-	struct hlist_head *head;
-	size_t len;
+	struct domain_index hashs[DOMAIN_TYPE_NUM];
+	struct domain_index shadow[DOMAIN_TYPE_NUM];   ///< 完全重建写入的私有索引,发布时与hashs交换
+	spinlock_t lock;
+	int node;
 };
 
-/// hash node
-struct domain_hash_entry
+/// 每个cpu一个类别的Space-Saving统计,只保留DOMAIN_MISS_SLOTS个未匹配域名
+/// 	未命中已有的项时替换计数最小的项,新项的计数为被替换的计数加1,误差为被替换的计数;
+/// 	每次未匹配只比较DOMAIN_MISS_SLOTS个哈希值,替换时才复制域名
+struct domain_miss_sketch
 {
-	struct hlist_node node;
-	size_t index;
+	u64 hash[DOMAIN_MISS_SLOTS];          ///< hash_key_seed(key,cache_seed)
+	unsigned int count[DOMAIN_MISS_SLOTS];   ///< 次数,0表示空项
+	unsigned int error[DOMAIN_MISS_SLOTS];   ///< 次数的最大高估值
+	unsigned char len[DOMAIN_MISS_SLOTS];
+	char name[DOMAIN_MISS_SLOTS][DOMAIN_MAX_LENGTH];   ///< 小写的点分格式,不以'\0'结尾
 };
 
 /// @breif 域名db的hash结构
 struct domain_db_hash
 {
-	struct domain_hash hashs[DOMAIN_TYPE_NUM];
-	spinlock_t lock;
+	struct domain_db_replica *primary;                ///< 从db重建的副本
+	struct domain_db_replica *replicas[MAX_NUMNODES]; ///< 各节点查找使用的副本,未复制时指向primary
+	int replica_num;                                  ///< 副本个数
+	unsigned int generation;   ///< 每次重建或应用日志后加1,使各cpu的结果缓存整体失效
+	unsigned long long journal_seq;   ///< 已应用的最后一条修改日志的序号
+	unsigned long journal_applied;    ///< 已应用的日志条数
+	unsigned long rebuilds;           ///< 完全重建的次数
+	spinlock_t update_lock;           ///< 同一时刻只有一个cpu更新索引
+	struct work_struct rebuild_work;  ///< 完全重建,在进程上下文中执行
+	bool rebuilding;                  ///< 完全重建已排队或正在执行,期间不应用日志
+	/// 各记录每个cpu的命中次数,下标为记录下标,最后一项为通配规则,
+	/// 记录重新编号的完全重建时清零
+	unsigned int __percpu *hits[DOMAIN_TYPE_NUM];
+	/// 各类别每个cpu的未匹配域名统计,读取时合并
+	struct domain_miss_sketch __percpu *misses[DOMAIN_TYPE_NUM];
 }db_hash;
 
+/// 结果缓存项,以64位哈希和长度为键,不保存域名本身
+struct domain_cache_entry
+{
+	u64 hash;                  ///< hash_key_seed(key,cache_seed)
+	unsigned int generation;   ///< 写入时db_hash的代数
+	short record;              ///< domain_index_lookup的结果,命中缓存时同样计数
+	unsigned char len;         ///< 域名长度,小于DOMAIN_MAX_LENGTH
+	unsigned char type;        ///< 域名类别
+};
 
-/// @breif 初始化domain_hash结构
-/// @param[in] len初始哈希大小
-/// @retval 成功0 错误返回错误码的负值
-static int init_domain_hash(struct domain_hash *hash,size_t len)
+/// 完全重建的工作项,复制一个类别中一个区间的记录
+struct domain_build_work
 {
-	int i=0;
+	struct work_struct work;
+	enum domain_type type;
+	size_t start;
+	size_t end;
+	int chained;            ///< domain_index_build_range的结果
+};
 
-	if(NULL==hash)
-		return 0;
-	if(0==len)
+/// 每个cpu的直接映射结果缓存,命中时不访问共享的哈希表
+struct domain_cache
+{
+	struct domain_cache_entry entries[DOMAIN_CACHE_SIZE];
+	unsigned long hits;        ///< 命中次数
+	unsigned long misses;      ///< 未命中次数
+};
+static DEFINE_PER_CPU(struct domain_cache,domain_cache);
+/// 结果缓存的哈希种子,每次载入模块时随机选取
+static unsigned int cache_seed __read_mostly;
+
+/// @brief 在节点node上分配并初始化索引副本
+static struct domain_db_replica *alloc_domain_db_replica(int node)
+{
+	struct domain_db_replica *replica=NULL;
+	/// trie索引的keys和哈希链数组在重建时按trie之后的记录数分配
+	int (*init_index)(struct domain_index*,size_t,size_t,int)=
+		trie_index?init_domain_index_trie:init_domain_index_node;
+	int i=0;
+	int cur_hash=0;
+	if((replica=kzalloc_node(sizeof(*replica),GFP_KERNEL,node))==NULL)
+		return NULL;
+	/// 初始化哈希
+	for(cur_hash=0;cur_hash<DOMAIN_TYPE_NUM;cur_hash++)
 	{
-		hash->len=0;
-		hash->head=NULL;
+		size_t cap=db.domain_names.domain_type_max_len[cur_hash];
+		if(init_index(replica->hashs+cur_hash,
+					domain_index_bucket_num(cap),cap,node)<0)
+		{
+			printk(KERN_ERR "%s: init hash %d on node %d error\n",NAME,cur_hash,node);
+			goto clean_hash;
+		}
+		if(init_index(replica->shadow+cur_hash,
+					domain_index_bucket_num(cap),cap,node)<0)
+		{
+			printk(KERN_ERR "%s: init shadow %d on node %d error\n",NAME,cur_hash,node);
+			destory_domain_index(replica->hashs+cur_hash);
+			goto clean_hash;
+		}
 	}
-	/// 分配内存
-	hash->head=(struct hlist_head*)kmalloc(sizeof(struct domain_hash)*len,GFP_ATOMIC);
-	if(NULL==hash->head)
+	/// 初始化锁
+	spin_lock_init(&replica->lock);
+	replica->node=node;
+	return replica;
+clean_hash:
+	for(i=0;i<cur_hash;i++)
 	{
-		hash->len=0;
-		return -ENOMEM;
+		destory_domain_index(replica->hashs+i);
+		destory_domain_index(replica->shadow+i);
 	}
-	hash->len=len;
-	/// 初始化
-	for(i=0;i<hash->len;i++)
-		INIT_HLIST_HEAD(hash->head+i);
-	return 0;
+	kfree(replica);
+	return NULL;
 }
 
-/// @breif 添加index到hash
-/// @param[in] key hash函数求得的key值
-/// @param[in] index 哈希内容
-static int add_domain_hash(struct domain_hash *hash,int key,size_t index)
+/// @brief 销毁索引副本,并释放内存
+static void free_domain_db_replica(struct domain_db_replica *replica)
 {
-	struct domain_hash_entry *entry=NULL;
-	if(NULL==hash||0==hash->len||NULL==hash->head)
-		return -EINVAL;
-	/// 加入hash
-	key=key%hash->len;
-	entry=(struct domain_hash_entry*)kmalloc(sizeof(struct domain_hash_entry),GFP_ATOMIC);
-	if(NULL==entry)
-		return -ENOMEM;
-	entry->index=index;
-	hlist_add_head(&entry->node,hash->head+key);
-	return 0;
-}
-
-/// @breif 清除hash表中内容
-static void clean_domain_hash(struct domain_hash *hash)
-{
-	int i;
-	if(NULL==hash)
+	int i=0;
+	if(NULL==replica)
 		return;
-	/// 清除哈希内容
-	for(i=0;i<hash->len;++i)
+	for(i=0;i<DOMAIN_TYPE_NUM;++i)
 	{
-		struct hlist_head *p=hash->head+i;
-		while(!hlist_empty(p))
-		{
-			struct hlist_node *n=p->first;
-			hlist_del(n);
-			kfree(hlist_entry_safe(n,struct domain_hash_entry,node));
-		}
+		destory_domain_index(replica->hashs+i);
+		destory_domain_index(replica->shadow+i);
 	}
+	kfree(replica);
 }
 
-/// @brief 销毁domain_hash结构
-static void destory_domain_hash(struct domain_hash *hash)
+/// @brief 销毁db_hash,并释放内存
+static void destory_domain_db_hash(void)
 {
-	clean_domain_hash(hash);
-	/// 销毁head数组
-	kfree(hash->head);
-	hash->head=NULL;
-	hash->len=0;
+	int node=0;
+	for(node=0;node<MAX_NUMNODES;node++)
+	{
+		if(db_hash.replicas[node]!=db_hash.primary)
+			free_domain_db_replica(db_hash.replicas[node]);
+		db_hash.replicas[node]=NULL;
+	}
+	free_domain_db_replica(db_hash.primary);
+	db_hash.primary=NULL;
+	db_hash.replica_num=0;
+	for(node=0;node<DOMAIN_TYPE_NUM;node++)
+	{
+		free_percpu(db_hash.hits[node]);
+		db_hash.hits[node]=NULL;
+		free_percpu(db_hash.misses[node]);
+		db_hash.misses[node]=NULL;
+	}
 }
 
 /// @brief 初始化db_hash
+/// 	开启numa_replicas时在每个在线节点上各建立一份副本
 static int init_domain_db_hash(void)
 {
-	const int HASH_MAX_SIZE=2048;    /// 哈希最大大小
-	size_t hash_len[DOMAIN_TYPE_NUM];
+	int node=0;
 	int i=0;
-	int cur_hash=0;
-	int err=0;
-	/// 计算哈希表大小
+	spin_lock_init(&db_hash.update_lock);
+	db_hash.rebuilding=false;
+	db_hash.journal_seq=0;
+	if((db_hash.primary=alloc_domain_db_replica(numa_node_id()))==NULL)
+		return -ENOMEM;
+	/// 命中计数和未匹配统计始终分配,每个cpu每条记录4字节,每个类别约4.6KB,
+	/// 运行时可开关hit_counters和miss_sketch
 	for(i=0;i<DOMAIN_TYPE_NUM;i++)
 	{
-		hash_len[i]=db.domain_names.domain_type_max_len[i];
-		hash_len[i]=hash_len[i]>HASH_MAX_SIZE?HASH_MAX_SIZE:hash_len[i];
+		size_t size=(db.domain_names.domain_type_max_len[i]+1)*sizeof(unsigned int);
+		if((db_hash.hits[i]=__alloc_percpu(size,sizeof(unsigned int)))==NULL||
+				(db_hash.misses[i]=alloc_percpu(struct domain_miss_sketch))==NULL)
+		{
+			destory_domain_db_hash();
+			return -ENOMEM;
+		}
 	}
-	/// 初始化哈希
-	for(cur_hash=0;cur_hash<DOMAIN_TYPE_NUM;cur_hash++)
+	db_hash.replica_num=1;
+	for(node=0;node<MAX_NUMNODES;node++)
+		db_hash.replicas[node]=db_hash.primary;
+	if(!numa_replicas)
+		return 0;
+	for_each_online_node(node)
 	{
-		if((err=init_domain_hash(db_hash.hashs+cur_hash,hash_len[cur_hash]))<0)
+		struct domain_db_replica *replica=NULL;
+		if(node==db_hash.primary->node)
+			continue;
+		if((replica=alloc_domain_db_replica(node))==NULL)
 		{
-			printk(KERN_ERR "%s: init hash %d error\n",NAME,cur_hash);
-			goto clean_hash;
+			destory_domain_db_hash();
+			return -ENOMEM;
 		}
+		db_hash.replicas[node]=replica;
+		db_hash.replica_num++;
 	}
-	/// 初始化锁
-	spin_lock_init(&db_hash.lock);
 	return 0;
-clean_hash:
-	for(i=0;i<cur_hash;i++)
-		destory_domain_hash(db_hash.hashs+i);
-	return err;
 }
 
-/// @brief 销毁db_hash,并释放内存
-static void destory_domain_db_hash(void)
+/// @brief 清零type类别的命中计数
+/// @param[in] index 记录下标,负值时清零该类别的全部计数
+/// 	与计数并发执行时可能遗漏少量命中,计数本身即为近似值
+static void reset_domain_hits(enum domain_type type,int index)
 {
-	int i=0;
-	spin_lock_bh(&db_hash.lock);
-	for(i=0;i<DOMAIN_TYPE_NUM;++i)
-		destory_domain_hash(db_hash.hashs+i);
-	spin_unlock_bh(&db_hash.lock);
+	size_t num=db.domain_names.domain_type_max_len[type]+1;
+	int cpu=0;
+	for_each_possible_cpu(cpu)
+	{
+		unsigned int *hits=per_cpu_ptr(db_hash.hits[type],cpu);
+		if(index<0)
+			memset(hits,0,num*sizeof(unsigned int));
+		else if((size_t)index<num)
+			WRITE_ONCE(hits[index],0);
+	}
+}
+
+/// @brief 记录一次匹配
+static inline void count_domain_hit(enum domain_type type,int record)
+{
+	if(!READ_ONCE(hit_counters)||DOMAIN_INDEX_MISS==record)
+		return;
+	if(DOMAIN_INDEX_GLOB==record)
+		record=db.domain_names.domain_type_max_len[type];
+	this_cpu_inc(db_hash.hits[type][record]);
 }
 
-/// @brief 计算哈希值
-static size_t hash_key_str(const char *str)
+/// @brief 清零type类别的未匹配域名统计
+static void reset_domain_misses(enum domain_type type)
 {
-	unsigned int hash=1315423911;
-	while(*str)
+	int cpu=0;
+	for_each_possible_cpu(cpu)
 	{
-		hash^=((hash<<5)+(*str++)+(hash>>2));
+		struct domain_miss_sketch *sketch=per_cpu_ptr(db_hash.misses[type],cpu);
+		local_bh_disable();
+		memset(sketch->count,0,sizeof(sketch->count));
+		local_bh_enable();
 	}
-	return hash;
 }
 
-/// @brief 依据bc_domain_db建立 哈希表
-static void build_domain_db_hash(void)
+/// @brief 记录一次未匹配,在本cpu的统计中增加计数或替换计数最小的项
+/// @param[in] hash hash_key_seed(key,cache_seed),为0时在此计算
+static void count_domain_miss(const struct domain_key *key,enum domain_type type,int record,u64 hash)
 {
-	int i=0,j=0;
-	int err=0;
-	for(i=0;i<DOMAIN_TYPE_NUM;++i)
+	struct domain_miss_sketch *sketch=NULL;
+	size_t len=0;
+	int min=0;
+	int i=0;
+	if(!READ_ONCE(miss_sketch)||DOMAIN_INDEX_MISS!=record)
+		return;
+	if(0==hash)
+		hash=hash_key_seed(key,cache_seed);
+	/// 软中断中也会查找,需关闭下半部
+	local_bh_disable();
+	sketch=this_cpu_ptr(db_hash.misses[type]);
+	for(i=0;i<DOMAIN_MISS_SLOTS;i++)
 	{
-		/// 读取域名
-		spin_lock_bh(&db_hash.lock);
-		for(j=0;j<get_domain_name_num(&db,i);j++)
+		if(sketch->count[i]>0&&sketch->hash[i]==hash&&sketch->len[i]==key->len)
 		{
-			struct domain_name name;
-			size_t key=0;
-			if((err=get_domain_name(&name,&db,i,j))<0)
-				continue;
-			if(!name.is_vaild)
-				continue;
-			key=hash_key_str(name.name);
-			add_domain_hash(db_hash.hashs+i,key,j);
+			sketch->count[i]++;
+			goto out;
 		}
-		spin_unlock_bh(&db_hash.lock);
+		if(sketch->count[i]<sketch->count[min])
+			min=i;
 	}
+	/// 替换计数最小的项,空项的计数为0
+	sketch->error[min]=sketch->count[min];
+	sketch->count[min]++;
+	sketch->hash[min]=hash;
+	len=domain_key_copy(key,sketch->name[min]);
+	/// 线格式的标签可以含任意字节,空白和不可打印的字节以'?'代替,使proc文件每行可以按空白分隔
+	for(i=0;i<len;i++)
+		sketch->name[min][i]=isgraph(sketch->name[min][i])?tolower(sketch->name[min][i]):'?';
+	sketch->len[min]=len;
+out:
+	local_bh_enable();
 }
 
-/// @brief 清除bc_domain_hash中内容
-static void clean_domain_db_hash(void)
+/// @brief 复制一个区间的记录到primary的私有索引
+static void domain_build_work_fn(struct work_struct *work)
 {
+	struct domain_build_work *w=container_of(work,struct domain_build_work,work);
+	w->chained=domain_index_build_range(db_hash.primary->shadow+w->type,&db,w->type,w->start,w->end);
+}
+
+/// @brief 依据bc_domain_db建立 哈希表,只能在进程上下文中调用
+/// 	载入用户程序编译的最小完美哈希索引,只有发布后追加的域名进入哈希链
+/// 	各类别的记录按DOMAIN_BUILD_CHUNK分段,分给在线的cpu复制到私有索引,
+/// 	全部完成后在各副本的锁内交换,关闭下半部的时间与记录数无关
+static void build_domain_db_hash(void)
+{
+	struct domain_db_replica *primary=db_hash.primary;
+	struct domain_build_work *works=NULL;
+	size_t chained[DOMAIN_TYPE_NUM];
+	size_t total=0;
+	size_t records=0;
+	size_t n=0;
+	u64 start=ktime_get_ns();
+	int num[DOMAIN_TYPE_NUM];
+	int cpu=-1;
+	int node=0;
 	int i=0;
 	for(i=0;i<DOMAIN_TYPE_NUM;++i)
 	{
-		spin_lock_bh(&db_hash.lock);
-		clean_domain_hash(db_hash.hashs+i);
-		spin_unlock_bh(&db_hash.lock);
+		chained[i]=0;
+		if((num[i]=domain_index_build_begin(primary->shadow+i,&db,i))<0)
+			num[i]=0;
+		total+=DIV_ROUND_UP(num[i],DOMAIN_BUILD_CHUNK);
+		records+=num[i];
+	}
+	trace_bc_domain_rebuild_start(records,total);
+	works=kcalloc(total,sizeof(*works),GFP_KERNEL);
+	for(i=0;i<DOMAIN_TYPE_NUM;++i)
+	{
+		size_t start=0;
+		for(start=0;start<num[i];start+=DOMAIN_BUILD_CHUNK)
+		{
+			size_t end=min_t(size_t,start+DOMAIN_BUILD_CHUNK,num[i]);
+			int ret=0;
+			/// 内存不足时在本cpu上依次复制
+			if(NULL==works)
+			{
+				if((ret=domain_index_build_range(primary->shadow+i,&db,i,start,end))>0)
+					chained[i]+=ret;
+				cond_resched();
+				continue;
+			}
+			works[n].type=i;
+			works[n].start=start;
+			works[n].end=end;
+			INIT_WORK(&works[n].work,domain_build_work_fn);
+			if((cpu=cpumask_next(cpu,cpu_online_mask))>=nr_cpu_ids)
+				cpu=cpumask_first(cpu_online_mask);
+			queue_work_on(cpu,system_wq,&works[n].work);
+			n++;
+		}
+	}
+	for(i=0;i<n;i++)
+	{
+		flush_work(&works[i].work);
+		if(works[i].chained>0)
+			chained[works[i].type]+=works[i].chained;
+	}
+	kfree(works);
+	for(i=0;i<DOMAIN_TYPE_NUM;++i)
+		domain_index_build_end(primary->shadow+i,chained[i]);
+	/// 其余节点的副本在私有内存中复制,不再读取db
+	for(node=0;node<MAX_NUMNODES;node++)
+	{
+		struct domain_db_replica *replica=db_hash.replicas[node];
+		if(NULL==replica||replica==primary)
+			continue;
+		for(i=0;i<DOMAIN_TYPE_NUM;++i)
+			if(domain_index_copy(replica->shadow+i,primary->shadow+i)<0)
+				printk(KERN_ERR "%s: copy index %d to node %d error\n",NAME,i,replica->node);
+	}
+	/// 发布:交换索引结构,原有的索引成为下次重建的私有内存
+	for(node=-1;node<MAX_NUMNODES;node++)
+	{
+		struct domain_db_replica *replica=node<0?primary:db_hash.replicas[node];
+		if(NULL==replica||(node>=0&&replica==primary))
+			continue;
+		spin_lock_bh(&replica->lock);
+		for(i=0;i<DOMAIN_TYPE_NUM;++i)
+			swap(replica->hashs[i],replica->shadow[i]);
+		spin_unlock_bh(&replica->lock);
+	}
+	/// 发布和整理会重新排列记录,原有计数不再对应
+	for(i=0;i<DOMAIN_TYPE_NUM;++i)
+		reset_domain_hits(i,-1);
+	if(trace_bc_domain_rebuild_end_enabled())
+	{
+		for(i=0,total=0;i<DOMAIN_TYPE_NUM;++i)
+			total+=chained[i];
+		trace_bc_domain_rebuild_end(records,total,ktime_get_ns()-start);
 	}
 }
 
-/// @breif 依据hash结构对域名进行查找
-/// @retval 匹配成功1 匹配失败-1 出错-1
-int bc_domain_match(const char *domain,enum domain_type type)
+/// @brief 完全重建的工作函数
+/// 	先清除更新标识再读取头部,重建期间用户程序再次发布时重建完成后重新排队
+static void domain_rebuild_work_fn(struct work_struct *work)
 {
 	int err=0;
-	size_t key=0;
-	struct hlist_head *head=NULL;
-	struct domain_hash_entry *entry;
-	//struct hash_node *n;
-	size_t hash_len=0;
+	spin_lock_bh(&db_hash.update_lock);
+	db.domain_names.is_update=false;
+	if((err=write_domain_db(&db,offsetof(struct bc_domain_names,is_update),
+					&db.domain_names.is_update,sizeof(db.domain_names.is_update)))>=0)
+		err=read_domain_db(&db,0,&db.domain_names,sizeof(db.domain_names));
+	spin_unlock_bh(&db_hash.update_lock);
+	if(err<0)
+	{
+		printk(KERN_ERR "%s: read db header for rebuild error %d\n",NAME,err);
+		trace_bc_domain_error(DOMAIN_TRACE_REBUILD,err);
+		WRITE_ONCE(db_hash.rebuilding,false);
+		return;
+	}
+	/// 先读取序号再读取记录
+	smp_rmb();
+	build_domain_db_hash();
+	/// 重建读取的记录已包含头部序号之前的全部修改
+	spin_lock_bh(&db_hash.update_lock);
+	db_hash.rebuilds++;
+	WRITE_ONCE(db_hash.journal_seq,db.domain_names.journal_seq);
+	/// 交换完成后再使缓存失效,重建期间写入的缓存项也随之作废
+	WRITE_ONCE(db_hash.generation,db_hash.generation+1);
+	WRITE_ONCE(db_hash.rebuilding,false);
+	spin_unlock_bh(&db_hash.update_lock);
+}
 
-	/// 判断type是否合法
-	if(type<0||type>=DOMAIN_TYPE_NUM)
+/// @brief 对所有副本应用一条修改日志
+/// @retval 成功0 需要完全重建时错误代码负值
+static int apply_domain_journal_entry(const struct domain_journal_entry *entry)
+{
+	struct domain_name name;
+	bool is_add=false;
+	int node=0;
+	int err=0;
+	if(entry->type>=DOMAIN_TYPE_NUM)
 		return -EINVAL;
-	/// 判断是否需要重建hash
-	if((err=read_bigmem_bh(&db.mem,0,&db.domain_names,sizeof(db.domain_names)))<0)
+	if(DOMAIN_JOURNAL_ADD==entry->op)
+	{
+		/// 记录之后可能又被删除,以db中的当前内容为准
+		if((err=get_domain_name(&name,&db,entry->type,entry->index))<0)
+			return err;
+		is_add=name.is_vaild;
+	}
+	else if(DOMAIN_JOURNAL_DEL!=entry->op)
+		return -EINVAL;
+	/// 增加的记录可能复用已删除记录的下标
+	reset_domain_hits(entry->type,entry->index);
+	for(node=-1;node<MAX_NUMNODES&&err>=0;node++)
+	{
+		/// node为-1时为primary,其余为不同于primary的副本
+		struct domain_db_replica *replica=node<0?db_hash.primary:db_hash.replicas[node];
+		struct domain_index *idx=NULL;
+		if(NULL==replica||(node>=0&&replica==db_hash.primary))
+			continue;
+		idx=replica->hashs+entry->type;
+		spin_lock_bh(&replica->lock);
+		if(is_add)
+			err=domain_index_insert(idx,entry->index,name.name);
+		else
+			domain_index_remove(idx,entry->index);
+		spin_unlock_bh(&replica->lock);
+	}
+	return err;
+}
+
+/// @brief 依次应用序号在(db_hash.journal_seq,seq]之间的修改日志
+/// @retval 成功0 日志已被覆盖或无法增量更新时错误代码负值
+static int apply_domain_journal(unsigned long long seq)
+{
+	unsigned long long cur=db_hash.journal_seq;
+	int err=0;
+	/// 落后超过环的大小,或db被重新初始化
+	if(seq-cur>DOMAIN_JOURNAL_SIZE)
+		return -EAGAIN;
+	for(cur++;cur<=seq;cur++)
+	{
+		struct domain_journal_entry entry;
+		if((err=read_domain_journal(&db,cur,&entry))<0)
+			return err;
+		if(entry.seq!=cur)
+			return -EAGAIN;
+		if((err=apply_domain_journal_entry(&entry))<0)
+			return err;
+		WRITE_ONCE(db_hash.journal_seq,cur);
+		db_hash.journal_applied++;
+	}
+	return 0;
+}
+
+/// @brief 判断是否需要更新hash
+/// 	依据修改日志增量更新,用户程序设置更新标识或日志无法应用时,
+/// 	在工作队列中完全重建,完成前继续使用当前索引
+/// @retval 成功0 失败错误代码负值
+static int check_domain_db_update(void)
+{
+	struct bc_domain_names head;
+	const size_t off=offsetof(struct bc_domain_names,is_update);
+	const size_t end=offsetof(struct bc_domain_names,journal_seq)+sizeof(head.journal_seq);
+	unsigned long long applied=0;
+	int err=0;
+	if(READ_ONCE(db_hash.rebuilding))
+		return 0;
+	/// 每次查找只读取更新标识和日志序号,有变化时才读取整个头部
+	if((err=read_domain_db(&db,off,(char*)&head+off,end-off))<0)
+	{
+		trace_bc_domain_error(DOMAIN_TRACE_HEAD,err);
 		return err;
-	if(db.domain_names.is_update)
-	{
-		clean_domain_db_hash();
-		build_domain_db_hash();
-	}
-	/// 查找是否匹配
-	err=0;    ///< 默认不匹配
-	key=hash_key_str(domain);
-	spin_lock_bh(&db_hash.lock);
-	hash_len=db_hash.hashs[type].len;
-	head=db_hash.hashs[type].head;
-	if(0==hash_len||NULL==head)
+	}
+	if(!head.is_update&&head.journal_seq==READ_ONCE(db_hash.journal_seq))
+		return 0;
+	/// 其他cpu正在更新时继续使用当前索引
+	if(!spin_trylock_bh(&db_hash.update_lock))
+		return 0;
+	if(db_hash.rebuilding)
 		goto unlock;
-	key%=hash_len;
-	head+=key;
-	hlist_for_each_entry(entry,head,node)
+	if((err=read_domain_db(&db,0,&db.domain_names,sizeof(db.domain_names)))<0)
 	{
-		size_t index=entry->index;
-		struct domain_name name;
-		if((err=get_domain_name(&name,&db,type,index))<0)
-			goto unlock;
-		if(!name.is_vaild)
-			continue;
-		if(strcasecmp(name.name,domain)==0)
+		trace_bc_domain_error(DOMAIN_TRACE_HEAD,err);
+		goto unlock;
+	}
+	/// 先读取序号再读取日志和记录
+	smp_rmb();
+	applied=db_hash.journal_seq;
+	if(!db.domain_names.is_update)
+	{
+		int ret=apply_domain_journal(db.domain_names.journal_seq);
+		if(0==ret)
 		{
-			err=1;                     ///< 匹配
-			break;
+			trace_bc_domain_update(false,db.domain_names.journal_seq,applied,false);
+			WRITE_ONCE(db_hash.generation,db_hash.generation+1);
+			goto unlock;
 		}
+		/// 日志被覆盖或无法应用,改为完全重建
+		trace_bc_domain_error(DOMAIN_TRACE_JOURNAL,ret);
 	}
+	trace_bc_domain_update(db.domain_names.is_update,db.domain_names.journal_seq,applied,true);
+	WRITE_ONCE(db_hash.rebuilding,true);
+	queue_work(system_unbound_wq,&db_hash.rebuild_work);
 unlock:
-	spin_unlock_bh(&db_hash.lock);
+	spin_unlock_bh(&db_hash.update_lock);
+	return err;
+}
+
+/// @brief 在本节点副本的type索引中查找key
+/// @param[out] probes 非NULL时给出比较的次数,只在跟踪点启用时传入
+/// @retval 匹配的记录下标 DOMAIN_INDEX_GLOB DOMAIN_INDEX_MISS
+static int domain_replica_find(const struct domain_key *key,enum domain_type type,unsigned int *probes)
+{
+	struct domain_db_replica *replica=db_hash.replicas[numa_node_id()];
+	int err=0;
+	spin_lock_bh(&replica->lock);
+	if(NULL==probes)
+		err=domain_index_lookup(replica->hashs+type,key);
+	else
+		err=domain_index_lookup_probes(replica->hashs+type,key,probes);
+	spin_unlock_bh(&replica->lock);
 	return err;
 }
+
+/// @brief 在type的hash中查找key,先查找本cpu的结果缓存
+/// 	跟踪点未启用时不计时,也不统计比较次数
+/// @retval 匹配成功1 匹配失败0 出错错误代码负值
+static int domain_hash_find(const struct domain_key *key,enum domain_type type)
+{
+	int err=0;
+	u64 hash=0;
+	u64 start=0;
+	unsigned int generation=0;
+	unsigned int probes=0;
+	bool traced=trace_bc_domain_lookup_enabled();
+	size_t slot=0;
+	struct domain_cache *cache=NULL;
+	struct domain_cache_entry *entry=NULL;
+
+	if(traced)
+		start=ktime_get_ns();
+	if(!READ_ONCE(result_cache))
+	{
+		err=domain_replica_find(key,type,traced?&probes:NULL);
+		count_domain_hit(type,err);
+		count_domain_miss(key,type,err,0);
+		if(traced)
+			trace_bc_domain_lookup(type,err,probes,ktime_get_ns()-start,false);
+		return DOMAIN_INDEX_MISS!=err;
+	}
+	hash=hash_key_seed(key,cache_seed);
+	generation=READ_ONCE(db_hash.generation);
+	slot=(size_t)(hash^type)&(DOMAIN_CACHE_SIZE-1);
+	/// 查找本cpu的缓存,软中断中也会查找,需关闭下半部
+	local_bh_disable();
+	cache=this_cpu_ptr(&domain_cache);
+	entry=cache->entries+slot;
+	if(entry->hash==hash&&entry->len==key->len&&entry->type==type
+			&&entry->generation==generation)
+	{
+		cache->hits++;
+		err=entry->record;
+		count_domain_hit(type,err);
+		local_bh_enable();
+		count_domain_miss(key,type,err,hash);
+		if(traced)
+			trace_bc_domain_lookup(type,err,0,ktime_get_ns()-start,true);
+		return DOMAIN_INDEX_MISS!=err;
+	}
+	cache->misses++;
+	local_bh_enable();
+
+	err=domain_replica_find(key,type,traced?&probes:NULL);
+	/// 以查找前读取的代数写入,查找期间发生重建时该项自然失效
+	local_bh_disable();
+	entry=this_cpu_ptr(&domain_cache)->entries+slot;
+	entry->hash=hash;
+	entry->generation=generation;
+	entry->record=err;
+	entry->len=key->len;
+	entry->type=type;
+	count_domain_hit(type,err);
+	local_bh_enable();
+	count_domain_miss(key,type,err,hash);
+	if(traced)
+		trace_bc_domain_lookup(type,err,probes,ktime_get_ns()-start,false);
+	return DOMAIN_INDEX_MISS!=err;
+}
+
+/// @breif 依据hash结构对长度为len的域名进行查找,buf不要求以'\0'结尾
+/// @retval 匹配成功1 匹配失败0 出错错误代码负值
+int bc_domain_match_n(const char *buf,size_t len,enum domain_type type)
+{
+	int err=0;
+	struct domain_key key;
+
+	/// 判断type是否合法
+	if(type<0||type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	if(NULL==buf)
+		return -EINVAL;
+	if(!domain_key_set(&key,buf,len))
+		return 0;
+	if((err=check_domain_db_update())<0)
+		return err;
+	return domain_hash_find(&key,type);
+}
+EXPORT_SYMBOL(bc_domain_match_n);
+
+/// @breif 对DNS报文中线格式的域名进行查找,不转换为点分格式
+/// @param[in] msg,msg_len DNS报文,压缩指针相对于msg解析
+/// @param[in] offset 域名在报文中的偏移
+/// @retval 匹配成功1 匹配失败0 出错错误代码负值
+int bc_domain_match_qname(const unsigned char *msg,size_t msg_len,size_t offset,enum domain_type type)
+{
+	int err=0;
+	struct dns_qname qname;
+	struct domain_key key;
+
+	if(type<0||type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	if((err=domain_key_set_qname(&key,&qname,msg,msg_len,offset))<=0)
+		return err;
+	if((err=check_domain_db_update())<0)
+		return err;
+	return domain_hash_find(&key,type);
+}
+EXPORT_SYMBOL(bc_domain_match_qname);
+
+/// @breif 依据hash结构对域名进行查找
+/// @retval 匹配成功1 匹配失败0 出错错误代码负值
+int bc_domain_match(const char *domain,enum domain_type type)
+{
+	if(NULL==domain)
+		return -EINVAL;
+	return bc_domain_match_n(domain,strnlen(domain,DOMAIN_MAX_LENGTH),type);
+}
 EXPORT_SYMBOL(bc_domain_match);
 
+/// @breif 复制type类别下标为index的记录的域名,供测试模块构造查询
+/// @retval 成功返回域名长度 无效记录和通配规则返回0 下标越界返回-ERANGE 出错错误代码负值
+int bc_domain_get_name(enum domain_type type,size_t index,char *buf,size_t len)
+{
+	struct domain_name name;
+	int err=0;
+	if(type<0||type>=DOMAIN_TYPE_NUM||NULL==buf||0==len)
+		return -EINVAL;
+	if(index>=get_domain_name_num(&db,type))
+		return -ERANGE;
+	if((err=get_domain_name(&name,&db,type,index))<0)
+		return err;
+	if(!name.is_vaild||is_domain_glob(name.name))
+		return 0;
+	return strscpy(buf,name.name,len)<0?-E2BIG:strlen(buf);
+}
+EXPORT_SYMBOL(bc_domain_get_name);
+
 
 /// @brief mem proc文件的读函数
 ssize_t proc_mem_read(struct file *f,char *buf,size_t count,loff_t *offp)
@@ -283,6 +767,284 @@ static const struct file_operations fops={
 };
 
 
+/// @brief 输出各类别索引的结构统计
+static void proc_stats_show_index(struct seq_file *m)
+{
+	struct domain_db_replica *primary=db_hash.primary;
+	int i=0;
+	seq_printf(m,"type records live tombstones mph_slots chained buckets load max_chain avg_chain globs glob_states trie_keys trie_bytes bytes_used bytes_alloc\n");
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		struct domain_index_stat stat;
+		unsigned long load=0;
+		unsigned long avg=0;
+		/// 统计只读取索引中的计数,关闭下半部的时间与记录数无关
+		spin_lock_bh(&primary->lock);
+		domain_index_get_stat(primary->hashs+i,&stat);
+		spin_unlock_bh(&primary->lock);
+		/// 负载与平均链长保留两位小数
+		if(stat.bucket_num>0)
+			load=stat.chained*100/stat.bucket_num;
+		if(stat.used_buckets>0)
+			avg=stat.chained*100/stat.used_buckets;
+		seq_printf(m,"%d %zu %zu %zu %zu %zu %zu %lu.%02lu %zu %lu.%02lu %zu %zu %zu %zu %zu %zu\n",
+				i,stat.records,stat.live,stat.tombstones,stat.mph_slots,stat.chained,
+				stat.bucket_num,load/100,load%100,stat.max_chain,avg/100,avg%100,
+				stat.glob_rules,stat.glob_states,stat.trie_keys,stat.trie_bytes,
+				stat.bytes_used,stat.bytes_alloc);
+	}
+}
+
+/// @brief stats proc文件的输出函数
+static int proc_stats_show(struct seq_file *m,void *v)
+{
+	unsigned long hits=0;
+	unsigned long misses=0;
+	int cpu=0;
+	for_each_possible_cpu(cpu)
+	{
+		struct domain_cache *cache=per_cpu_ptr(&domain_cache,cpu);
+		hits+=cache->hits;
+		misses+=cache->misses;
+	}
+	seq_printf(m,"backend: %s%s\n",NULL!=db.region.base?"region":"bigmem",
+			db.region.huge?" hugepage":"");
+	seq_printf(m,"generation: %u\n",READ_ONCE(db_hash.generation));
+	seq_printf(m,"journal_seq: %llu\n",READ_ONCE(db_hash.journal_seq));
+	seq_printf(m,"journal_applied: %lu\n",db_hash.journal_applied);
+	seq_printf(m,"rebuilds: %lu\n",db_hash.rebuilds);
+	seq_printf(m,"rebuilding: %d\n",READ_ONCE(db_hash.rebuilding));
+	seq_printf(m,"numa_replicas: %d\n",db_hash.replica_num);
+	seq_printf(m,"cache_size: %d\n",DOMAIN_CACHE_SIZE);
+	seq_printf(m,"cache_hits: %lu\n",hits);
+	seq_printf(m,"cache_misses: %lu\n",misses);
+	/// 命中率,保留两位小数
+	if(hits+misses>0)
+	{
+		unsigned long rate=hits*10000/(hits+misses);
+		seq_printf(m,"cache_hit_rate: %lu.%02lu%%\n",rate/100,rate%100);
+	}
+	else
+		seq_printf(m,"cache_hit_rate: 0.00%%\n");
+	proc_stats_show_index(m);
+	return 0;
+}
+
+static int proc_stats_open(struct inode *inode,struct file *file)
+{
+	return single_open(file,proc_stats_show,NULL);
+}
+
+static const struct file_operations stats_fops={
+	.owner=THIS_MODULE,
+	.open=proc_stats_open,
+	.read=seq_read,
+	.llseek=seq_lseek,
+	.release=single_release,
+};
+
+/// @brief hits proc文件的输出函数,只输出非零的计数
+static int proc_hits_show(struct seq_file *m,void *v)
+{
+	int i=0;
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		size_t num=db.domain_names.domain_type_max_len[i];
+		size_t j=0;
+		for(j=0;j<=num;j++)
+		{
+			unsigned long sum=0;
+			int cpu=0;
+			for_each_possible_cpu(cpu)
+				sum+=READ_ONCE(per_cpu_ptr(db_hash.hits[i],cpu)[j]);
+			if(0==sum)
+				continue;
+			if(j<num)
+				seq_printf(m,"%d %zu %lu\n",i,j,sum);
+			else
+				seq_printf(m,"%d glob %lu\n",i,sum);
+		}
+		cond_resched();
+	}
+	return 0;
+}
+
+static int proc_hits_open(struct inode *inode,struct file *file)
+{
+	return single_open(file,proc_hits_show,NULL);
+}
+
+/// @brief hits proc文件的写函数,写入类别编号时清零该类别的计数
+static ssize_t proc_hits_write(struct file *f,const char __user *buf,size_t count,loff_t *offp)
+{
+	int type=0;
+	int err=0;
+	if((err=kstrtoint_from_user(buf,count,10,&type))<0)
+		return err;
+	if(type<0||type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	reset_domain_hits(type,-1);
+	return count;
+}
+
+static const struct file_operations hits_fops={
+	.owner=THIS_MODULE,
+	.open=proc_hits_open,
+	.read=seq_read,
+	.write=proc_hits_write,
+	.llseek=seq_lseek,
+	.release=single_release,
+};
+
+/// 合并各cpu统计时的一项
+struct domain_miss_item
+{
+	u64 hash;
+	unsigned long count;     ///< 出现该项的各cpu的次数之和
+	unsigned long error;     ///< 出现该项的各cpu的误差之和
+	unsigned long min;       ///< 出现该项的各cpu的最小次数之和
+	unsigned char len;
+	char name[DOMAIN_MAX_LENGTH];
+};
+
+/// @brief 按哈希值和长度排序,相同的项相邻
+static int domain_miss_hash_cmp(const void *a,const void *b)
+{
+	const struct domain_miss_item *x=a;
+	const struct domain_miss_item *y=b;
+	if(x->hash!=y->hash)
+		return x->hash<y->hash?-1:1;
+	return (int)x->len-(int)y->len;
+}
+
+/// @brief 按次数从高到低排序
+static int domain_miss_count_cmp(const void *a,const void *b)
+{
+	const struct domain_miss_item *x=a;
+	const struct domain_miss_item *y=b;
+	if(x->count!=y->count)
+		return x->count<y->count?1:-1;
+	return 0;
+}
+
+/// @brief 合并各cpu中type类别的统计,输出次数最多的DOMAIN_MISS_SLOTS项
+/// 	某个cpu的统计已满而其中没有该项时,该项在此cpu上的次数不超过其最小次数,
+/// 	因此输出的误差为各cpu误差之和加上未出现该项的cpu的最小次数之和,
+/// 	真实次数与输出的次数之差不超过误差
+static void proc_misses_show_type(struct seq_file *m,enum domain_type type,struct domain_miss_item *items)
+{
+	unsigned long total_min=0;
+	size_t n=0;
+	size_t i=0;
+	size_t j=0;
+	int cpu=0;
+	for_each_possible_cpu(cpu)
+	{
+		struct domain_miss_sketch *sketch=per_cpu_ptr(db_hash.misses[type],cpu);
+		unsigned int min=UINT_MAX;
+		size_t first=n;
+		for(i=0;i<DOMAIN_MISS_SLOTS;i++)
+		{
+			unsigned int count=READ_ONCE(sketch->count[i]);
+			if(count<min)
+				min=count;
+			if(0==count)
+				continue;
+			items[n].hash=READ_ONCE(sketch->hash[i]);
+			items[n].count=count;
+			items[n].error=READ_ONCE(sketch->error[i]);
+			items[n].len=min_t(unsigned char,READ_ONCE(sketch->len[i]),DOMAIN_MAX_LENGTH);
+			memcpy(items[n].name,sketch->name[i],items[n].len);
+			n++;
+		}
+		/// 统计未满时没有出现的项在此cpu上的次数为0
+		for(i=first;i<n;i++)
+			items[i].min=min;
+		total_min+=min;
+	}
+	/// 合并各cpu的相同项
+	sort(items,n,sizeof(*items),domain_miss_hash_cmp,NULL);
+	for(i=0,j=0;i<n;i++)
+	{
+		if(j>0&&0==domain_miss_hash_cmp(items+j-1,items+i))
+		{
+			items[j-1].count+=items[i].count;
+			items[j-1].error+=items[i].error;
+			items[j-1].min+=items[i].min;
+			continue;
+		}
+		if(j!=i)
+			items[j]=items[i];
+		j++;
+	}
+	sort(items,j,sizeof(*items),domain_miss_count_cmp,NULL);
+	for(i=0;i<j&&i<DOMAIN_MISS_SLOTS;i++)
+		seq_printf(m,"%d %lu %lu %.*s\n",type,items[i].count,
+				items[i].error+total_min-items[i].min,(int)items[i].len,items[i].name);
+}
+
+/// @brief misses proc文件的输出函数
+static int proc_misses_show(struct seq_file *m,void *v)
+{
+	struct domain_miss_item *items=NULL;
+	int i=0;
+	if((items=kvmalloc_array(num_possible_cpus()*DOMAIN_MISS_SLOTS,sizeof(*items),GFP_KERNEL))==NULL)
+		return -ENOMEM;
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		proc_misses_show_type(m,i,items);
+		cond_resched();
+	}
+	kvfree(items);
+	return 0;
+}
+
+static int proc_misses_open(struct inode *inode,struct file *file)
+{
+	return single_open(file,proc_misses_show,NULL);
+}
+
+/// @brief misses proc文件的写函数,写入类别编号时清零该类别的统计
+static ssize_t proc_misses_write(struct file *f,const char __user *buf,size_t count,loff_t *offp)
+{
+	int type=0;
+	int err=0;
+	if((err=kstrtoint_from_user(buf,count,10,&type))<0)
+		return err;
+	if(type<0||type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	reset_domain_misses(type);
+	return count;
+}
+
+static const struct file_operations misses_fops={
+	.owner=THIS_MODULE,
+	.open=proc_misses_open,
+	.read=seq_read,
+	.write=proc_misses_write,
+	.llseek=seq_lseek,
+	.release=single_release,
+};
+
+/// @brief 字符设备的mmap函数,将共享内存区映射到用户态
+static int region_dev_mmap(struct file *f,struct vm_area_struct *vma)
+{
+	return mmap_domain_region(&db.region,vma);
+}
+
+static const struct file_operations region_fops={
+	.owner=THIS_MODULE,
+	.mmap=region_dev_mmap,
+};
+
+/// 共享内存区的字符设备
+static struct miscdevice region_dev={
+	.minor=MISC_DYNAMIC_MINOR,
+	.name=REGION_DEV_NAME,
+	.fops=&region_fops,
+	.mode=0600,
+};
+
 /// @brief 创建proc文件
 static int create_mem_proc(const char *proc_name)
 {
@@ -292,25 +1054,64 @@ static int create_mem_proc(const char *proc_name)
 		printk(KERN_ERR"count not initialize /proc/%s",PROC_NAME);
 		return -1;
 	}
+	stats_proc=proc_create(STATS_PROC_NAME,0444,NULL,&stats_fops);
+	if(NULL==stats_proc)
+	{
+		printk(KERN_ERR"count not initialize /proc/%s",STATS_PROC_NAME);
+		remove_proc_entry(proc_name,NULL);
+		return -1;
+	}
+	hits_proc=proc_create(HITS_PROC_NAME,0644,NULL,&hits_fops);
+	if(NULL==hits_proc)
+	{
+		printk(KERN_ERR"count not initialize /proc/%s",HITS_PROC_NAME);
+		remove_proc_entry(STATS_PROC_NAME,NULL);
+		remove_proc_entry(proc_name,NULL);
+		return -1;
+	}
+	misses_proc=proc_create(MISSES_PROC_NAME,0644,NULL,&misses_fops);
+	if(NULL==misses_proc)
+	{
+		printk(KERN_ERR"count not initialize /proc/%s",MISSES_PROC_NAME);
+		remove_proc_entry(HITS_PROC_NAME,NULL);
+		remove_proc_entry(STATS_PROC_NAME,NULL);
+		remove_proc_entry(proc_name,NULL);
+		return -1;
+	}
 	return 0;
 }
 
 /// @brief 删除proc文件 
 static void clean_mem_proc(void)
 {
+	remove_proc_entry(MISSES_PROC_NAME,NULL);
+	remove_proc_entry(HITS_PROC_NAME,NULL);
+	remove_proc_entry(STATS_PROC_NAME,NULL);
 	remove_proc_entry(PROC_NAME,NULL);
 }
 
 static int bc_domain_search_init(void)
 {
 	int err=0;
+	enum domain_backend type=DOMAIN_BACKEND_BIGMEM;
+	if(strcmp(backend,"region")==0)
+		type=DOMAIN_BACKEND_REGION;
+	else if(strcmp(backend,"bigmem")!=0)
+	{
+		printk(KERN_ERR "%s: unknown backend %s\n",NAME,backend);
+		return -EINVAL;
+	}
+	/// 结果缓存以short保存记录下标
+	BUILD_BUG_ON(DOMAIN_MAX_COUNT>SHRT_MAX);
+	cache_seed=get_random_u32();
 	/// 初始化bc_domain_db
-	if((err=init_bc_domain_db(&db))<0)
+	if((err=init_bc_domain_db(&db,type))<0)
 	{
 		printk(KERN_INFO"init bc_domain db error");
 		goto err_back;
 	}
 	/// 初始化hash
+	INIT_WORK(&db_hash.rebuild_work,domain_rebuild_work_fn);
 	if((err=init_domain_db_hash())<0)
 	{
 		printk(KERN_INFO "init domain db_hash error");
@@ -324,17 +1125,36 @@ static int bc_domain_search_init(void)
 		goto destory_hash;
 	}
 	printk(KERN_INFO "/proc/%s create ok",PROC_NAME);
-	/// 设置read_buf
-	if((err=dump_bigmem(&db.mem,&read_buf))<0)
+	/// 设置read_buf,共享内存区时只给出设备路径
+	if(DOMAIN_BACKEND_REGION==type)
+	{
+		if((read_buf=kasprintf(GFP_KERNEL,"region %s %zu\n",
+						REGION_DEV_PATH,db.region.size))==NULL)
+		{
+			err=-ENOMEM;
+			goto clean_proc;
+		}
+		if((err=misc_register(&region_dev))<0)
+		{
+			printk(KERN_ERR "register %s error",REGION_DEV_PATH);
+			goto clean_buf;
+		}
+	}
+	else if((err=dump_bigmem(&db.mem,&read_buf))<0)
 	{
 		read_buf=NULL;
 		printk(KERN_ERR "dump bigmem to read_buf error");
-		goto destory_hash;
+		goto clean_proc;
 	}
 	temp=strlen(read_buf);
 	/// 输出信息
 	printk(KERN_INFO"%s(%s) load ok\n",NAME,BC_DOMAIN_MEM_VERSION);
 	return 0;
+clean_buf:
+	kfree(read_buf);
+	read_buf=NULL;
+clean_proc:
+	clean_mem_proc();
 destory_hash:
 	destory_domain_db_hash();
 clean_mem:
@@ -348,6 +1168,9 @@ err_back:
 static void bc_domain_search_exit(void)
 {
 	int err=0;
+	/// 删除字符设备,映射持有设备文件,全部解除前模块不能卸载
+	if(NULL!=db.region.base)
+		misc_deregister(&region_dev);
 	/// 清除read_buf
 	if(NULL!=read_buf)
 	{
@@ -356,6 +1179,8 @@ static void bc_domain_search_exit(void)
 	}
 	/// 清除proc_file
 	clean_mem_proc();
+	/// 等待正在执行的重建
+	cancel_work_sync(&db_hash.rebuild_work);
 	/// 清除hash
 	destory_domain_db_hash();
 	/// 清除bc_domain_db
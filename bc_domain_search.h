@@ -5,6 +5,16 @@
 #ifndef _BC_DOMAIN_SEARCH_H
 #define _BC_DOMAIN_SEARCH_H
 #include "bc_domain_names.h"
+#include "bc_domain_parse.h"
 int bc_domain_match(const char *domain,enum domain_type type);
+/// @brief 对长度为len的域名进行查找,buf可直接指向报文内容,不要求以'\0'结尾
+/// 	通常与bc_domain_host_extract配合使用
+int bc_domain_match_n(const char *buf,size_t len,enum domain_type type);
+/// @brief 对DNS报文中线格式的域名进行查找,结果与点分格式接口一致
+/// 	压缩指针只允许在[msg,msg+msg_len)范围内向前跳转,否则返回-EINVAL
+int bc_domain_match_qname(const unsigned char *msg,size_t msg_len,size_t offset,enum domain_type type);
+/// @brief 复制type类别下标为index的记录的域名,供测试模块构造查询
+/// @retval 成功返回域名长度 无效记录和通配规则返回0 下标越界返回-ERANGE
+int bc_domain_get_name(enum domain_type type,size_t index,char *buf,size_t len);
 
 #endif /// _BC_DOMAIN_SEARCH_H 
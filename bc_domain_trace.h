@@ -0,0 +1,124 @@
+/*
+ * @file bc_domain_trace.h
+ * @breif bc_domain_mem模块的静态跟踪点,未启用时只是一条空指令
+ *        可由perf,ftrace或eBPF挂接,如perf record -e 'bc_domain:*'
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM bc_domain
+
+#if !defined(_BC_DOMAIN_TRACE_H_)||defined(TRACE_HEADER_MULTI_READ)
+#define _BC_DOMAIN_TRACE_H_
+
+#include <linux/tracepoint.h>
+
+/// bc_domain_error的出错位置
+#define DOMAIN_TRACE_HEAD 0       ///< 读取db头部
+#define DOMAIN_TRACE_JOURNAL 1    ///< 应用修改日志
+#define DOMAIN_TRACE_REBUILD 2    ///< 完全重建
+
+/// 一次查找,record为匹配的记录下标,未匹配为-1,通配规则为-2
+TRACE_EVENT(bc_domain_lookup,
+	TP_PROTO(int type,int record,unsigned int probes,u64 ns,bool cached),
+	TP_ARGS(type,record,probes,ns,cached),
+	TP_STRUCT__entry(
+		__field(int,type)
+		__field(int,record)
+		__field(unsigned int,probes)
+		__field(u64,ns)
+		__field(bool,cached)
+	),
+	TP_fast_assign(
+		__entry->type=type;
+		__entry->record=record;
+		__entry->probes=probes;
+		__entry->ns=ns;
+		__entry->cached=cached;
+	),
+	TP_printk("type=%d record=%d hit=%d probes=%u ns=%llu cached=%d",
+		__entry->type,__entry->record,DOMAIN_INDEX_MISS!=__entry->record,
+		__entry->probes,__entry->ns,__entry->cached)
+);
+
+/// 完全重建开始,records为各类别需要复制的记录总数,works为工作项个数
+TRACE_EVENT(bc_domain_rebuild_start,
+	TP_PROTO(size_t records,size_t works),
+	TP_ARGS(records,works),
+	TP_STRUCT__entry(
+		__field(size_t,records)
+		__field(size_t,works)
+	),
+	TP_fast_assign(
+		__entry->records=records;
+		__entry->works=works;
+	),
+	TP_printk("records=%zu works=%zu",__entry->records,__entry->works)
+);
+
+/// 完全重建结束,chained为进入哈希链的记录数,ns为复制到交换完成的时间
+TRACE_EVENT(bc_domain_rebuild_end,
+	TP_PROTO(size_t records,size_t chained,u64 ns),
+	TP_ARGS(records,chained,ns),
+	TP_STRUCT__entry(
+		__field(size_t,records)
+		__field(size_t,chained)
+		__field(u64,ns)
+	),
+	TP_fast_assign(
+		__entry->records=records;
+		__entry->chained=chained;
+		__entry->ns=ns;
+	),
+	TP_printk("records=%zu chained=%zu ns=%llu",__entry->records,__entry->chained,__entry->ns)
+);
+
+/// 查找时发现db有更新,rebuild为是否排队完全重建,否则已增量应用修改日志
+TRACE_EVENT(bc_domain_update,
+	TP_PROTO(bool is_update,unsigned long long seq,unsigned long long applied,bool rebuild),
+	TP_ARGS(is_update,seq,applied,rebuild),
+	TP_STRUCT__entry(
+		__field(bool,is_update)
+		__field(unsigned long long,seq)
+		__field(unsigned long long,applied)
+		__field(bool,rebuild)
+	),
+	TP_fast_assign(
+		__entry->is_update=is_update;
+		__entry->seq=seq;
+		__entry->applied=applied;
+		__entry->rebuild=rebuild;
+	),
+	TP_printk("is_update=%d seq=%llu applied=%llu rebuild=%d",
+		__entry->is_update,__entry->seq,__entry->applied,__entry->rebuild)
+);
+
+/// 读取db出错,这些错误只使查找退回当前索引或完全重建
+TRACE_EVENT(bc_domain_error,
+	TP_PROTO(int where,int err),
+	TP_ARGS(where,err),
+	TP_STRUCT__entry(
+		__field(int,where)
+		__field(int,err)
+	),
+	TP_fast_assign(
+		__entry->where=where;
+		__entry->err=err;
+	),
+	TP_printk("where=%s err=%d",
+		__print_symbolic(__entry->where,
+			{DOMAIN_TRACE_HEAD,"head"},
+			{DOMAIN_TRACE_JOURNAL,"journal"},
+			{DOMAIN_TRACE_REBUILD,"rebuild"}),
+		__entry->err)
+);
+
+#endif /// _BC_DOMAIN_TRACE_H_
+
+/// 跟踪点头文件不在内核的include路径中,Makefile为bc_domain_search.o加入-I$(src)
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE bc_domain_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,630 @@
+/*
+ * @file bc_domain_trie.c
+ * @breif 压缩trie,查找内核与用户态共用,建立只在用户态
+ * 	  树形按LOUDS编码:按层次顺序,各节点依次写入子节点个数个1和一个0,
+ * 	  节点i的子节点从第i-1个0之后开始,编号为该位置之前1的个数加1,
+ * 	  没有分支的路径合并为一条边,查找时每层只在分支处读取LOUDS,
+ * 	  只剩一个域名的子树不再展开,其余字符作为叶节点的边串保存
+ * @author hzy.oop@gmail.com
+ * @date 2026-10-19
+ */
+
+#ifndef USER_SPACE
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/prefetch.h>
+
+#define trie_popcount(x) hweight64(x)
+#define trie_ctz(x) __ffs64(x)
+#define trie_prefetch(p) prefetch(p)
+#else
+#include <errno.h>
+#include <error.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define trie_popcount(x) __builtin_popcountll(x)
+#define trie_ctz(x) __builtin_ctzll(x)
+#define trie_prefetch(p) __builtin_prefetch(p)
+#endif
+
+#include "bc_domain_trie.h"
+#include "bc_domain_glob.h"
+
+/// data中偏移为off处的指针
+#define TRIE_PTR(trie,off) ((const unsigned char*)(trie)->data+(off))
+
+/// @brief 按8字节对齐
+static inline size_t trie_align(size_t x)
+{
+	return (x+7)&~(size_t)7;
+}
+
+/// @brief bits个位所需的64位字个数
+static inline size_t trie_words(size_t bits)
+{
+	return (bits+63)/64;
+}
+
+/// 带秩目录的位向量每块中的位数,每块第一个字为之前1的个数,计算秩只读一个缓存行
+#define TRIE_BLOCK_BITS ((DOMAIN_TRIE_RANK_WORDS-1)*64)
+
+/// @brief 带秩目录的位向量的字节数
+static inline size_t trie_rank_bytes(size_t bits)
+{
+	return (bits/TRIE_BLOCK_BITS+1)*DOMAIN_TRIE_RANK_WORDS*8;
+}
+
+/// @brief 带秩目录的位向量中第i位所在的字
+static inline size_t trie_rank_word(size_t i)
+{
+	return i/TRIE_BLOCK_BITS*DOMAIN_TRIE_RANK_WORDS+1+i%TRIE_BLOCK_BITS/64;
+}
+
+/// @brief 依据节点,边串和域名个数计算trie各部分的偏移与data的大小
+/// @retval 成功0 个数不合理返回错误代码负值
+int domain_trie_layout(struct domain_trie *trie)
+{
+	size_t off=0;
+	if(NULL==trie||0==trie->node_num||trie->key_num>trie->node_num||trie->link_num>trie->node_num||
+			trie->link_bytes<2*(size_t)trie->link_num||trie->record_bits<1||trie->record_bits>32)
+		return -EINVAL;
+	trie->louds=off;
+	off+=trie_words(2*(size_t)trie->node_num-1)*8;
+	trie->select=off;
+	off+=trie_align((trie->node_num/DOMAIN_TRIE_SELECT_STEP+1)*sizeof(unsigned int));
+	trie->labels=off;
+	off+=trie_align(trie->node_num);
+	/// 秩目录按缓存行对齐
+	off=(off+63)&~(size_t)63;
+	trie->terminal=off;
+	off+=trie_rank_bytes(trie->node_num);
+	trie->link=off;
+	off+=trie_rank_bytes(trie->node_num);
+	trie->link_index=off;
+	off+=trie_align((trie->link_num/DOMAIN_TRIE_LINK_STEP+1)*sizeof(unsigned int));
+	trie->link_pool=off;
+	off+=trie_align(trie->link_bytes);
+	trie->records=off;
+	/// 多留一个字,读取跨字的记录下标时不越界
+	off+=(trie_words((size_t)trie->key_num*trie->record_bits)+1)*8;
+	if(off>0x7fffffff)
+		return -E2BIG;
+	trie->size=off;
+	trie->reserved=0;
+	return 0;
+}
+
+/// @brief 带秩目录的位向量中第i位
+static inline bool trie_bit(const struct domain_trie *trie,unsigned int off,size_t i)
+{
+	const unsigned long long *bits=(const unsigned long long*)TRIE_PTR(trie,off);
+	return (bits[trie_rank_word(i)]>>(i&63))&1;
+}
+
+/// @brief 带秩目录的位向量中[0,i)内1的个数
+static inline size_t trie_rank(const struct domain_trie *trie,unsigned int off,size_t i)
+{
+	const unsigned long long *bits=(const unsigned long long*)TRIE_PTR(trie,off);
+	size_t b=i/TRIE_BLOCK_BITS*DOMAIN_TRIE_RANK_WORDS;
+	size_t w=trie_rank_word(i);
+	size_t r=bits[b];
+	for(b++;b<w;b++)
+		r+=trie_popcount(bits[b]);
+	if(i&63)
+		r+=trie_popcount(bits[w]&((1ull<<(i&63))-1));
+	return r;
+}
+
+/// 各字节均为1或0x80的常量
+#define TRIE_L8 0x0101010101010101ull
+#define TRIE_H8 0x8080808080808080ull
+
+/// @brief 各字节的值均不超过127时,值不超过r的字节个数
+static inline size_t trie_bytes_le(unsigned long long sums,size_t r)
+{
+	/// 不超过r的字节最高位为1,再将各字节的最高位累加到最高字节
+	return (((((r*TRIE_L8)|TRIE_H8)-sums)&TRIE_H8)>>7)*TRIE_L8>>56;
+}
+
+/// @brief 64位字x中第r个1(从0开始)的位置,x中须多于r个1
+/// 	先由各字节1个数的前缀和找到所在的字节,再将该字节的各位展开到8个字节同样计算,没有分支
+static inline size_t trie_select64(unsigned long long x,size_t r)
+{
+	unsigned long long s=x-((x>>1)&0x5555555555555555ull);
+	size_t place=0;
+	s=(s&0x3333333333333333ull)+((s>>2)&0x3333333333333333ull);
+	/// 各字节为该字节及之前1的个数
+	s=((s+(s>>4))&0x0f0f0f0f0f0f0f0full)*TRIE_L8;
+	place=trie_bytes_le(s,r)*8;
+	r-=((s<<8)>>place)&0xff;
+	/// 字节中第i位展开为第i个字节的0或1,再求前缀和
+	s=((x>>place)&0xff)*TRIE_L8&0x8040201008040201ull;
+	s=(((s+0x7f7f7f7f7f7f7f7full)&TRIE_H8)>>7)*TRIE_L8;
+	return place+trie_bytes_le(s,r);
+}
+
+/// @brief LOUDS中第k个0(从0开始)的位置
+static size_t trie_select0(const struct domain_trie *trie,size_t k)
+{
+	const unsigned long long *louds=(const unsigned long long*)TRIE_PTR(trie,trie->louds);
+	const unsigned int *samples=(const unsigned int*)TRIE_PTR(trie,trie->select);
+	size_t pos=samples[k/DOMAIN_TRIE_SELECT_STEP];
+	size_t r=k%DOMAIN_TRIE_SELECT_STEP;
+	size_t w=pos>>6;
+	unsigned long long x=~louds[w]&(~0ull<<(pos&63));
+	size_t c=0;
+	/// 先按字跳过,再在字内定位
+	while((c=trie_popcount(x))<=r)
+	{
+		r-=c;
+		x=~louds[++w];
+	}
+	return w*64+trie_select64(x,r);
+}
+
+/// @brief LOUDS中从pos开始连续1的个数,即子节点个数
+static inline size_t trie_degree(const struct domain_trie *trie,size_t pos)
+{
+	const unsigned long long *louds=(const unsigned long long*)TRIE_PTR(trie,trie->louds);
+	size_t n=0;
+	for(;;)
+	{
+		size_t left=64-(pos&63);
+		unsigned long long x=~(louds[pos>>6]>>(pos&63));
+		size_t c=x?trie_ctz(x):64;
+		if(c<left)
+			return n+c;
+		n+=left;
+		pos+=left;
+	}
+}
+
+/// @brief 第k个域名的记录下标
+static inline unsigned int trie_record(const struct domain_trie *trie,size_t k)
+{
+	const unsigned long long *rec=(const unsigned long long*)TRIE_PTR(trie,trie->records);
+	size_t pos=k*trie->record_bits;
+	unsigned long long x=rec[pos>>6]>>(pos&63);
+	if((pos&63)+trie->record_bits>64)
+		x|=rec[(pos>>6)+1]<<(64-(pos&63));
+	return x&((1ull<<trie->record_bits)-1);
+}
+
+/// @brief 转为小写
+static inline unsigned char trie_fold(unsigned char c)
+{
+	return (c>='A'&&c<='Z')?c+('a'-'A'):c;
+}
+
+/// 从最后一个字符开始依次读取域名的游标
+/// 	线格式按标签逆序读取,只记录各标签在报文中的位置,不展开为点分格式
+struct trie_rev
+{
+	const char *name;            ///< 点分格式域名
+	const unsigned char *msg;    ///< 线格式所在的报文
+	const unsigned int *off;     ///< 线格式各标签内容在报文中的偏移
+	const unsigned char *len;    ///< 线格式各标签的长度
+	size_t left;                 ///< 尚未读取的字符数
+	int label;                   ///< 线格式的当前标签
+	size_t in;                   ///< 当前标签中尚未读取的字符数,为0时下一个字符为'.'
+};
+
+/// @brief 读取前一个字符并转为小写,wire为常量,内联后两种格式各自展开
+static __always_inline unsigned char trie_rev_next(struct trie_rev *r,const bool wire)
+{
+	r->left--;
+	if(!wire)
+		return trie_fold(r->name[r->left]);
+	if(0==r->in)
+	{
+		r->label--;
+		r->in=r->len[r->label];
+		return '.';
+	}
+	r->in--;
+	return trie_fold(r->msg[r->off[r->label]+r->in]);
+}
+
+/// @brief 比较节点node的边串与域名之后的字符,并跳过相同的字符
+/// @retval 相等true 不相等false
+static __always_inline bool trie_link_match(const struct domain_trie *trie,size_t node,
+		struct trie_rev *r,const bool wire)
+{
+	size_t t=trie_rank(trie,trie->link,node);
+	const unsigned int *index=(const unsigned int*)TRIE_PTR(trie,trie->link_index);
+	const char *p=(const char*)TRIE_PTR(trie,trie->link_pool)+index[t/DOMAIN_TRIE_LINK_STEP];
+	size_t i=0;
+	for(i=t%DOMAIN_TRIE_LINK_STEP;i>0;i--)
+		p+=strlen(p)+1;
+	/// 边串中的字符也是从后向前的顺序
+	for(;'\0'!=*p;p++)
+		if(0==r->left||(unsigned char)*p!=trie_rev_next(r,wire))
+			return false;
+	return true;
+}
+
+/// @brief 查找的实现,依次读取游标中的字符
+/// @retval 匹配的记录下标 匹配失败DOMAIN_TRIE_MISS
+static __always_inline int trie_lookup(const struct domain_trie *trie,struct trie_rev *r,const bool wire)
+{
+	const unsigned char *labels=TRIE_PTR(trie,trie->labels);
+	const unsigned char *child=NULL;
+	size_t node=0;
+	while(r->left>0)
+	{
+		/// 子节点的位置之前有node个0,编号从1开始
+		size_t start=node?trie_select0(trie,node-1)+1:0;
+		size_t deg=trie_degree(trie,start);
+		if(0==deg)
+			return DOMAIN_TRIE_MISS;
+		child=(const unsigned char*)memchr(labels+start-node+1,trie_rev_next(r,wire),deg);
+		if(NULL==child)
+			return DOMAIN_TRIE_MISS;
+		node=child-labels;
+		/// 下一层select0的采样与边串的比较无关,先开始读取
+		trie_prefetch((const unsigned int*)TRIE_PTR(trie,trie->select)+(node-1)/DOMAIN_TRIE_SELECT_STEP);
+		if(trie_bit(trie,trie->link,node)&&!trie_link_match(trie,node,r,wire))
+			return DOMAIN_TRIE_MISS;
+	}
+	if(!trie_bit(trie,trie->terminal,node))
+		return DOMAIN_TRIE_MISS;
+	return trie_record(trie,trie_rank(trie,trie->terminal,node));
+}
+
+/// @brief 在trie中查找长度为len的点分格式域名,忽略ASCII大小写
+/// @retval 匹配的记录下标 匹配失败DOMAIN_TRIE_MISS
+int domain_trie_lookup(const struct domain_trie *trie,const char *name,size_t len)
+{
+	struct trie_rev r;
+	if(NULL==trie||0==trie->key_num)
+		return DOMAIN_TRIE_MISS;
+	r.name=name;
+	r.left=len;
+	return trie_lookup(trie,&r,false);
+}
+
+/// @brief 在trie中查找已校验的线格式域名,忽略ASCII大小写
+/// 	先记录各标签的位置,再从最后一个标签开始逆序读取,不复制域名
+/// @retval 匹配的记录下标 匹配失败DOMAIN_TRIE_MISS
+int domain_trie_lookup_qname(const struct domain_trie *trie,const struct dns_qname *qname)
+{
+	/// 点分格式短于DOMAIN_MAX_LENGTH时至多DOMAIN_MAX_LENGTH/2个标签
+	unsigned int off[DOMAIN_MAX_LENGTH/2];
+	unsigned char len[DOMAIN_MAX_LENGTH/2];
+	const unsigned char *label=NULL;
+	struct trie_rev r;
+	size_t pos=0;
+	size_t n=0;
+	size_t l=0;
+	if(NULL==trie||0==trie->key_num||0==qname->len||qname->len>=DOMAIN_MAX_LENGTH)
+		return DOMAIN_TRIE_MISS;
+	pos=qname->offset;
+	while(n<DOMAIN_MAX_LENGTH/2&&(label=dns_qname_label(qname,&pos,&l))!=NULL)
+	{
+		off[n]=label-qname->msg;
+		len[n]=l;
+		n++;
+	}
+	if(0==n)
+		return DOMAIN_TRIE_MISS;
+	r.msg=qname->msg;
+	r.off=off;
+	r.len=len;
+	r.left=qname->len;
+	r.label=n-1;
+	r.in=len[n-1];
+	return trie_lookup(trie,&r,true);
+}
+
+#ifdef USER_SPACE
+
+/// 建立时的域名,字符已逆序并转为小写
+struct trie_key
+{
+	char *rev;
+	unsigned int len;
+	unsigned int record;
+};
+
+/// 建立时的节点,按层次顺序排列,同时作为待展开的队列
+struct trie_node
+{
+	unsigned int lo;        ///< 子树中的域名为keys[lo,hi)
+	unsigned int hi;
+	unsigned char from;     ///< 入边从第from个字符开始
+	unsigned char depth;    ///< 入边结束时已匹配的字符个数
+	unsigned short degree;  ///< 子节点个数
+};
+
+/// @brief 按逆序的域名排序,相同的域名按记录下标
+static int trie_key_cmp(const void *a,const void *b)
+{
+	const struct trie_key *x=(const struct trie_key*)a;
+	const struct trie_key *y=(const struct trie_key*)b;
+	int ret=strcmp(x->rev,y->rev);
+	if(ret)
+		return ret;
+	return x->record<y->record?-1:x->record>y->record;
+}
+
+/// @brief 设置位向量的第i位
+static inline void trie_set_bit(unsigned long long *bits,size_t i)
+{
+	bits[i>>6]|=1ull<<(i&63);
+}
+
+/// @brief 设置带秩目录的位向量的第i位
+static inline void trie_set_rank_bit(unsigned long long *bits,size_t i)
+{
+	bits[trie_rank_word(i)]|=1ull<<(i&63);
+}
+
+/// @brief 依据位向量填写各块的秩
+static void trie_fill_rank(unsigned long long *bits,size_t n)
+{
+	size_t words=trie_rank_bytes(n)/8;
+	unsigned long long r=0;
+	size_t w=0;
+	for(w=0;w<words;w++)
+	{
+		if(0==w%DOMAIN_TRIE_RANK_WORDS)
+			bits[w]=r;
+		else
+			r+=trie_popcount(bits[w]);
+	}
+}
+
+/// @brief 对n个域名建立压缩trie,重复的域名只保留第一个
+/// @retval 成功0 超出缓冲区返回-E2BIG 失败错误代码负值
+int build_domain_trie(const char **names,const unsigned int *records,size_t n,size_t num,
+		struct domain_trie *trie,size_t size)
+{
+	struct trie_key *keys=NULL;
+	struct trie_node *nodes=NULL;
+	char *buf=NULL;
+	unsigned char *data=NULL;
+	size_t node_cap=0;
+	size_t node_num=0;
+	size_t key_num=0;
+	size_t link_num=0;
+	size_t link_bytes=0;
+	size_t chars=0;
+	size_t i=0;
+	size_t j=0;
+	int err=0;
+
+	if(NULL==names||NULL==records||NULL==trie||size<sizeof(struct domain_trie))
+		return -EINVAL;
+	memset(trie,0,sizeof(struct domain_trie));
+	if(0==n)
+		return 0;
+	for(i=0;i<n;i++)
+	{
+		if(records[i]>=num)
+			return -EINVAL;
+		chars+=strnlen(names[i],DOMAIN_MAX_LENGTH-1)+1;
+	}
+	keys=(struct trie_key*)calloc(n,sizeof(struct trie_key));
+	buf=(char*)malloc(chars);
+	node_cap=n+1;
+	nodes=(struct trie_node*)malloc(node_cap*sizeof(struct trie_node));
+	if(NULL==keys||NULL==buf||NULL==nodes)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	/// 逆序并转为小写
+	for(i=0,chars=0;i<n;i++)
+	{
+		size_t len=strnlen(names[i],DOMAIN_MAX_LENGTH-1);
+		keys[i].rev=buf+chars;
+		keys[i].len=len;
+		keys[i].record=records[i];
+		for(j=0;j<len;j++)
+			keys[i].rev[j]=trie_fold(names[i][len-1-j]);
+		keys[i].rev[len]='\0';
+		chars+=len+1;
+	}
+	qsort(keys,n,sizeof(struct trie_key),trie_key_cmp);
+	for(i=0,j=0;i<n;i++)
+		if(0==keys[i].len||(j>0&&strcmp(keys[j-1].rev,keys[i].rev)==0))
+			continue;
+		else
+			keys[j++]=keys[i];
+	n=j;
+	if(0==n)
+		goto out;
+	/// 按层次顺序展开,新节点追加到末尾
+	memset(nodes,0,sizeof(struct trie_node));
+	nodes[0].hi=n;
+	for(i=0,node_num=1;i<node_num;i++)
+	{
+		unsigned int lo=nodes[i].lo;
+		unsigned int hi=nodes[i].hi;
+		unsigned char depth=nodes[i].depth;
+		/// 排序后以该节点结尾的域名在最前面
+		if(keys[lo].len==depth)
+		{
+			key_num++;
+			lo++;
+		}
+		while(lo<hi)
+		{
+			unsigned char c=keys[lo].rev[depth];
+			unsigned int end=lo;
+			unsigned int d=depth+1;
+			while(end<hi&&(unsigned char)keys[end].rev[depth]==c)
+				end++;
+			/// 只有一个域名时边直到末尾,否则延伸到第一个分支或结尾处,
+			/// 已排序,首尾两个域名相同的字符所有域名都相同
+			if(end-lo==1)
+				d=keys[lo].len;
+			else
+				while(keys[lo].len>d&&keys[lo].rev[d]==keys[end-1].rev[d])
+					d++;
+			if(node_num==node_cap)
+			{
+				struct trie_node *p=NULL;
+				node_cap*=2;
+				if((p=(struct trie_node*)realloc(nodes,node_cap*sizeof(struct trie_node)))==NULL)
+				{
+					err=-ENOMEM;
+					goto out;
+				}
+				nodes=p;
+			}
+			nodes[node_num].lo=lo;
+			nodes[node_num].hi=end;
+			nodes[node_num].from=depth;
+			nodes[node_num].depth=d;
+			nodes[node_num].degree=0;
+			if(d>depth+1)
+			{
+				link_num++;
+				link_bytes+=d-depth;
+			}
+			node_num++;
+			nodes[i].degree++;
+			lo=end;
+		}
+	}
+	trie->key_num=key_num;
+	trie->num=num;
+	trie->node_num=node_num;
+	trie->link_num=link_num;
+	trie->link_bytes=link_bytes;
+	for(trie->record_bits=1;trie->record_bits<32&&(num-1)>>trie->record_bits;trie->record_bits++);
+	if((err=domain_trie_layout(trie))<0)
+		goto out;
+	if(sizeof(struct domain_trie)+trie->size>size)
+	{
+		err=-E2BIG;
+		goto out;
+	}
+	data=(unsigned char*)trie->data;
+	memset(data,0,trie->size);
+	{
+		unsigned long long *louds=(unsigned long long*)(data+trie->louds);
+		unsigned int *samples=(unsigned int*)(data+trie->select);
+		unsigned long long *terminal=(unsigned long long*)(data+trie->terminal);
+		unsigned long long *link=(unsigned long long*)(data+trie->link);
+		unsigned int *link_index=(unsigned int*)(data+trie->link_index);
+		char *pool=(char*)(data+trie->link_pool);
+		unsigned long long *rec=(unsigned long long*)(data+trie->records);
+		size_t pos=0;
+		size_t k=0;
+		size_t t=0;
+		size_t off=0;
+		for(i=0;i<node_num;i++)
+		{
+			const struct trie_node *cur=nodes+i;
+			const struct trie_key *key=keys+cur->lo;
+			/// 子节点个数个1,再一个0
+			for(j=0;j<cur->degree;j++)
+				trie_set_bit(louds,pos++);
+			if(0==i%DOMAIN_TRIE_SELECT_STEP)
+				samples[i/DOMAIN_TRIE_SELECT_STEP]=pos;
+			pos++;
+			if(i>0)
+				data[trie->labels+i]=key->rev[cur->from];
+			if(key->len==cur->depth)
+			{
+				size_t bit=k*trie->record_bits;
+				unsigned long long r=key->record;
+				trie_set_rank_bit(terminal,i);
+				rec[bit>>6]|=r<<(bit&63);
+				if((bit&63)+trie->record_bits>64)
+					rec[(bit>>6)+1]|=r>>(64-(bit&63));
+				k++;
+			}
+			if(i>0&&cur->depth>cur->from+1)
+			{
+				size_t len=cur->depth-cur->from-1;
+				trie_set_rank_bit(link,i);
+				if(0==t%DOMAIN_TRIE_LINK_STEP)
+					link_index[t/DOMAIN_TRIE_LINK_STEP]=off;
+				memcpy(pool+off,key->rev+cur->from+1,len);
+				pool[off+len]='\0';
+				off+=len+1;
+				t++;
+			}
+		}
+		trie_fill_rank(terminal,node_num);
+		trie_fill_rank(link,node_num);
+	}
+out:
+	if(err<0)
+		memset(trie,0,sizeof(struct domain_trie));
+	free(keys);
+	free(buf);
+	free(nodes);
+	return err;
+}
+
+/// @brief 对db中type类别的有效字面域名建立压缩trie并写入db
+/// 	超出trie区时写入空的trie,内核改用哈希索引
+/// @retval 成功返回trie中的域名个数 失败错误代码负值
+int compile_domain_trie(struct bc_domain_db *db,enum domain_type type)
+{
+	struct domain_trie *trie=NULL;
+	const char **names=NULL;
+	unsigned int *records=NULL;
+	char (*buf)[DOMAIN_MAX_LENGTH]=NULL;
+	struct domain_iter it;
+	const struct domain_name *name=NULL;
+	size_t max_len=0;
+	size_t num=0;
+	size_t n=0;
+	size_t i=0;
+	int err=0;
+
+	if(NULL==db||type<0||type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	max_len=db->domain_names.domain_type_max_len[type];
+	trie=(struct domain_trie*)calloc(1,DOMAIN_TRIE_SIZE(max_len));
+	names=(const char**)calloc(max_len+1,sizeof(char*));
+	records=(unsigned int*)calloc(max_len+1,sizeof(unsigned int));
+	buf=(char(*)[DOMAIN_MAX_LENGTH])calloc(max_len+1,DOMAIN_MAX_LENGTH);
+	if(NULL==trie||NULL==names||NULL==records||NULL==buf)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	if((err=domain_iter_init(&it,db,type))<0)
+		goto out;
+	while((name=domain_iter_next(&it,&i))!=NULL&&i<max_len)
+	{
+		/// 通配规则由DFA匹配
+		if(!name->is_vaild||is_domain_glob(name->name))
+			continue;
+		strncpy(buf[n],name->name,DOMAIN_MAX_LENGTH-1);
+		names[n]=buf[n];
+		records[n++]=i;
+	}
+	if((err=it.err)<0)
+		goto out;
+	num=get_domain_name_num(db,type);
+	if((err=build_domain_trie(names,records,n,num,trie,DOMAIN_TRIE_SIZE(max_len)))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"build trie of %zu names for type %d failed",n,type);
+		memset(trie,0,sizeof(struct domain_trie));
+		set_domain_trie(trie,db,type);
+		goto out;
+	}
+	if((err=set_domain_trie(trie,db,type))<0)
+	{
+		error_at_line(0,-err,__FILE__,__LINE__,"write domain trie for type %d error",type);
+		goto out;
+	}
+	err=trie->key_num;
+out:
+	free(trie);
+	free(names);
+	free(records);
+	free(buf);
+	return err;
+}
+
+#endif /// USER_SPACE
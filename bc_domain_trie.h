@@ -0,0 +1,55 @@
+/*
+ * bc_domain_trie模块头文件
+ * 	  压缩trie,用户程序在发布时建立并写入db,内核可以直接在压缩的形式上查找
+ * 	  域名从最后一个字符开始插入,同一区域下的域名共享从根开始的路径
+ */
+#ifndef _BC_DOMAIN_TRIE_H
+#define _BC_DOMAIN_TRIE_H
+
+#include "bc_domain_names.h"
+#include "bc_domain_parse.h"
+
+/// LOUDS中每隔多少个0保存一次位置,select0最多扫描这么多个0
+#define DOMAIN_TRIE_SELECT_STEP 32
+/// 带秩目录的位向量每块的64位字个数,每块占一个缓存行
+#define DOMAIN_TRIE_RANK_WORDS 8
+/// 每隔多少个边串保存一次起始偏移
+#define DOMAIN_TRIE_LINK_STEP 4
+
+/// domain_trie_lookup查找失败的返回值
+#define DOMAIN_TRIE_MISS (-1)
+
+/// @brief 依据节点,尾串和域名个数计算trie各部分的偏移与data的大小
+/// @retval 成功0 个数不合理返回错误代码负值
+int domain_trie_layout(struct domain_trie *trie);
+
+/// @brief 在trie中查找长度为len的点分格式域名,忽略ASCII大小写
+/// @retval 匹配的记录下标 匹配失败DOMAIN_TRIE_MISS
+int domain_trie_lookup(const struct domain_trie *trie,const char *name,size_t len);
+
+/// @brief 在trie中查找已校验的线格式域名,忽略ASCII大小写,不展开为点分格式
+/// @retval 匹配的记录下标 匹配失败DOMAIN_TRIE_MISS
+int domain_trie_lookup_qname(const struct domain_trie *trie,const struct dns_qname *qname);
+
+/// @brief trie占用的字节数
+static inline size_t domain_trie_bytes(const struct domain_trie *trie)
+{
+	return sizeof(struct domain_trie)+(trie->key_num>0?trie->size:0);
+}
+
+#ifdef USER_SPACE
+/// @brief 对n个域名建立压缩trie,重复的域名只保留第一个
+/// @param[in] records 各域名的记录下标,均小于num
+/// @param[in] num 记录个数
+/// @param[in] size trie缓冲区大小
+/// @retval 成功0 超出缓冲区返回-E2BIG 失败错误代码负值
+int build_domain_trie(const char **names,const unsigned int *records,size_t n,size_t num,
+		struct domain_trie *trie,size_t size);
+
+/// @brief 对db中type类别的有效字面域名建立压缩trie并写入db
+/// 	在最小完美哈希编译之后调用,记录下标以重排后的为准,超出trie区时写入空的trie
+/// @retval 成功返回trie中的域名个数 失败错误代码负值
+int compile_domain_trie(struct bc_domain_db *db,enum domain_type type);
+#endif /// USER_SPACE
+
+#endif /// _BC_DOMAIN_TRIE_H
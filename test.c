@@ -1,6 +1,18 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/bottom_half.h>
 
 #include "bc_domain_search.h"
 
@@ -13,6 +25,446 @@ module_param(test_domain,charp,0000);
 MODULE_PARM_DESC(test_domain,"test domain string");
 module_param(type,int,0644);
 MODULE_PARM_DESC(type,"type for domain");
+static int bench_loops=0;
+module_param(bench_loops,int,0644);
+MODULE_PARM_DESC(bench_loops,"lookups per thread per type in both the untimed and the sampled pass, 0 skips the benchmark at load; "
+		"load bc_domain_mem with result_cache=0 to measure the index");
+static int bench_threads=1;
+module_param(bench_threads,int,0644);
+MODULE_PARM_DESC(bench_threads,"benchmark kthreads, bound round-robin to bench_cpus");
+static char *bench_cpus="";
+module_param(bench_cpus,charp,0644);
+MODULE_PARM_DESC(bench_cpus,"cpu list for the kthreads, e.g. 0-3,8; empty for all online cpus");
+static int bench_type=-1;
+module_param(bench_type,int,0644);
+MODULE_PARM_DESC(bench_type,"type to benchmark, -1 for every type");
+static int hit_ratio=90;
+module_param(hit_ratio,int,0644);
+MODULE_PARM_DESC(hit_ratio,"percent of queries taken from the db, the rest get a random extra label");
+static int bench_names=4096;
+module_param(bench_names,int,0644);
+MODULE_PARM_DESC(bench_names,"query domains generated per type");
+static bool bench_bh=true;
+module_param(bench_bh,bool,0644);
+MODULE_PARM_DESC(bench_bh,"run lookups with bottom halves disabled, as in softirq context");
+
+/// 结果proc文件,读取上次的结果,写入任意内容以当前参数重新测试
+#define BENCH_PROC_NAME "bc_domain_bench"
+/// 延迟直方图的桶个数,每桶1纳秒,更长的计入最后一个桶
+#define BENCH_HIST_SIZE 4096
+/// 关闭下半部时每批的查找次数,批之间开放下半部并让出cpu
+#define BENCH_BATCH 64
+/// 计时的一遍中每BENCH_SAMPLE次查找计时一次
+#define BENCH_SAMPLE 16
+/// 报告的百分位,以千分之一为单位
+static const unsigned int bench_permille[]={500,900,990,999};
+
+/// 单个类别的查询域名
+struct bench_queries
+{
+	char (*names)[DOMAIN_MAX_LENGTH];
+	unsigned char *lens;
+	size_t num;
+	size_t hits;          ///< 取自db的个数
+};
+
+/// 单个测试线程
+struct bench_thread
+{
+	const struct bench_queries *queries;
+	int type;
+	int cpu;
+	u64 loops;            ///< 查找次数
+	bool bh;              ///< 是否关闭下半部
+	unsigned int *hist;   ///< 抽样查找耗时的直方图
+	u64 ops;
+	u64 matched;
+	u64 errors;
+	u64 total_ns;         ///< 不计时一遍的耗时
+	u64 samples;          ///< 计时的查找次数
+	u64 max_ns;
+	u64 start;            ///< 不计时一遍开始与结束的时刻
+	u64 end;
+	struct completion done;
+};
+
+/// 单个类别的结果
+struct bench_result
+{
+	u64 ops;
+	u64 matched;
+	u64 errors;
+	u64 total_ns;
+	u64 samples;
+	u64 max_ns;
+	u64 wall_ns;          ///< 不计时一遍最早开始到最晚结束
+	unsigned int percentile[ARRAY_SIZE(bench_permille)];
+	size_t names;
+	size_t hits;
+	bool valid;
+};
+
+static struct proc_dir_entry *bench_proc=NULL;
+/// 串行化测试,并保护结果
+static DEFINE_MUTEX(bench_lock);
+static struct bench_result bench_results[DOMAIN_TYPE_NUM];
+/// 上次测试的参数
+static int last_loops=0;
+static int last_threads=0;
+static int last_hit_ratio=0;
+static bool last_bh=false;
+static char last_cpus[64];
+static u64 clock_ns=0;
+
+/// @breif 测量连续两次读取时钟的最小间隔,即每次计时的额外开销
+static u64 bench_clock_overhead(void)
+{
+	u64 best=U64_MAX;
+	int i=0;
+	for(i=0;i<1000;i++)
+	{
+		u64 a=ktime_get_ns();
+		u64 b=ktime_get_ns();
+		if(b-a<best)
+			best=b-a;
+	}
+	return best;
+}
+
+/// @breif 释放查询域名
+static void bench_free_queries(struct bench_queries *q)
+{
+	vfree(q->names);
+	vfree(q->lens);
+	memset(q,0,sizeof(*q));
+}
+
+/// @breif 生成type类别的查询域名
+/// 	hit_ratio%取自db中的有效字面域名,其余在其前面加一个随机标签,
+/// 	长度与后缀和命中的域名相近,通常不匹配(可能匹配通配规则)
+/// @retval 成功0 失败错误代码负值
+static int bench_make_queries(struct bench_queries *q,int type)
+{
+	char (*pool)[DOMAIN_MAX_LENGTH]=NULL;
+	size_t pool_num=0;
+	size_t i=0;
+	int err=0;
+	memset(q,0,sizeof(*q));
+	q->names=vzalloc((size_t)bench_names*DOMAIN_MAX_LENGTH);
+	q->lens=vzalloc(bench_names);
+	if(NULL==q->names||NULL==q->lens)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	/// 取出db中的有效字面域名
+	for(i=0;;i++)
+	{
+		char name[DOMAIN_MAX_LENGTH];
+		int len=bc_domain_get_name(type,i,name,sizeof(name));
+		if(-ERANGE==len)
+			break;
+		if(len<=0)
+			continue;
+		if(pool_num%256==0)
+		{
+			char (*p)[DOMAIN_MAX_LENGTH]=vzalloc((pool_num+256)*DOMAIN_MAX_LENGTH);
+			if(NULL==p)
+			{
+				err=-ENOMEM;
+				goto out;
+			}
+			if(NULL!=pool)
+				memcpy(p,pool,pool_num*DOMAIN_MAX_LENGTH);
+			vfree(pool);
+			pool=p;
+		}
+		memcpy(pool[pool_num++],name,len+1);
+	}
+	for(i=0;i<bench_names;i++)
+	{
+		const char *base=pool_num>0?pool[get_random_u32()%pool_num]:"bench.invalid";
+		int len=0;
+		if(pool_num>0&&get_random_u32()%100<hit_ratio)
+		{
+			len=scnprintf(q->names[i],DOMAIN_MAX_LENGTH,"%s",base);
+			q->hits++;
+		}
+		else
+			len=scnprintf(q->names[i],DOMAIN_MAX_LENGTH,"m%x.%s",get_random_u32(),base);
+		q->lens[i]=len;
+	}
+	q->num=bench_names;
+out:
+	vfree(pool);
+	if(err<0)
+		bench_free_queries(q);
+	return err;
+}
+
+/// @breif 从pos开始依次查找loops次
+/// 	timed为true时每BENCH_SAMPLE次查找计时一次并记录到直方图,否则统计匹配结果
+static void bench_loop(struct bench_thread *t,size_t *pos,bool timed)
+{
+	const struct bench_queries *q=t->queries;
+	u64 i=0;
+	while(i<t->loops)
+	{
+		int k=0;
+		if(t->bh)
+			local_bh_disable();
+		for(k=0;k<BENCH_BATCH&&i<t->loops;k++,i++)
+		{
+			int ret=0;
+			if(timed&&0==i%BENCH_SAMPLE)
+			{
+				u64 begin=ktime_get_ns();
+				u64 ns=0;
+				ret=bc_domain_match_n(q->names[*pos],q->lens[*pos],t->type);
+				ns=ktime_get_ns()-begin;
+				t->hist[ns<BENCH_HIST_SIZE?ns:BENCH_HIST_SIZE-1]++;
+				t->samples++;
+				if(ns>t->max_ns)
+					t->max_ns=ns;
+			}
+			else
+				ret=bc_domain_match_n(q->names[*pos],q->lens[*pos],t->type);
+			if(!timed&&ret>0)
+				t->matched++;
+			else if(!timed&&ret<0)
+				t->errors++;
+			if(++*pos==q->num)
+				*pos=0;
+		}
+		if(t->bh)
+			local_bh_enable();
+		cond_resched();
+	}
+}
+
+/// @breif 测试线程,先不计时地查找bench_loops次测量吞吐,再抽样计时查找bench_loops次测量耗时分布
+static int bench_thread_fn(void *arg)
+{
+	struct bench_thread *t=arg;
+	size_t pos=get_random_u32()%t->queries->num;
+	t->start=ktime_get_ns();
+	bench_loop(t,&pos,false);
+	t->end=ktime_get_ns();
+	t->ops=t->loops;
+	t->total_ns=t->end-t->start;
+	bench_loop(t,&pos,true);
+	complete(&t->done);
+	return 0;
+}
+
+/// @breif 依据合并的直方图计算各百分位
+static void bench_percentile(struct bench_result *r,const unsigned int *hist)
+{
+	size_t k=0;
+	for(k=0;k<ARRAY_SIZE(bench_permille);k++)
+	{
+		u64 target=div_u64(r->samples*bench_permille[k]+999,1000);
+		u64 sum=0;
+		unsigned int ns=0;
+		for(ns=0;ns<BENCH_HIST_SIZE;ns++)
+		{
+			sum+=hist[ns];
+			if(sum>=target)
+				break;
+		}
+		r->percentile[k]=ns;
+	}
+}
+
+/// @breif 在mask中的cpu上以bench_threads个线程测试type类别
+/// @retval 成功0 失败错误代码负值
+static int bench_run_type(int type,const struct cpumask *mask,struct bench_result *r)
+{
+	struct bench_queries q;
+	struct bench_thread *threads=NULL;
+	unsigned int *hist=NULL;
+	u64 start=0;
+	u64 end=0;
+	int cpu=-1;
+	int started=0;
+	int i=0;
+	int err=0;
+
+	memset(r,0,sizeof(*r));
+	if((err=bench_make_queries(&q,type))<0)
+		return err;
+	threads=kcalloc(bench_threads,sizeof(*threads),GFP_KERNEL);
+	hist=vzalloc((size_t)(bench_threads+1)*BENCH_HIST_SIZE*sizeof(unsigned int));
+	if(NULL==threads||NULL==hist)
+	{
+		err=-ENOMEM;
+		goto out;
+	}
+	for(i=0;i<bench_threads;i++)
+	{
+		struct bench_thread *t=threads+i;
+		struct task_struct *task=NULL;
+		/// 依次绑定到mask中的cpu
+		cpu=cpumask_next(cpu,mask);
+		if(cpu>=nr_cpu_ids)
+			cpu=cpumask_first(mask);
+		t->queries=&q;
+		t->type=type;
+		t->cpu=cpu;
+		t->loops=last_loops;
+		t->bh=last_bh;
+		t->hist=hist+(size_t)(i+1)*BENCH_HIST_SIZE;
+		init_completion(&t->done);
+		task=kthread_create_on_node(bench_thread_fn,t,cpu_to_node(cpu),"bc_bench/%d",cpu);
+		if(IS_ERR(task))
+		{
+			err=PTR_ERR(task);
+			break;
+		}
+		kthread_bind(task,cpu);
+		wake_up_process(task);
+		started++;
+	}
+	for(i=0;i<started;i++)
+		wait_for_completion(&threads[i].done);
+	if(err<0)
+		goto out;
+	/// 合并各线程的结果
+	start=threads[0].start;
+	end=threads[0].end;
+	for(i=0;i<started;i++)
+	{
+		struct bench_thread *t=threads+i;
+		int ns=0;
+		r->ops+=t->ops;
+		r->matched+=t->matched;
+		r->errors+=t->errors;
+		r->total_ns+=t->total_ns;
+		r->samples+=t->samples;
+		if(t->max_ns>r->max_ns)
+			r->max_ns=t->max_ns;
+		for(ns=0;ns<BENCH_HIST_SIZE;ns++)
+			hist[ns]+=t->hist[ns];
+		if(t->start<start)
+			start=t->start;
+		if(t->end>end)
+			end=t->end;
+	}
+	r->wall_ns=end-start;
+	bench_percentile(r,hist);
+	r->names=q.num;
+	r->hits=q.hits;
+	r->valid=true;
+out:
+	kfree(threads);
+	vfree(hist);
+	bench_free_queries(&q);
+	return err;
+}
+
+/// @breif 以当前参数测试各类别,结果保存在bench_results中
+/// @retval 成功0 失败错误代码负值
+static int bench_run(void)
+{
+	cpumask_var_t mask;
+	int i=0;
+	int err=0;
+	if(bench_loops<=0||bench_threads<=0||bench_threads>1024||bench_names<=0||bench_names>(1<<20)||
+			hit_ratio<0||hit_ratio>100||bench_type<-1||bench_type>=DOMAIN_TYPE_NUM)
+		return -EINVAL;
+	if(!zalloc_cpumask_var(&mask,GFP_KERNEL))
+		return -ENOMEM;
+	if(NULL!=bench_cpus&&'\0'!=bench_cpus[0])
+	{
+		if((err=cpulist_parse(bench_cpus,mask))<0)
+			goto out;
+		cpumask_and(mask,mask,cpu_online_mask);
+	}
+	else
+		cpumask_copy(mask,cpu_online_mask);
+	if(cpumask_empty(mask))
+	{
+		err=-EINVAL;
+		goto out;
+	}
+	mutex_lock(&bench_lock);
+	clock_ns=bench_clock_overhead();
+	last_loops=bench_loops;
+	last_threads=bench_threads;
+	last_hit_ratio=hit_ratio;
+	last_bh=bench_bh;
+	scnprintf(last_cpus,sizeof(last_cpus),"%*pbl",cpumask_pr_args(mask));
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		bench_results[i].valid=false;
+		if(bench_type>=0&&i!=bench_type)
+			continue;
+		if((err=bench_run_type(i,mask,bench_results+i))<0)
+		{
+			printk(KERN_ERR "bench type %d error %d\n",i,err);
+			break;
+		}
+		printk(KERN_INFO "bench type %d: %llu ops %llu ns/op p99 %u ns\n",i,bench_results[i].ops,
+				bench_results[i].ops?div64_u64(bench_results[i].total_ns,bench_results[i].ops):0,
+				bench_results[i].percentile[2]);
+	}
+	mutex_unlock(&bench_lock);
+out:
+	free_cpumask_var(mask);
+	return err;
+}
+
+/// @breif bench proc文件的输出函数
+static int proc_bench_show(struct seq_file *m,void *v)
+{
+	int i=0;
+	mutex_lock(&bench_lock);
+	seq_printf(m,"loops: %d\nthreads: %d\ncpus: %s\nhit_ratio: %d\nbh_disabled: %d\nclock_ns: %llu\nsample: 1/%d\n",
+			last_loops,last_threads,last_cpus,last_hit_ratio,last_bh,clock_ns,BENCH_SAMPLE);
+	seq_printf(m,"type names hits ops matched errors ns_per_op p50 p90 p99 p999 max wall_ms mops\n");
+	for(i=0;i<DOMAIN_TYPE_NUM;i++)
+	{
+		const struct bench_result *r=bench_results+i;
+		u64 avg=0;
+		u64 mops=0;
+		if(!r->valid)
+			continue;
+		if(r->ops>0)
+			avg=div64_u64(r->total_ns,r->ops);
+		/// 每秒百万次,保留两位小数
+		if(r->wall_ns>0)
+			mops=div64_u64(r->ops*100000,r->wall_ns);
+		seq_printf(m,"%d %zu %zu %llu %llu %llu %llu %u %u %u %u %llu %llu %llu.%02llu\n",
+				i,r->names,r->hits,r->ops,r->matched,r->errors,avg,
+				r->percentile[0],r->percentile[1],r->percentile[2],r->percentile[3],
+				r->max_ns,div64_u64(r->wall_ns,1000000),mops/100,mops%100);
+	}
+	mutex_unlock(&bench_lock);
+	return 0;
+}
+
+static int proc_bench_open(struct inode *inode,struct file *file)
+{
+	return single_open(file,proc_bench_show,NULL);
+}
+
+/// @breif bench proc文件的写函数,以当前参数重新测试
+static ssize_t proc_bench_write(struct file *f,const char __user *buf,size_t count,loff_t *offp)
+{
+	int err=0;
+	if((err=bench_run())<0)
+		return err;
+	return count;
+}
+
+static const struct file_operations bench_fops={
+	.owner=THIS_MODULE,
+	.open=proc_bench_open,
+	.read=seq_read,
+	.write=proc_bench_write,
+	.llseek=seq_lseek,
+	.release=single_release,
+};
 
 static int __init test_init(void)
 {
@@ -27,11 +479,20 @@ static int __init test_init(void)
 		printk(KERN_INFO "test %s in %d not match\n",test_domain,type);
 	else
 		printk(KERN_INFO "test %s in %d match\n",test_domain,type);
+	bench_proc=proc_create(BENCH_PROC_NAME,0644,NULL,&bench_fops);
+	if(NULL==bench_proc)
+	{
+		printk(KERN_ERR"count not initialize /proc/%s",BENCH_PROC_NAME);
+		return -ENOMEM;
+	}
+	if(bench_loops>0&&(err=bench_run())<0)
+		printk(KERN_ERR "bench error %d\n",err);
 	return 0;
 }
 
 static void __exit test_exit(void)
 {
+	remove_proc_entry(BENCH_PROC_NAME,NULL);
 }
 
 module_init(test_init);